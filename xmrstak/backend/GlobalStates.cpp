@@ -28,24 +28,86 @@
 #include <cmath>
 #include <chrono>
 #include <cstring>
+#include <thread>
 
 
 namespace xmrstak
 {
 
+GlobalStates::GlobalStates() : iThreadCount(0), iGlobalJobNo(0), iConsumeCnt(0), iGlobalNonce(0),
+	iNonceSpace(uint64_t(1) << 32), iExhaustedJobNo(0), jobSeq(0)
+{
+	// consumers get a stalled job until the first job is published
+	store_work(miner_work());
+}
+
+void GlobalStates::store_work(const miner_work& work)
+{
+	work_image img;
+	memset(&img, 0, sizeof(img));
+	memcpy(img.sJobID, work.sJobID, sizeof(img.sJobID));
+	memcpy(img.bWorkBlob, work.bWorkBlob, work.iWorkSize);
+	img.iTarget = work.iTarget;
+	img.iPoolId = work.iPoolId;
+	img.iWorkSize = work.iWorkSize;
+	img.bNiceHash = work.bNiceHash;
+	img.bStall = work.bStall;
+	img.iNoncePrefixBits = work.iNoncePrefixBits;
+
+	uint64_t words[work_words] = {};
+	memcpy(words, &img, sizeof(img));
+	for(size_t i = 0; i < work_words; ++i)
+		jobWords[i].store(words[i], std::memory_order_relaxed);
+}
+
 void GlobalStates::consume_work( miner_work& threadWork, uint64_t& currentJobId)
 {
-	jobLock.ReadLock();
+	uint64_t words[work_words];
+	while(true)
+	{
+		uint64_t seq = jobSeq.load(std::memory_order_acquire);
+		if(seq & 1)
+		{
+			// switch_work() is writing the job
+			std::this_thread::yield();
+			continue;
+		}
 
-	threadWork = oGlobalWork;
-	currentJobId = iGlobalJobNo.load(std::memory_order_relaxed);
-	
-	jobLock.UnLock();
+		for(size_t i = 0; i < work_words; ++i)
+			words[i] = jobWords[i].load(std::memory_order_relaxed);
+		currentJobId = iGlobalJobNo.load(std::memory_order_relaxed);
+
+		// the copies must be finished before the sequence is checked again
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(jobSeq.load(std::memory_order_relaxed) == seq)
+			break;
+	}
+
+	work_image img;
+	memcpy(&img, words, sizeof(img));
+	memcpy(threadWork.sJobID, img.sJobID, sizeof(img.sJobID));
+	threadWork.iWorkSize = img.iWorkSize;
+	assert(threadWork.iWorkSize <= sizeof(threadWork.bWorkBlob));
+	memcpy(threadWork.bWorkBlob, img.bWorkBlob, img.iWorkSize);
+	threadWork.iTarget = img.iTarget;
+	threadWork.iPoolId = img.iPoolId;
+	threadWork.bNiceHash = img.bNiceHash;
+	threadWork.bStall = img.bStall;
+	threadWork.iNoncePrefixBits = img.iNoncePrefixBits;
 }
 
 void GlobalStates::switch_work(miner_work& pWork, pool_data& dat)
 {
-	jobLock.WriteLock();
+	std::lock_guard<std::mutex> lck(jobWriteMutex);
+
+	// consumers retry as long as the sequence is odd
+	jobSeq.store(jobSeq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	// the job is written first, threads which see the new job number only wait for the end of the switch
+	store_work(pWork);
+	// a thread which sees the new job number must never lease against the nonce space of the old job
+	iNonceSpace.store(uint64_t(1) << (32 - pWork.iNoncePrefixBits), std::memory_order_relaxed);
 
 	/* This notifies all threads that the job has changed.
 	 * To avoid duplicated shared this must be done before the nonce is exchanged.
@@ -61,9 +123,24 @@ void GlobalStates::switch_work(miner_work& pWork, pool_data& dat)
 	 * after the nonce is read.
 	 */
 	dat.iSavedNonce = iGlobalNonce.exchange(dat.iSavedNonce, std::memory_order_relaxed);
-	oGlobalWork = pWork;
-	
-	jobLock.UnLock();
+
+	jobSeq.store(jobSeq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+
+	/* A waiting thread checks the job number while it holds the mutex,
+	 * locking the mutex here avoids that the notification is lost between the check and the wait.
+	 */
+	{
+		std::lock_guard<std::mutex> lck(jobWaitMutex);
+	}
+	jobWaitCv.notify_all();
+}
+
+bool GlobalStates::wait_for_job(uint64_t iJobNo, std::chrono::milliseconds timeout)
+{
+	std::unique_lock<std::mutex> lck(jobWaitMutex);
+	return jobWaitCv.wait_for(lck, timeout, [&]() {
+		return iGlobalJobNo.load(std::memory_order_relaxed) != iJobNo;
+	});
 }
 
 } // namespace xmrstak
@@ -4,9 +4,12 @@
 #include "xmrstak/misc/Environment.hpp"
 #include "xmrstak/misc/console.hpp"
 #include "xmrstak/backend/pool_data.hpp"
-#include "xmrstak/cpputil/read_write_lock.h"
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 
 namespace xmrstak {
 
@@ -22,27 +25,89 @@ struct GlobalStates {
 	//pool_data is in-out winapi style
 	void switch_work(miner_work& pWork, pool_data& dat);
 
-	inline void calc_start_nonce(uint32_t& nonce, bool use_nicehash, uint32_t reserve_count) {
-		if(use_nicehash)
-			nonce = (nonce & 0xFF000000) | iGlobalNonce.fetch_add(reserve_count);
-		else
-			nonce = iGlobalNonce.fetch_add(reserve_count);
+	/** lease nonces of the current job
+	 *
+	 * The nonce space of a job has 2^(32 - iNoncePrefixBits) nonces, a lease never wraps around.
+	 * Backends lease big blocks here and split them with a nonce_range into the ranges of their threads.
+	 *
+	 * @param count number of nonces
+	 * @param[out] offset first nonce of the lease without the nonce prefix of the pool
+	 * @return number of leased nonces, less than count at the end and 0 if the nonce space is exhausted
+	 */
+	inline uint64_t lease_nonces(uint64_t count, uint64_t& offset) {
+		offset = iGlobalNonce.fetch_add(count, std::memory_order_relaxed);
+		const uint64_t space = iNonceSpace.load(std::memory_order_relaxed);
+		if(offset >= space)
+			return 0;
+		return std::min(count, space - offset);
+	}
+
+	/** mark the nonce space of a job as exhausted
+	 *
+	 * @return true for the first caller of a job, only this caller asks the pool for a new job
+	 */
+	inline bool report_nonces_exhausted(uint64_t iJobNo) {
+		return iExhaustedJobNo.exchange(iJobNo, std::memory_order_relaxed) != iJobNo;
+	}
+
+	/** apply the nonce prefix of the pool to a nonce offset */
+	static inline uint32_t nonce_with_prefix(uint32_t blobNonce, uint8_t prefixBits, uint64_t offset) {
+		const uint32_t prefixMask = prefixBits == 0 ? 0 : 0xFFFFFFFFu << (32 - prefixBits);
+		return (blobNonce & prefixMask) | (uint32_t(offset) & ~prefixMask);
 	}
 
 	void consume_work( miner_work& threadWork, uint64_t& currentJobId);
 
-	miner_work oGlobalWork;
+	/** block until the global job number differs from iJobNo
+	 *
+	 * @param timeout maximal waiting time
+	 * @return true if the job was changed, false if the timeout expired
+	 */
+	bool wait_for_job(uint64_t iJobNo, std::chrono::milliseconds timeout);
+
 	uint64_t iThreadCount;
 	std::atomic<uint64_t> iGlobalJobNo;
 	std::atomic<uint64_t> iConsumeCnt;
-	std::atomic<uint32_t> iGlobalNonce;
+	// next nonce offset of the current job, 64 bit to detect the end of the nonce space
+	std::atomic<uint64_t> iGlobalNonce;
+	// number of nonces of the current job
+	std::atomic<uint64_t> iNonceSpace;
+	// last job with an exhausted nonce space
+	std::atomic<uint64_t> iExhaustedJobNo;
 	size_t pool_id = invalid_pool_id;
 
 private:
-	GlobalStates() : iThreadCount(0), iGlobalJobNo(0), iConsumeCnt(0) {
-	}
+	GlobalStates();
+
+	/** trivially copyable image of a miner_work */
+	struct work_image
+	{
+		char sJobID[sizeof(miner_work::sJobID)];
+		uint8_t bWorkBlob[sizeof(miner_work::bWorkBlob)];
+		uint64_t iTarget;
+		uint64_t iPoolId;
+		uint32_t iWorkSize;
+		bool bNiceHash;
+		bool bStall;
+		uint8_t iNoncePrefixBits;
+	};
+	static constexpr size_t work_words = (sizeof(work_image) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	/** write the job into jobWords, the caller must hold jobWriteMutex and the sequence must be odd */
+	void store_work(const miner_work& work);
 
-	::cpputil::RWLock jobLock;
+	/* The global job is published with a seqlock: switch_work() makes the sequence odd,
+	 * writes the job number, nonce and job and makes the sequence even again.
+	 * consume_work() copies the job without a lock and retries if the sequence was changed meanwhile.
+	 * The job is stored in atomic words, a concurrent copy is not a data race.
+	 */
+	std::atomic<uint64_t> jobSeq;
+	std::atomic<uint64_t> jobWords[work_words];
+	// serializes switch_work(), consumers never take it
+	std::mutex jobWriteMutex;
+	// wakes the threads waiting in wait_for_job()
+	std::mutex jobWaitMutex;
+	std::condition_variable jobWaitCv;
 };
 
 } // namespace xmrstak
@@ -14,9 +14,12 @@
   */
 
 #include "xmrstak/backend/cryptonight.hpp"
+#include "xmrstak/backend/GlobalStates.hpp"
 #include "xmrstak/jconf.hpp"
 #include "xmrstak/picosha2/picosha2.hpp"
 #include "xmrstak/params.hpp"
+#include "kernelOptions.hpp"
+#include "spirvKernels.hpp"
 
 #include <stdio.h>
 #include <string.h>
@@ -34,11 +37,18 @@
 #include <string>
 #include <iostream>
 
+#include <thread>
+#include <functional>
+
 #if defined _MSC_VER
 #include <direct.h>
+#include <process.h>
+#include <sys/types.h>
+#include <sys/utime.h>
 #elif defined __GNUC__
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <utime.h>
 #endif
 
 
@@ -68,9 +78,51 @@ static inline void port_sleep(size_t sec)
 {
 	Sleep(sec * 1000);
 }
+
+static inline int get_pid()
+{
+	return _getpid();
+}
+
+static inline bool rename_file(const std::string& from, const std::string& to)
+{
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+struct cache_file_info
+{
+	std::string name;
+	uint64_t size;
+	uint64_t mtime;
+};
+
+static inline std::vector<cache_file_info> list_directory(const std::string& dirname)
+{
+	std::vector<cache_file_info> files;
+	WIN32_FIND_DATAA data;
+	HANDLE h = FindFirstFileA((dirname + "/*").c_str(), &data);
+	if(h == INVALID_HANDLE_VALUE)
+		return files;
+	do
+	{
+		if(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+		ULARGE_INTEGER t;
+		t.LowPart = data.ftLastWriteTime.dwLowDateTime;
+		t.HighPart = data.ftLastWriteTime.dwHighDateTime;
+		// FILETIME is in 100ns steps since 1601, convert to seconds since epoch
+		uint64_t mtime = t.QuadPart / 10000000ull - 11644473600ull;
+		uint64_t size = (uint64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+		files.push_back({data.cFileName, size, mtime});
+	}
+	while(FindNextFileA(h, &data));
+	FindClose(h);
+	return files;
+}
 #else
 #include <unistd.h>
 #include <pwd.h>
+#include <dirent.h>
 
 static inline void create_directory(std::string dirname)
 {
@@ -91,6 +143,43 @@ static inline void port_sleep(size_t sec)
 {
 	sleep(sec);
 }
+
+static inline int get_pid()
+{
+	return getpid();
+}
+
+static inline bool rename_file(const std::string& from, const std::string& to)
+{
+	// rename() atomically replaces an existing target on POSIX systems
+	return rename(from.c_str(), to.c_str()) == 0;
+}
+
+struct cache_file_info
+{
+	std::string name;
+	uint64_t size;
+	uint64_t mtime;
+};
+
+static inline std::vector<cache_file_info> list_directory(const std::string& dirname)
+{
+	std::vector<cache_file_info> files;
+	DIR* dir = opendir(dirname.c_str());
+	if(dir == nullptr)
+		return files;
+	struct dirent* entry;
+	while((entry = readdir(dir)) != nullptr)
+	{
+		struct stat st;
+		std::string path = dirname + "/" + entry->d_name;
+		if(stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+			continue;
+		files.push_back({entry->d_name, uint64_t(st.st_size), uint64_t(st.st_mtime)});
+	}
+	closedir(dir);
+	return files;
+}
 #endif // _WIN32
 
 #if 0
@@ -244,10 +333,306 @@ void Printer::inst()->print_msg(L1,const char* fmt, ...);
 void Printer::inst()->print_str(const char* str);
 #endif
 
+/* Layout of an OpenCL binary cache file:
+ *
+ *   cache_header | driver description | program binary
+ *
+ * The driver description contains the platform version, driver version and device name.
+ * An entry is only used if the description matches the current driver and the checksum
+ * over description and binary is valid.
+ */
+static const char cache_magic[8] = {'X', 'M', 'R', 'C', 'L', 'B', 'I', 'N'};
+static const uint32_t cache_format_version = 1u;
+
+struct cache_header
+{
+	char magic[8];
+	uint32_t formatVersion;
+	uint32_t descSize;
+	uint64_t binSize;
+	uint8_t checksum[32];
+};
+
+static inline std::string get_cache_dir()
+{
+	return get_home() + "/.openclcache";
+}
+
+static inline bool ends_with(const std::string& str, const std::string& suffix)
+{
+	return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static std::string get_driver_description(cl_device_id device, const char* devName)
+{
+	std::string desc;
+	std::vector<char> info(1024);
+	cl_platform_id platform;
+
+	if(clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(cl_platform_id), &platform, NULL) == CL_SUCCESS &&
+		clGetPlatformInfo(platform, CL_PLATFORM_VERSION, info.size(), info.data(), NULL) == CL_SUCCESS)
+		desc += info.data();
+	desc += "|";
+	if(clGetDeviceInfo(device, CL_DRIVER_VERSION, info.size(), info.data(), NULL) == CL_SUCCESS)
+		desc += info.data();
+	desc += "|";
+	desc += devName;
+	return desc;
+}
+
+static void cache_checksum(const std::string& desc, const char* bin, size_t bin_size, uint8_t* checksum)
+{
+	picosha2::hash256_one_by_one hasher;
+	hasher.process(desc.begin(), desc.end());
+	hasher.process(bin, bin + bin_size);
+	hasher.finish();
+	hasher.get_hash_bytes(checksum, checksum + 32);
+}
+
+/** load a precompiled program from the cache
+ *
+ * Invalid entries are removed so that the caller rebuilds them from source.
+ *
+ * @param binary[out] program binary
+ * @return true if a valid entry for the current driver was found, else false
+ */
+static bool load_cache_entry(const std::string& cache_file, const std::string& desc, std::string& binary, size_t deviceIdx)
+{
+	std::ifstream clBinFile(cache_file, std::ifstream::in | std::ifstream::binary);
+	if(!clBinFile.good())
+		return false;
+
+	std::ostringstream ss;
+	ss << clBinFile.rdbuf();
+	clBinFile.close();
+	std::string content = ss.str();
+
+	const char* reason = nullptr;
+	cache_header header;
+	if(content.size() < sizeof(cache_header))
+		reason = "truncated file";
+	else
+	{
+		memcpy(&header, content.data(), sizeof(cache_header));
+		if(memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 || header.formatVersion != cache_format_version)
+			reason = "unknown file format";
+		else if(content.size() != sizeof(cache_header) + header.descSize + header.binSize)
+			reason = "truncated file";
+		else if(content.compare(sizeof(cache_header), header.descSize, desc) != 0)
+			reason = "compiled by a different driver";
+		else
+		{
+			uint8_t checksum[32];
+			cache_checksum(desc, content.data() + sizeof(cache_header) + header.descSize, header.binSize, checksum);
+			if(memcmp(checksum, header.checksum, sizeof(checksum)) != 0)
+				reason = "checksum mismatch";
+		}
+	}
+
+	if(reason != nullptr)
+	{
+		Printer::inst()->print_msg(L1, "OpenCL device %u - Discard precompiled code %s: %s.", deviceIdx, cache_file.c_str(), reason);
+		remove(cache_file.c_str());
+		return false;
+	}
+
+	binary = content.substr(sizeof(cache_header) + header.descSize);
+	// the modification time is the last usage time for the cache eviction
+	utime(cache_file.c_str(), nullptr);
+	return true;
+}
+
+/** store a program binary in the cache
+ *
+ * The entry is written to a unique temporary file and renamed afterwards,
+ * other miner instances sharing the cache never read a partially written file.
+ */
+static void store_cache_entry(const std::string& cache_file, const std::string& desc, const char* bin, size_t bin_size, size_t deviceIdx)
+{
+	cache_header header;
+	memcpy(header.magic, cache_magic, sizeof(cache_magic));
+	header.formatVersion = cache_format_version;
+	header.descSize = desc.size();
+	header.binSize = bin_size;
+	cache_checksum(desc, bin, bin_size, header.checksum);
+
+	std::string tmp_file = cache_file + "." + std::to_string(get_pid()) + "." +
+		std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+
+	std::ofstream file_stream;
+	file_stream.open(tmp_file, std::ofstream::out | std::ofstream::binary);
+	file_stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file_stream.write(desc.data(), desc.size());
+	file_stream.write(bin, bin_size);
+	file_stream.close();
+
+	if(!file_stream.good() || !rename_file(tmp_file, cache_file))
+	{
+		remove(tmp_file.c_str());
+		Printer::inst()->print_msg(L1, "WARNING: OpenCL device %u - Could not store precompiled code in file %s", deviceIdx, cache_file.c_str());
+		return;
+	}
+	Printer::inst()->print_msg(L1, "OpenCL device %u - Precompiled code stored in file %s", deviceIdx, cache_file.c_str());
+}
+
+/** remove the least recently used cache entries until the cache fits into the size limit
+ *
+ * Leftover temporary files of crashed miners are removed too.
+ *
+ * @param limit maximal cache size in byte, 0 disables the limit
+ */
+static void evict_cache_entries(const std::string& cache_dir, uint64_t limit)
+{
+	std::vector<cache_file_info> entries;
+	uint64_t total = 0;
+	uint64_t now = time(nullptr);
+
+	for(auto& file : list_directory(cache_dir))
+	{
+		if(ends_with(file.name, ".openclbin"))
+		{
+			total += file.size;
+			entries.push_back(file);
+		}
+		else if(ends_with(file.name, ".tmp") && file.mtime + 3600 < now)
+			remove((cache_dir + "/" + file.name).c_str());
+	}
+
+	if(limit == 0 || total <= limit)
+		return;
+
+	std::sort(entries.begin(), entries.end(), [](const cache_file_info& a, const cache_file_info& b) {
+		return a.mtime < b.mtime;
+	});
+
+	for(auto& file : entries)
+	{
+		if(total <= limit)
+			break;
+		if(remove((cache_dir + "/" + file.name).c_str()) == 0)
+		{
+			total -= file.size;
+			Printer::inst()->print_msg(L2, "OpenCL cache size limit reached, remove %s", file.name.c_str());
+		}
+	}
+}
+
+/** OpenCL device type selected with the command line option `--openCLDeviceType` */
+static cl_device_type get_device_type()
+{
+	const std::string& type = xmrstak::params::inst().openCLDeviceType;
+	if(type == "cpu")
+		return CL_DEVICE_TYPE_CPU;
+	else if(type == "all")
+		return CL_DEVICE_TYPE_ALL;
+	return CL_DEVICE_TYPE_GPU;
+}
+
+/** create the program from a SPIR-V kernel precompiled at build time
+ *
+ * @return false if no kernel was precompiled for the options, the device is not
+ *         able to consume SPIR-V or the build failed, the caller must compile the source
+ */
+#if defined(CONF_SPIRV) && defined(CL_VERSION_2_1) && !defined(CONF_ENFORCE_OpenCL_1_2)
+static bool load_spirv_program(cl_context opencl_ctx, GpuContext* ctx, int ii, const std::string& options)
+{
+	const spirv_kernel* kernel = find_spirv_kernel(options);
+	if(kernel == nullptr)
+		return false;
+
+	size_t len = 0;
+	if(clGetDeviceInfo(ctx->DeviceID, CL_DEVICE_IL_VERSION, 0, NULL, &len) != CL_SUCCESS || len == 0)
+		return false;
+	std::vector<char> ilVersion(len + 1, '\0');
+	if(clGetDeviceInfo(ctx->DeviceID, CL_DEVICE_IL_VERSION, len, ilVersion.data(), NULL) != CL_SUCCESS)
+		return false;
+	if(std::string(ilVersion.data()).find("SPIR-V") == std::string::npos)
+		return false;
+
+	cl_int ret;
+	cl_program program = clCreateProgramWithIL(opencl_ctx, kernel->data, kernel->size, &ret);
+	if(ret != CL_SUCCESS)
+	{
+		Printer::inst()->print_msg(L1,"OpenCL device %u - Error %s when calling clCreateProgramWithIL, compile the kernel source.", ctx->deviceIdx, err_to_str(ret));
+		return false;
+	}
+
+	// the options are already part of the SPIR-V kernel
+	ret = clBuildProgram(program, 1, &ctx->DeviceID, NULL, NULL, NULL);
+	if(ret != CL_SUCCESS)
+	{
+		Printer::inst()->print_msg(L1,"OpenCL device %u - Error %s when building the SPIR-V kernel, compile the kernel source.", ctx->deviceIdx, err_to_str(ret));
+		clReleaseProgram(program);
+		return false;
+	}
+
+	Printer::inst()->print_msg(L1,"OpenCL device %u - Use the SPIR-V kernel precompiled at build time.", ctx->deviceIdx);
+	ctx->Program[ii] = program;
+	return true;
+}
+#else
+static bool load_spirv_program(cl_context /*opencl_ctx*/, GpuContext* /*ctx*/, int /*ii*/, const std::string& /*options*/)
+{
+	return false;
+}
+#endif
+
+// the work blob is padded to one Keccak block, a blob can be up to 135 byte long
+static const size_t keccak_block_size = 136;
+
+/** (re)create the result buffer with space for `capacity` nonces
+ *
+ * The buffer starts with a counter and the capacity, see store_result() in cryptonight.cl.
+ * The finalizer kernels which are already created get the new buffer as argument.
+ */
+static size_t resize_result_buffer(GpuContext* ctx, size_t capacity)
+{
+	cl_int ret;
+	cl_mem buffer = clCreateBuffer(ctx->opencl_ctx, CL_MEM_READ_WRITE, sizeof(cl_uint) * (capacity + 2), NULL, &ret);
+	if(ret != CL_SUCCESS)
+	{
+		Printer::inst()->print_msg(L1,"Error %s when calling clCreateBuffer to create output buffer.", err_to_str(ret));
+		return ERR_OCL_API;
+	}
+
+	const cl_uint header[2] = { 0, cl_uint(capacity) };
+	if((ret = clEnqueueWriteBuffer(ctx->CommandQueues, buffer, CL_TRUE, 0, sizeof(header), header, 0, NULL, NULL)) != CL_SUCCESS)
+	{
+		Printer::inst()->print_msg(L1,"Error %s when calling clEnqueueWriteBuffer to initialize the output buffer.", err_to_str(ret));
+		clReleaseMemObject(buffer);
+		return ERR_OCL_API;
+	}
+
+	for(int k = 0; k < 2; ++k)
+	{
+		for(int i = 3; i < 7; ++i)
+		{
+			if(ctx->Kernels[k][i] == nullptr)
+				continue;
+			if((ret = clSetKernelArg(ctx->Kernels[k][i], 2, sizeof(cl_mem), &buffer)) != CL_SUCCESS)
+			{
+				Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel %d, argument %d.", err_to_str(ret), i, 2);
+				clReleaseMemObject(buffer);
+				return ERR_OCL_API;
+			}
+		}
+	}
+
+	if(ctx->OutputBuffer != nullptr)
+		clReleaseMemObject(ctx->OutputBuffer);
+	ctx->OutputBuffer = buffer;
+	ctx->resultCapacity = capacity;
+	return ERR_SUCCESS;
+}
+
 size_t InitOpenCLGpu(cl_context opencl_ctx, GpuContext* ctx, const char* source_code) {
 	size_t MaximumWorkSize;
 	cl_int ret;
 
+	// each gpu holds a reference to the context, it is released in ReleaseOpenCLGpu
+	clRetainContext(opencl_ctx);
+	ctx->opencl_ctx = opencl_ctx;
+
 	if((ret = clGetDeviceInfo(ctx->DeviceID, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &MaximumWorkSize, NULL)) != CL_SUCCESS)
 	{
 		Printer::inst()->print_msg(L1,"Error %s when querying a device's max worksize using clGetDeviceInfo.", err_to_str(ret));
@@ -259,11 +644,18 @@ size_t InitOpenCLGpu(cl_context opencl_ctx, GpuContext* ctx, const char* source_
 	 */
 	MaximumWorkSize /= 8;
 	Printer::inst()->print_msg(L1,"Device %lu work size %lu / %lu.", ctx->deviceIdx, ctx->workSize, MaximumWorkSize);
+	const bool profiling = xmrstak::params::inst().openCLProfile;
+	if(profiling)
+		ctx->profile = std::make_shared<gpuProfile>();
 #if defined(CL_VERSION_2_0) && !defined(CONF_ENFORCE_OpenCL_1_2)
-	const cl_queue_properties CommandQueueProperties[] = { 0, 0, 0 };
+	const cl_queue_properties CommandQueueProperties[] = {
+		profiling ? cl_queue_properties(CL_QUEUE_PROPERTIES) : 0,
+		profiling ? cl_queue_properties(CL_QUEUE_PROFILING_ENABLE) : 0,
+		0
+	};
 	ctx->CommandQueues = clCreateCommandQueueWithProperties(opencl_ctx, ctx->DeviceID, CommandQueueProperties, &ret);
 #else
-	const cl_command_queue_properties CommandQueueProperties = { 0 };
+	const cl_command_queue_properties CommandQueueProperties = { profiling ? cl_command_queue_properties(CL_QUEUE_PROFILING_ENABLE) : 0 };
 	ctx->CommandQueues = clCreateCommandQueue(opencl_ctx, ctx->DeviceID, CommandQueueProperties, &ret);
 #endif
 
@@ -273,7 +665,7 @@ size_t InitOpenCLGpu(cl_context opencl_ctx, GpuContext* ctx, const char* source_
 		return ERR_OCL_API;
 	}
 
-	ctx->InputBuffer = clCreateBuffer(opencl_ctx, CL_MEM_READ_ONLY, 88, NULL, &ret);
+	ctx->InputBuffer = clCreateBuffer(opencl_ctx, CL_MEM_READ_ONLY, keccak_block_size, NULL, &ret);
 	if(ret != CL_SUCCESS)
 	{
 		Printer::inst()->print_msg(L1,"Error %s when calling clCreateBuffer to create input buffer.", err_to_str(ret));
@@ -286,60 +678,62 @@ size_t InitOpenCLGpu(cl_context opencl_ctx, GpuContext* ctx, const char* source_
 	);
 
 	size_t g_thd = ctx->rawIntensity;
-	ctx->ExtraBuffers[0] = clCreateBuffer(opencl_ctx, CL_MEM_READ_WRITE, scratchPadSize * g_thd, NULL, &ret);
-	if(ret != CL_SUCCESS)
-	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clCreateBuffer to create hash scratchpads buffer.", err_to_str(ret));
-		return ERR_OCL_API;
-	}
+	ctx->maxRawIntensity = g_thd;
 
-	ctx->ExtraBuffers[1] = clCreateBuffer(opencl_ctx, CL_MEM_READ_WRITE, 200 * g_thd, NULL, &ret);
-	if(ret != CL_SUCCESS)
+	/* The scratchpads are split into partitions if they do not fit into a single buffer,
+	 * the maximal size of an allocation is often only a quarter of the gpu memory.
+	 */
+	cl_ulong maxAlloc = 0;
+	if((ret = clGetDeviceInfo(ctx->DeviceID, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &maxAlloc, NULL)) != CL_SUCCESS)
 	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clCreateBuffer to create hash states buffer.", err_to_str(ret));
+		Printer::inst()->print_msg(L1,"Error %s when calling clGetDeviceInfo to get CL_DEVICE_MAX_MEM_ALLOC_SIZE for device %u.", err_to_str(ret), ctx->deviceIdx);
 		return ERR_OCL_API;
 	}
+	// the threads of a partition are a multiple of the worksize, all partitions except the last one are full
+	size_t partThreads = std::min<cl_ulong>(maxAlloc / scratchPadSize, g_thd);
+	if(partThreads < g_thd)
+		partThreads = std::max<size_t>((partThreads / ctx->workSize) * ctx->workSize, ctx->workSize);
 
-	// Blake-256 branches
-	ctx->ExtraBuffers[2] = clCreateBuffer(opencl_ctx, CL_MEM_READ_WRITE, sizeof(cl_uint) * (g_thd + 2), NULL, &ret);
-	if(ret != CL_SUCCESS)
-	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clCreateBuffer to create Branch 0 buffer.", err_to_str(ret));
-		return ERR_OCL_API;
-	}
+	ctx->partitions.resize((g_thd + partThreads - 1) / partThreads);
+	if(ctx->partitions.size() > 1)
+		Printer::inst()->print_msg(L1,"Device %lu split the scratchpads of %lu threads into %lu buffers.", ctx->deviceIdx, g_thd, ctx->partitions.size());
 
-	// Groestl-256 branches
-	ctx->ExtraBuffers[3] = clCreateBuffer(opencl_ctx, CL_MEM_READ_WRITE, sizeof(cl_uint) * (g_thd + 2), NULL, &ret);
-	if(ret != CL_SUCCESS)
+	for(size_t p = 0; p < ctx->partitions.size(); ++p)
 	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clCreateBuffer to create Branch 1 buffer.", err_to_str(ret));
-		return ERR_OCL_API;
-	}
+		GpuPartition& part = ctx->partitions[p];
+		part.start = p * partThreads;
+		part.maxThreads = std::min(partThreads, g_thd - part.start);
 
-	// JH-256 branches
-	ctx->ExtraBuffers[4] = clCreateBuffer(opencl_ctx, CL_MEM_READ_WRITE, sizeof(cl_uint) * (g_thd + 2), NULL, &ret);
-	if(ret != CL_SUCCESS)
-	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clCreateBuffer to create Branch 2 buffer.", err_to_str(ret));
-		return ERR_OCL_API;
-	}
+		part.ExtraBuffers[0] = clCreateBuffer(opencl_ctx, CL_MEM_READ_WRITE, scratchPadSize * part.maxThreads, NULL, &ret);
+		if(ret != CL_SUCCESS)
+		{
+			Printer::inst()->print_msg(L1,"Error %s when calling clCreateBuffer to create hash scratchpads buffer %u.", err_to_str(ret), int(p));
+			return ERR_OCL_API;
+		}
 
-	// Skein-512 branches
-	ctx->ExtraBuffers[5] = clCreateBuffer(opencl_ctx, CL_MEM_READ_WRITE, sizeof(cl_uint) * (g_thd + 2), NULL, &ret);
-	if(ret != CL_SUCCESS)
-	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clCreateBuffer to create Branch 3 buffer.", err_to_str(ret));
-		return ERR_OCL_API;
-	}
+		part.ExtraBuffers[1] = clCreateBuffer(opencl_ctx, CL_MEM_READ_WRITE, 200 * part.maxThreads, NULL, &ret);
+		if(ret != CL_SUCCESS)
+		{
+			Printer::inst()->print_msg(L1,"Error %s when calling clCreateBuffer to create hash states buffer %u.", err_to_str(ret), int(p));
+			return ERR_OCL_API;
+		}
 
-	// Assume we may find up to 0xFF nonces in one run - it's reasonable
-	ctx->OutputBuffer = clCreateBuffer(opencl_ctx, CL_MEM_READ_WRITE, sizeof(cl_uint) * 0x100, NULL, &ret);
-	if(ret != CL_SUCCESS)
-	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clCreateBuffer to create output buffer.", err_to_str(ret));
-		return ERR_OCL_API;
+		// Blake-256, Groestl-256, JH-256 and Skein-512 branches
+		for(int i = 2; i < 6; ++i)
+		{
+			part.ExtraBuffers[i] = clCreateBuffer(opencl_ctx, CL_MEM_READ_WRITE, sizeof(cl_uint) * (part.maxThreads + 2), NULL, &ret);
+			if(ret != CL_SUCCESS)
+			{
+				Printer::inst()->print_msg(L1,"Error %s when calling clCreateBuffer to create Branch %d buffer %u.", err_to_str(ret), i - 2, int(p));
+				return ERR_OCL_API;
+			}
+		}
 	}
 
+	// start with 0xFF nonces per round, the buffer grows if results are lost
+	if((ret = resize_result_buffer(ctx, ctx->resultCapacity)) != ERR_SUCCESS)
+		return ret;
+
 	std::vector<char> devNameVec(1024);
 	if((ret = clGetDeviceInfo(ctx->DeviceID, CL_DEVICE_NAME, devNameVec.size(), devNameVec.data(), NULL)) != CL_SUCCESS)
 	{
@@ -355,31 +749,52 @@ size_t InitOpenCLGpu(cl_context opencl_ctx, GpuContext* ctx, const char* source_
 
 	for(int ii = 0; ii < num_algos; ++ii)
 	{
-		// scratchpad size for the selected mining algorithm
-		size_t hashMemSize = cn_select_memory(miner_algo[ii]);
-		int threadMemMask = cn_select_mask(miner_algo[ii]);
-		int hashIterations = cn_select_iter(miner_algo[ii]);
-
-		char options[512];
-		snprintf(options, sizeof(options),
-			"-DITERATIONS=%d -DMASK=%d -DWORKSIZE=%llu -DSTRIDED_INDEX=%d -DMEM_CHUNK_EXPONENT=%d  -DCOMP_MODE=%d -DMEMORY=%llu -DALGO=%d",
-		hashIterations, threadMemMask, int_port(ctx->workSize), ctx->stridedIndex, int(1u<<ctx->memChunk), ctx->compMode ? 1 : 0,
-			int_port(hashMemSize), int(miner_algo[ii]));
+		const std::string options = get_kernel_options(miner_algo[ii], ctx->workSize, ctx->stridedIndex, ctx->memChunk, ctx->compMode, ctx->aesMode);
 		/* create a hash for the compile time cache
 		 * used data:
 		 *   - source code
-		 *   - device name
 		 *   - compile parameter
+		 *   - platform version, driver version and device name
 		 */
+		std::string driver_desc = get_driver_description(ctx->DeviceID, devNameVec.data());
 		std::string src_str(source_code);
 		src_str += options;
-		src_str += devNameVec.data();
+		src_str += driver_desc;
 		std::string hash_hex_str;
 		picosha2::hash256_hex_string(src_str, hash_hex_str);
 
-		std::string cache_file = get_home() + "/.openclcache/" + hash_hex_str + ".openclbin";
-		std::ifstream clBinFile(cache_file, std::ofstream::in | std::ofstream::binary);
-		if(xmrstak::params::inst().cache == false || !clBinFile.good())
+		std::string cache_file = get_cache_dir() + "/" + hash_hex_str + ".openclbin";
+		std::string cached_binary;
+		ctx->Program[ii] = nullptr;
+		if(xmrstak::params::inst().cache && load_cache_entry(cache_file, driver_desc, cached_binary, ctx->deviceIdx))
+		{
+			Printer::inst()->print_msg(L1, "OpenCL device %u - Load precompiled code from file %s",ctx->deviceIdx, cache_file.c_str());
+
+			size_t bin_size = cached_binary.size();
+			auto data_ptr = cached_binary.data();
+
+			cl_int clStatus;
+			ctx->Program[ii] = clCreateProgramWithBinary(
+				opencl_ctx, 1, &ctx->DeviceID, &bin_size,
+				(const unsigned char **)&data_ptr, &clStatus, &ret
+			);
+			if(ret == CL_SUCCESS)
+				ret = clBuildProgram(ctx->Program[ii], 1, &ctx->DeviceID, NULL, NULL, NULL);
+			if(ret != CL_SUCCESS)
+			{
+				Printer::inst()->print_msg(L1,"OpenCL device %u - Error %s when loading precompiled code, rebuild it from source.", ctx->deviceIdx, err_to_str(ret));
+				if(ctx->Program[ii] != nullptr)
+					clReleaseProgram(ctx->Program[ii]);
+				ctx->Program[ii] = nullptr;
+				remove(cache_file.c_str());
+			}
+		}
+
+		bool store_binary = false;
+		if(ctx->Program[ii] == nullptr && load_spirv_program(opencl_ctx, ctx, ii, options))
+			store_binary = true;
+
+		if(ctx->Program[ii] == nullptr)
 		{
 			if(xmrstak::params::inst().cache)
 				Printer::inst()->print_msg(L1,"OpenCL device %u - Precompiled code %s not found. Compiling ...",ctx->deviceIdx, cache_file.c_str());
@@ -390,7 +805,7 @@ size_t InitOpenCLGpu(cl_context opencl_ctx, GpuContext* ctx, const char* source_
 				return ERR_OCL_API;
 			}
 
-			ret = clBuildProgram(ctx->Program[ii], 1, &ctx->DeviceID, options, NULL, NULL);
+			ret = clBuildProgram(ctx->Program[ii], 1, &ctx->DeviceID, options.c_str(), NULL, NULL);
 			if(ret != CL_SUCCESS)
 			{
 				size_t len;
@@ -419,10 +834,26 @@ size_t InitOpenCLGpu(cl_context opencl_ctx, GpuContext* ctx, const char* source_
 				return ERR_OCL_API;
 			}
 
+			cl_build_status status;
+			do
+			{
+				if((ret = clGetProgramBuildInfo(ctx->Program[ii], ctx->DeviceID, CL_PROGRAM_BUILD_STATUS, sizeof(cl_build_status), &status, NULL)) != CL_SUCCESS)
+				{
+					Printer::inst()->print_msg(L1,"Error %s when calling clGetProgramBuildInfo for status of build.", err_to_str(ret));
+					return ERR_OCL_API;
+				}
+				port_sleep(1);
+			}
+			while(status == CL_BUILD_IN_PROGRESS);
+			store_binary = true;
+		}
+
+		// store the binary of the device for the next start
+		if(store_binary && xmrstak::params::inst().cache)
+		{
 			cl_uint num_devices;
 			clGetProgramInfo(ctx->Program[ii], CL_PROGRAM_NUM_DEVICES, sizeof(cl_uint), &num_devices,NULL);
 
-
 			std::vector<cl_device_id> devices_ids(num_devices);
 			clGetProgramInfo(ctx->Program[ii], CL_PROGRAM_DEVICES, sizeof(cl_device_id)* devices_ids.size(), devices_ids.data(),NULL);
 			int dev_id = 0;
@@ -436,71 +867,30 @@ size_t InitOpenCLGpu(cl_context opencl_ctx, GpuContext* ctx, const char* source_
 				dev_id++;
 			}
 
-			cl_build_status status;
-			do
-			{
-				if((ret = clGetProgramBuildInfo(ctx->Program[ii], ctx->DeviceID, CL_PROGRAM_BUILD_STATUS, sizeof(cl_build_status), &status, NULL)) != CL_SUCCESS)
-				{
-					Printer::inst()->print_msg(L1,"Error %s when calling clGetProgramBuildInfo for status of build.", err_to_str(ret));
-					return ERR_OCL_API;
-				}
-				port_sleep(1);
-			}
-			while(status == CL_BUILD_IN_PROGRESS);
-
-			if(xmrstak::params::inst().cache) {
-				std::vector<size_t> binary_sizes(num_devices);
-				clGetProgramInfo (ctx->Program[ii], CL_PROGRAM_BINARY_SIZES, sizeof(size_t) * binary_sizes.size(), binary_sizes.data(), NULL);
-
-				std::vector<char*> all_programs(num_devices);
-				std::vector<std::vector<char>> program_storage;
-
-				int p_id = 0;
-				size_t mem_size = 0;
-				// create memory  structure to query all OpenCL program binaries
-				for(auto & p : all_programs)
-				{
-					program_storage.emplace_back(std::vector<char>(binary_sizes[p_id]));
-					all_programs[p_id] = program_storage[p_id].data();
-					mem_size += binary_sizes[p_id];
-					p_id++;
-				}
+			std::vector<size_t> binary_sizes(num_devices);
+			clGetProgramInfo (ctx->Program[ii], CL_PROGRAM_BINARY_SIZES, sizeof(size_t) * binary_sizes.size(), binary_sizes.data(), NULL);
 
-				if((ret = clGetProgramInfo(ctx->Program[ii], CL_PROGRAM_BINARIES, num_devices * sizeof(char*), all_programs.data(),NULL)) != CL_SUCCESS)
-				{
-					Printer::inst()->print_msg(L1,"Error %s when calling clGetProgramInfo.", err_to_str(ret));
-					return ERR_OCL_API;
-				}
+			std::vector<char*> all_programs(num_devices);
+			std::vector<std::vector<char>> program_storage;
 
-				std::ofstream file_stream;
-				file_stream.open(cache_file, std::ofstream::out | std::ofstream::binary);
-				file_stream.write(all_programs[dev_id], binary_sizes[dev_id]);
-				file_stream.close();
-				Printer::inst()->print_msg(L1, "OpenCL device %u - Precompiled code stored in file %s",ctx->deviceIdx, cache_file.c_str());
+			int p_id = 0;
+			size_t mem_size = 0;
+			// create memory  structure to query all OpenCL program binaries
+			for(auto & p : all_programs)
+			{
+				program_storage.emplace_back(std::vector<char>(binary_sizes[p_id]));
+				all_programs[p_id] = program_storage[p_id].data();
+				mem_size += binary_sizes[p_id];
+				p_id++;
 			}
-		} else {
-			Printer::inst()->print_msg(L1, "OpenCL device %u - Load precompiled code from file %s",ctx->deviceIdx, cache_file.c_str());
-			std::ostringstream ss;
-			ss << clBinFile.rdbuf();
-			std::string s = ss.str();
-
-			size_t bin_size = s.size();
-			auto data_ptr = s.data();
 
-			cl_int clStatus;
-			ctx->Program[ii] = clCreateProgramWithBinary(
-				opencl_ctx, 1, &ctx->DeviceID, &bin_size,
-				(const unsigned char **)&data_ptr, &clStatus, &ret
-			);
-			if(ret != CL_SUCCESS) {
-				Printer::inst()->print_msg(L1,"Error %s when calling clCreateProgramWithBinary. Try to delete file %s", err_to_str(ret), cache_file.c_str());
-				return ERR_OCL_API;
-			}
-			ret = clBuildProgram(ctx->Program[ii], 1, &ctx->DeviceID, NULL, NULL, NULL);
-			if(ret != CL_SUCCESS) {
-				Printer::inst()->print_msg(L1,"Error %s when calling clBuildProgram. Try to delete file %s", err_to_str(ret), cache_file.c_str());
+			if((ret = clGetProgramInfo(ctx->Program[ii], CL_PROGRAM_BINARIES, num_devices * sizeof(char*), all_programs.data(),NULL)) != CL_SUCCESS)
+			{
+				Printer::inst()->print_msg(L1,"Error %s when calling clGetProgramInfo.", err_to_str(ret));
 				return ERR_OCL_API;
 			}
+
+			store_cache_entry(cache_file, driver_desc, all_programs[dev_id], binary_sizes[dev_id], ctx->deviceIdx);
 		}
 
 		std::vector<std::string> KernelNames = { "cn0", "cn1", "cn2", "Blake", "Groestl", "JH", "Skein" };
@@ -568,14 +958,14 @@ std::vector<GpuContext> getAMDDevices(int index) {
 		return ctxVec;
 	}
 
-	if((clStatus = clGetDeviceIDs( platforms[index], CL_DEVICE_TYPE_GPU, 0, NULL, &num_devices)) != CL_SUCCESS)
+	if((clStatus = clGetDeviceIDs( platforms[index], get_device_type(), 0, NULL, &num_devices)) != CL_SUCCESS)
 	{
 		Printer::inst()->print_msg(L1,"WARNING: %s when calling clGetDeviceIDs for of devices.", err_to_str(clStatus));
 		return ctxVec;
 	}
 
 	device_list.resize(num_devices);
-	if((clStatus = clGetDeviceIDs( platforms[index], CL_DEVICE_TYPE_GPU, num_devices, device_list.data(), NULL)) != CL_SUCCESS)
+	if((clStatus = clGetDeviceIDs( platforms[index], get_device_type(), num_devices, device_list.data(), NULL)) != CL_SUCCESS)
 	{
 		Printer::inst()->print_msg(L1,"WARNING: %s when calling clGetDeviceIDs for device information.", err_to_str(clStatus));
 		return ctxVec;
@@ -589,7 +979,6 @@ std::vector<GpuContext> getAMDDevices(int index) {
 		}
 
         GpuContext ctx;
-        size_t maxMem;
 		std::string devVendor(devVendorVec.data());
 		std::string selectedOpenCLVendor = xmrstak::params::inst().openCLVendor;
         std::vector<char> devNameVec(1024);
@@ -600,11 +989,6 @@ std::vector<GpuContext> getAMDDevices(int index) {
             continue;
         }
 
-        if((clStatus = clGetDeviceInfo(device_list[k], CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(size_t), &(maxMem), NULL)) != CL_SUCCESS) {
-            Printer::inst()->print_msg(L1,"WARNING: %s when calling clGetDeviceInfo to get CL_DEVICE_MAX_MEM_ALLOC_SIZE for device %u.", err_to_str(clStatus), k);
-            continue;
-        }
-
         if((clStatus = clGetDeviceInfo(device_list[k], CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(size_t), &(ctx.freeMem), NULL)) != CL_SUCCESS) {
             Printer::inst()->print_msg(L1,"WARNING: %s when calling clGetDeviceInfo to get CL_DEVICE_GLOBAL_MEM_SIZE for device %u.", err_to_str(clStatus), k);
             continue;
@@ -615,13 +999,10 @@ std::vector<GpuContext> getAMDDevices(int index) {
             continue;
         }
 
-        if (ctx.isNVIDIA) {
-            maxMem = ctx.freeMem;
-        }
-
-        // if environment variable GPU_SINGLE_ALLOC_PERCENT is not set we can not allocate the full memory
+        // the scratchpads are split if they are larger than CL_DEVICE_MAX_MEM_ALLOC_SIZE, the full memory is usable
         ctx.deviceIdx = k;
-        ctx.freeMem = std::min(ctx.freeMem, maxMem);
+        ctx.platformIdx = index;
+        ctx.platform = platforms[index];
         ctx.name = std::string(devNameVec.data());
         ctx.DeviceID = device_list[k];
         Printer::inst()->print_msg(L0,"Found OpenCL GPU %s.",ctx.name.c_str());
@@ -631,20 +1012,18 @@ std::vector<GpuContext> getAMDDevices(int index) {
 	return ctxVec;
 }
 
-int getAMDPlatformIdx() {
+std::vector<int> getAMDPlatformIdxs() {
 
+	std::vector<int> platformIndexes;
 	uint32_t numPlatforms = getNumPlatforms();
 	if(numPlatforms == 0) {
 		Printer::inst()->print_msg(L0,"WARNING: No OpenCL platform found.");
-		return -1;
+		return platformIndexes;
 	}
-	cl_platform_id *platforms = NULL;
+	std::vector<cl_platform_id> platforms(numPlatforms);
 
-	platforms = (cl_platform_id *) malloc(sizeof(cl_platform_id) * numPlatforms);
-
-	int platformIndex = -1;
 	int mesaPlatform = -1; // Mesa OpenCL is the fallback if no AMD or Apple OpenCL is found
-    auto clStatus = clGetPlatformIDs(numPlatforms, platforms, NULL);
+	auto clStatus = clGetPlatformIDs(numPlatforms, platforms.data(), NULL);
 
 	if(clStatus == CL_SUCCESS) {
 		for (int i = 0; i < numPlatforms; i++) {
@@ -655,310 +1034,305 @@ int getAMDPlatformIdx() {
 			clGetPlatformInfo(platforms[i], CL_PLATFORM_VENDOR, infoSize, platformNameVec.data(), NULL);
 			std::string platformName(platformNameVec.data());
 			std::string selectedOpenCLVendor = xmrstak::params::inst().openCLVendor;
-            Printer::inst()->print_msg(L0,"Found %s platform index id = %i, name = %s", selectedOpenCLVendor.c_str(), i , platformName.c_str());
-            if(platformName.find("Mesa") != std::string::npos) {
-                mesaPlatform = i;
-            } else {
-                // exit if AMD or Apple platform is found
-                platformIndex = i;
-                break;
-            }
+			Printer::inst()->print_msg(L0,"Found %s platform index id = %i, name = %s", selectedOpenCLVendor.c_str(), i , platformName.c_str());
+			if(platformName.find("Mesa") != std::string::npos) {
+				// Mesa exposes the same gpus as the vendor drivers, never use both
+				mesaPlatform = i;
+			} else {
+				platformIndexes.push_back(i);
+			}
 		}
 		// fall back to Mesa OpenCL
-		if(platformIndex == -1 && mesaPlatform != -1) {
+		if(platformIndexes.empty() && mesaPlatform != -1) {
 			Printer::inst()->print_msg(L0,"No AMD platform found select Mesa as OpenCL platform");
-			platformIndex = mesaPlatform;
+			platformIndexes.push_back(mesaPlatform);
 		}
 	} else {
 		Printer::inst()->print_msg(L1,"WARNING: %s when calling clGetPlatformIDs for platform information.", err_to_str(clStatus));
 	}
 
-	free(platforms);
-	return platformIndex;
+	return platformIndexes;
+}
+
+int getAMDPlatformIdx() {
+	std::vector<int> platformIndexes = getAMDPlatformIdxs();
+	return platformIndexes.empty() ? -1 : platformIndexes.front();
 }
 
-// RequestedDeviceIdxs is a list of OpenCL device indexes
-// NumDevicesRequested is number of devices in RequestedDeviceIdxs list
-// Returns 0 on success, -1 on stupid params, -2 on OpenCL API error
-size_t InitOpenCL(GpuContext* ctx, size_t num_gpus, size_t platform_idx) {
+/** OpenCL source code of all kernels, created once */
+static const std::string& get_kernel_source()
+{
+	static const std::string source_code = []() {
+		const char *cryptonightCL =
+				#include "./opencl/cryptonight.cl"
+		;
+		const char *blake256CL =
+				#include "./opencl/blake256.cl"
+		;
+		const char *groestl256CL =
+				#include "./opencl/groestl256.cl"
+		;
+		const char *jhCL =
+				#include "./opencl/jh.cl"
+		;
+		const char *wolfAesCL =
+				#include "./opencl/wolf-aes.cl"
+		;
+		const char *wolfSkeinCL =
+				#include "./opencl/wolf-skein.cl"
+		;
+
+		std::string src(cryptonightCL);
+		src = std::regex_replace(src, std::regex("XMRSTAK_INCLUDE_WOLF_AES"), wolfAesCL);
+		src = std::regex_replace(src, std::regex("XMRSTAK_INCLUDE_WOLF_SKEIN"), wolfSkeinCL);
+		src = std::regex_replace(src, std::regex("XMRSTAK_INCLUDE_JH"), jhCL);
+		src = std::regex_replace(src, std::regex("XMRSTAK_INCLUDE_BLAKE256"), blake256CL);
+		src = std::regex_replace(src, std::regex("XMRSTAK_INCLUDE_GROESTL256"), groestl256CL);
+		return src;
+	}();
+	return source_code;
+}
 
+/** initialize all gpus of one platform within an own OpenCL context
+ *
+ * @param gpus gpus with ctx->platformIdx == platform_idx
+ */
+static size_t InitOpenCLPlatform(std::vector<GpuContext*>& gpus, cl_platform_id platform, size_t platform_idx)
+{
 	cl_context opencl_ctx;
 	cl_int ret;
 	cl_uint entries;
 
-	if((ret = clGetPlatformIDs(0, NULL, &entries)) != CL_SUCCESS) {
-		Printer::inst()->print_msg(L1,"Error %s when calling clGetPlatformIDs for number of platforms.", err_to_str(ret));
-		return ERR_OCL_API;
-	}
-
-
-	// The number of platforms naturally is the index of the last platform plus one.
-	if(entries <= platform_idx) {
-		Printer::inst()->print_msg(L1,"Selected OpenCL platform index %d doesn't exist.", platform_idx);
-		return ERR_STUPID_PARAMS;
-	}
-
-	/*MSVC skimping on devel costs by shoehorning C99 to be a subset of C++? Noooo... can't be.*/
-#ifdef __GNUC__
-	cl_platform_id PlatformIDList[entries];
-#else
-	cl_platform_id* PlatformIDList = (cl_platform_id*)_alloca(entries * sizeof(cl_platform_id));
-#endif
-	if((ret = clGetPlatformIDs(entries, PlatformIDList, NULL)) != CL_SUCCESS) {
-		Printer::inst()->print_msg(L1,"Error %s when calling clGetPlatformIDs for platform ID information.", err_to_str(ret));
-		return ERR_OCL_API;
-	}
-
 	size_t infoSize;
-	clGetPlatformInfo(PlatformIDList[platform_idx], CL_PLATFORM_VENDOR, 0, NULL, &infoSize);
+	clGetPlatformInfo(platform, CL_PLATFORM_VENDOR, 0, NULL, &infoSize);
 	std::vector<char> platformNameVec(infoSize);
-	clGetPlatformInfo(PlatformIDList[platform_idx], CL_PLATFORM_VENDOR, infoSize, platformNameVec.data(), NULL);
+	clGetPlatformInfo(platform, CL_PLATFORM_VENDOR, infoSize, platformNameVec.data(), NULL);
 	std::string platformName(platformNameVec.data());
 	if(xmrstak::params::inst().openCLVendor == "AMD" && platformName.find("Advanced Micro Devices") == std::string::npos)
 	{
 		Printer::inst()->print_msg(L1,"WARNING: using non AMD device: %s", platformName.c_str());
 	}
 
-	if((ret = clGetDeviceIDs(PlatformIDList[platform_idx], CL_DEVICE_TYPE_GPU, 0, NULL, &entries)) != CL_SUCCESS)
+	if((ret = clGetDeviceIDs(platform, get_device_type(), 0, NULL, &entries)) != CL_SUCCESS)
 	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clGetDeviceIDs for number of devices.", err_to_str(ret));
+		Printer::inst()->print_msg(L1,"Error %s when calling clGetDeviceIDs for number of devices on platform %u.", err_to_str(ret), int(platform_idx));
 		return ERR_OCL_API;
 	}
 
 	// Same as the platform index sanity check, except we must check all requested device indexes
-	for(int i = 0; i < num_gpus; ++i)
+	for(auto gpu : gpus)
 	{
-		if(entries <= ctx[i].deviceIdx)
+		if(entries <= gpu->deviceIdx)
 		{
-			Printer::inst()->print_msg(L1,"Selected OpenCL device index %lu doesn't exist.\n", ctx[i].deviceIdx);
+			Printer::inst()->print_msg(L1,"Selected OpenCL device index %lu doesn't exist on platform %u.\n", gpu->deviceIdx, int(platform_idx));
 			return ERR_STUPID_PARAMS;
 		}
 	}
 
-#ifdef __GNUC__
-	cl_device_id DeviceIDList[entries];
-#else
-	cl_device_id* DeviceIDList = (cl_device_id*)_alloca(entries * sizeof(cl_device_id));
-#endif
-	if((ret = clGetDeviceIDs(PlatformIDList[platform_idx], CL_DEVICE_TYPE_GPU, entries, DeviceIDList, NULL)) != CL_SUCCESS)
+	std::vector<cl_device_id> DeviceIDList(entries);
+	if((ret = clGetDeviceIDs(platform, get_device_type(), entries, DeviceIDList.data(), NULL)) != CL_SUCCESS)
 	{
 		Printer::inst()->print_msg(L1,"Error %s when calling clGetDeviceIDs for device ID information.", err_to_str(ret));
 		return ERR_OCL_API;
 	}
 
 	// Indexes sanity checked above
-#ifdef __GNUC__
-	cl_device_id TempDeviceList[num_gpus];
-#else
-	cl_device_id* TempDeviceList = (cl_device_id*)_alloca(entries * sizeof(cl_device_id));
-#endif
-	for(int i = 0; i < num_gpus; ++i)
+	std::vector<cl_device_id> TempDeviceList;
+	for(auto gpu : gpus)
 	{
-		ctx[i].DeviceID = DeviceIDList[ctx[i].deviceIdx];
-		TempDeviceList[i] = DeviceIDList[ctx[i].deviceIdx];
+		gpu->DeviceID = DeviceIDList[gpu->deviceIdx];
+		gpu->platform = platform;
+		TempDeviceList.push_back(gpu->DeviceID);
 	}
 
-	opencl_ctx = clCreateContext(NULL, num_gpus, TempDeviceList, NULL, NULL, &ret);
+	opencl_ctx = clCreateContext(NULL, TempDeviceList.size(), TempDeviceList.data(), NULL, NULL, &ret);
 	if(ret != CL_SUCCESS)
 	{
 		Printer::inst()->print_msg(L1,"Error %s when calling clCreateContext.", err_to_str(ret));
 		return ERR_OCL_API;
 	}
 
-	const char *cryptonightCL =
-			#include "./opencl/cryptonight.cl"
-	;
-	const char *blake256CL =
-			#include "./opencl/blake256.cl"
-	;
-	const char *groestl256CL =
-			#include "./opencl/groestl256.cl"
-	;
-	const char *jhCL =
-			#include "./opencl/jh.cl"
-	;
-	const char *wolfAesCL =
-			#include "./opencl/wolf-aes.cl"
-	;
-	const char *wolfSkeinCL =
-			#include "./opencl/wolf-skein.cl"
-	;
-
-	std::string source_code(cryptonightCL);
-	source_code = std::regex_replace(source_code, std::regex("XMRSTAK_INCLUDE_WOLF_AES"), wolfAesCL);
-	source_code = std::regex_replace(source_code, std::regex("XMRSTAK_INCLUDE_WOLF_SKEIN"), wolfSkeinCL);
-	source_code = std::regex_replace(source_code, std::regex("XMRSTAK_INCLUDE_JH"), jhCL);
-	source_code = std::regex_replace(source_code, std::regex("XMRSTAK_INCLUDE_BLAKE256"), blake256CL);
-	source_code = std::regex_replace(source_code, std::regex("XMRSTAK_INCLUDE_GROESTL256"), groestl256CL);
+	const std::string& source_code = get_kernel_source();
 
-	// create a directory  for the OpenCL compile cache
-	create_directory(get_home() + "/.openclcache");
-
-	for(int i = 0; i < num_gpus; ++i)
+	for(auto gpu : gpus)
 	{
-		if(ctx[i].stridedIndex == 2 && (ctx[i].rawIntensity % ctx[i].workSize) != 0)
+		if(gpu->stridedIndex == 2 && (gpu->rawIntensity % gpu->workSize) != 0)
 		{
-			size_t reduced_intensity = (ctx[i].rawIntensity / ctx[i].workSize) * ctx[i].workSize;
-			ctx[i].rawIntensity = reduced_intensity;
+			size_t reduced_intensity = (gpu->rawIntensity / gpu->workSize) * gpu->workSize;
+			gpu->rawIntensity = reduced_intensity;
 			const std::string backendName = xmrstak::params::inst().openCLVendor;
-			Printer::inst()->print_msg(L0, "WARNING %s: gpu %d intensity is not a multiple of 'worksize', auto reduce intensity to %d", backendName.c_str(), ctx[i].deviceIdx, int(reduced_intensity));
+			Printer::inst()->print_msg(L0, "WARNING %s: gpu %d intensity is not a multiple of 'worksize', auto reduce intensity to %d", backendName.c_str(), gpu->deviceIdx, int(reduced_intensity));
 		}
 
-		if((ret = InitOpenCLGpu(opencl_ctx, &ctx[i], source_code.c_str())) != ERR_SUCCESS) {
+		if((ret = InitOpenCLGpu(opencl_ctx, gpu, source_code.c_str())) != ERR_SUCCESS) {
+			clReleaseContext(opencl_ctx);
 			return ret;
 		}
 	}
 
+	// the gpus hold own references to the context
+	clReleaseContext(opencl_ctx);
 	return ERR_SUCCESS;
 }
 
-size_t XMRSetJob(GpuContext* ctx, uint8_t* input, size_t input_len, uint64_t target, xmrstak_algo miner_algo)
-{
-	// switch to the kernel storage
-	int kernel_storage = miner_algo == ::jconf::inst()->GetCurrentCoinSelection().GetDescription().GetMiningAlgo() ? 0 : 1;
+// ctx is a list of gpus, each gpu selects the device with platformIdx and deviceIdx
+// num_gpus is number of gpus in the ctx list
+// Returns 0 on success, 1 on stupid params, 2 on OpenCL API error
+size_t InitOpenCL(GpuContext* ctx, size_t num_gpus) {
 
 	cl_int ret;
+	cl_uint entries;
 
-	if(input_len > 84)
-		return ERR_STUPID_PARAMS;
-
-	input[input_len] = 0x01;
-	memset(input + input_len + 1, 0, 88 - input_len - 1);
-
-	size_t numThreads = ctx->rawIntensity;
-
-	if((ret = clEnqueueWriteBuffer(ctx->CommandQueues, ctx->InputBuffer, CL_TRUE, 0, 88, input, 0, NULL, NULL)) != CL_SUCCESS)
-	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clEnqueueWriteBuffer to fill input buffer.", err_to_str(ret));
+	if((ret = clGetPlatformIDs(0, NULL, &entries)) != CL_SUCCESS) {
+		Printer::inst()->print_msg(L1,"Error %s when calling clGetPlatformIDs for number of platforms.", err_to_str(ret));
 		return ERR_OCL_API;
 	}
 
-	if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][0], 0, sizeof(cl_mem), &ctx->InputBuffer)) != CL_SUCCESS)
-	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel 0, argument 0.", err_to_str(ret));
+	std::vector<cl_platform_id> PlatformIDList(entries);
+	if((ret = clGetPlatformIDs(entries, PlatformIDList.data(), NULL)) != CL_SUCCESS) {
+		Printer::inst()->print_msg(L1,"Error %s when calling clGetPlatformIDs for platform ID information.", err_to_str(ret));
 		return ERR_OCL_API;
 	}
 
-	// Scratchpads
-	if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][0], 1, sizeof(cl_mem), ctx->ExtraBuffers + 0)) != CL_SUCCESS)
-	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel 0, argument 1.", err_to_str(ret));
-		return ERR_OCL_API;
-	}
+	// create a directory  for the OpenCL compile cache
+	create_directory(get_cache_dir());
 
-	// States
-	if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][0], 2, sizeof(cl_mem), ctx->ExtraBuffers + 1)) != CL_SUCCESS)
+	// group the gpus by platform, each platform gets an own context
+	std::vector<size_t> platforms;
+	for(size_t i = 0; i < num_gpus; ++i)
 	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel 0, argument 2.", err_to_str(ret));
-		return ERR_OCL_API;
+		if(std::find(platforms.begin(), platforms.end(), ctx[i].platformIdx) == platforms.end())
+			platforms.push_back(ctx[i].platformIdx);
 	}
 
-	// Threads
-	if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][0], 3, sizeof(cl_ulong), &numThreads)) != CL_SUCCESS)
+	for(size_t platform_idx : platforms)
 	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel 0, argument 3.", err_to_str(ret));
-		return(ERR_OCL_API);
-	}
+		// The number of platforms naturally is the index of the last platform plus one.
+		if(entries <= platform_idx) {
+			Printer::inst()->print_msg(L1,"Selected OpenCL platform index %d doesn't exist.", int(platform_idx));
+			return ERR_STUPID_PARAMS;
+		}
 
-	// CN1 Kernel
+		std::vector<GpuContext*> gpus;
+		for(size_t i = 0; i < num_gpus; ++i)
+		{
+			if(ctx[i].platformIdx == platform_idx)
+				gpus.push_back(&ctx[i]);
+		}
 
-	// Scratchpads
-	if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][1], 0, sizeof(cl_mem), ctx->ExtraBuffers + 0)) != CL_SUCCESS)
-	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel 1, argument 0.", err_to_str(ret));
-		return ERR_OCL_API;
+		if((ret = InitOpenCLPlatform(gpus, PlatformIDList[platform_idx], platform_idx)) != ERR_SUCCESS)
+			return ret;
 	}
 
-	// States
-	if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][1], 1, sizeof(cl_mem), ctx->ExtraBuffers + 1)) != CL_SUCCESS)
-	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel 1, argument 1.", err_to_str(ret));
-		return ERR_OCL_API;
-	}
+	if(xmrstak::params::inst().cache)
+		evict_cache_entries(get_cache_dir(), uint64_t(xmrstak::params::inst().cacheLimit) * 1024u * 1024u);
 
-	// Threads
-	if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][1], 2, sizeof(cl_ulong), &numThreads)) != CL_SUCCESS)
-	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel 1, argument 2.", err_to_str(ret));
-		return(ERR_OCL_API);
-	}
+	return ERR_SUCCESS;
+}
 
-	if(miner_algo == cryptonight_monero || miner_algo == cryptonight_aeon || miner_algo == cryptonight_ipbc || miner_algo == cryptonight_stellite || miner_algo == cryptonight_masari)
+void ReleaseOpenCLGpu(GpuContext* ctx)
+{
+	for(int ii = 0; ii < 2; ++ii)
 	{
-		// Input
-		if ((ret = clSetKernelArg(ctx->Kernels[kernel_storage][1], 3, sizeof(cl_mem), &ctx->InputBuffer)) != CL_SUCCESS)
+		for(int i = 0; i < 8; ++i)
 		{
-			Printer::inst()->print_msg(L1, "Error %s when calling clSetKernelArg for kernel 1, argument 4(input buffer).", err_to_str(ret));
-			return ERR_OCL_API;
+			// the finalizer kernels of the root algorithm are shared with the main algorithm
+			if(ctx->Kernels[ii][i] != nullptr && (ii == 0 || i < 3))
+				clReleaseKernel(ctx->Kernels[ii][i]);
+			ctx->Kernels[ii][i] = nullptr;
 		}
+		if(ctx->Program[ii] != nullptr)
+			clReleaseProgram(ctx->Program[ii]);
+		ctx->Program[ii] = nullptr;
 	}
 
-	// CN3 Kernel
-	// Scratchpads
-	if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][2], 0, sizeof(cl_mem), ctx->ExtraBuffers + 0)) != CL_SUCCESS)
+	for(auto& part : ctx->partitions)
 	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel 2, argument 0.", err_to_str(ret));
-		return ERR_OCL_API;
+		for(int i = 0; i < 6; ++i)
+		{
+			if(part.ExtraBuffers[i] != nullptr)
+				clReleaseMemObject(part.ExtraBuffers[i]);
+		}
 	}
+	ctx->partitions.clear();
 
-	// States
-	if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][2], 1, sizeof(cl_mem), ctx->ExtraBuffers + 1)) != CL_SUCCESS)
-	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel 2, argument 1.", err_to_str(ret));
-		return ERR_OCL_API;
-	}
+	if(ctx->InputBuffer != nullptr)
+		clReleaseMemObject(ctx->InputBuffer);
+	ctx->InputBuffer = nullptr;
+
+	if(ctx->OutputBuffer != nullptr)
+		clReleaseMemObject(ctx->OutputBuffer);
+	ctx->OutputBuffer = nullptr;
+
+	if(ctx->CommandQueues != nullptr)
+		clReleaseCommandQueue(ctx->CommandQueues);
+	ctx->CommandQueues = nullptr;
 
-	// Branch 0
-	if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][2], 2, sizeof(cl_mem), ctx->ExtraBuffers + 2)) != CL_SUCCESS)
+	if(ctx->opencl_ctx != nullptr)
+		clReleaseContext(ctx->opencl_ctx);
+	ctx->opencl_ctx = nullptr;
+}
+
+size_t XMRSetJob(GpuContext* ctx, const uint8_t* input, size_t input_len, size_t nonce_offset, uint64_t target, xmrstak_algo miner_algo)
+{
+	// switch to the kernel storage
+	int kernel_storage = miner_algo == ::jconf::inst()->GetCurrentCoinSelection().GetDescription().GetMiningAlgo() ? 0 : 1;
+
+	cl_int ret;
+
+	if(input_len >= keccak_block_size || nonce_offset + 4 > input_len)
 	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel 2, argument 2.", err_to_str(ret));
-		return ERR_OCL_API;
+		Printer::inst()->print_msg(L1,"OpenCL device %u - Unsupported work blob of %u byte with the nonce at byte %u.",
+			ctx->deviceIdx, (unsigned int)input_len, (unsigned int)nonce_offset);
+		return ERR_STUPID_PARAMS;
 	}
 
-	// Branch 1
-	if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][2], 3, sizeof(cl_mem), ctx->ExtraBuffers + 3)) != CL_SUCCESS)
+	// Keccak padding
+	uint8_t block[keccak_block_size] = {};
+	memcpy(block, input, input_len);
+	block[input_len] = 0x01;
+	block[keccak_block_size - 1] |= 0x80;
+
+	if((ret = clEnqueueWriteBuffer(ctx->CommandQueues, ctx->InputBuffer, CL_TRUE, 0, keccak_block_size, block, 0, NULL, NULL)) != CL_SUCCESS)
 	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel 2, argument 3.", err_to_str(ret));
+		Printer::inst()->print_msg(L1,"Error %s when calling clEnqueueWriteBuffer to fill input buffer.", err_to_str(ret));
 		return ERR_OCL_API;
 	}
 
-	// Branch 2
-	if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][2], 4, sizeof(cl_mem), ctx->ExtraBuffers + 4)) != CL_SUCCESS)
+	if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][0], 0, sizeof(cl_mem), &ctx->InputBuffer)) != CL_SUCCESS)
 	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel 2, argument 4.", err_to_str(ret));
+		Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel 0, argument 0.", err_to_str(ret));
 		return ERR_OCL_API;
 	}
 
-	// Branch 3
-	if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][2], 5, sizeof(cl_mem), ctx->ExtraBuffers + 5)) != CL_SUCCESS)
+	const cl_uint nonceOffset = nonce_offset;
+	if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][0], 4, sizeof(cl_uint), &nonceOffset)) != CL_SUCCESS)
 	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel 2, argument 5.", err_to_str(ret));
+		Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel 0, argument 4.", err_to_str(ret));
 		return ERR_OCL_API;
 	}
 
-	// Threads
-	if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][2], 6, sizeof(cl_ulong), &numThreads)) != CL_SUCCESS)
-	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel 2, argument 6.", err_to_str(ret));
-		return(ERR_OCL_API);
-	}
+	// the scratchpads, states, branches and thread counts are set per partition in XMRRunJob
 
-	for(int i = 0; i < 4; ++i)
+	if(miner_algo == cryptonight_monero || miner_algo == cryptonight_aeon || miner_algo == cryptonight_ipbc || miner_algo == cryptonight_stellite || miner_algo == cryptonight_masari || miner_algo == cryptonight_bittube2)
 	{
-		// States
-		if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][i + 3], 0, sizeof(cl_mem), ctx->ExtraBuffers + 1)) != CL_SUCCESS)
+		// Input
+		if ((ret = clSetKernelArg(ctx->Kernels[kernel_storage][1], 3, sizeof(cl_mem), &ctx->InputBuffer)) != CL_SUCCESS)
 		{
-			Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel %d, argument %d.", err_to_str(ret), i + 3, 0);
+			Printer::inst()->print_msg(L1, "Error %s when calling clSetKernelArg for kernel 1, argument 4(input buffer).", err_to_str(ret));
 			return ERR_OCL_API;
 		}
 
-		// Nonce buffer
-		if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][i + 3], 1, sizeof(cl_mem), ctx->ExtraBuffers + (i + 2))) != CL_SUCCESS)
+		// Nonce offset
+		if ((ret = clSetKernelArg(ctx->Kernels[kernel_storage][1], 4, sizeof(cl_uint), &nonceOffset)) != CL_SUCCESS)
 		{
-			Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel %d, argument %d.", err_to_str(ret), i + 3, 1);
+			Printer::inst()->print_msg(L1, "Error %s when calling clSetKernelArg for kernel 1, argument 5(nonce offset).", err_to_str(ret));
 			return ERR_OCL_API;
 		}
+	}
 
+	for(int i = 0; i < 4; ++i)
+	{
 		// Output
 		if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][i + 3], 2, sizeof(cl_mem), &ctx->OutputBuffer)) != CL_SUCCESS)
 		{
@@ -977,128 +1351,319 @@ size_t XMRSetJob(GpuContext* ctx, uint8_t* input, size_t input_len, uint64_t tar
 	return ERR_SUCCESS;
 }
 
-size_t XMRRunJob(GpuContext* ctx, cl_uint* HashOutput, xmrstak_algo miner_algo)
+/** set the buffers of a partition as arguments of cn0, cn1 and cn2
+ *
+ * OpenCL copies the arguments when a kernel is enqueued, the arguments can be changed
+ * for the next partition without waiting for the previous kernels.
+ *
+ * @param numThreads number of threads of the partition used in this round
+ */
+static size_t set_partition_args(GpuContext* ctx, int kernel_storage, GpuPartition& part, cl_ulong numThreads)
 {
-	// switch to the kernel storage
-	int kernel_storage = miner_algo == ::jconf::inst()->GetCurrentCoinSelection().GetDescription().GetMiningAlgo() ? 0 : 1;
-
 	cl_int ret;
-	cl_uint zero = 0;
-	size_t BranchNonces[4];
-	memset(BranchNonces,0,sizeof(size_t)*4);
 
-	size_t g_intensity = ctx->rawIntensity;
-	size_t w_size = ctx->workSize;
-	size_t g_thd = g_intensity;
-
-	if(ctx->compMode)
+	// CN0 Kernel: scratchpads, states, threads
+	// CN1 Kernel: scratchpads, states, threads
+	const cl_uint argOffset[2] = { 1, 0 };
+	for(int k = 0; k < 2; ++k)
 	{
-		// round up to next multiple of w_size
-		g_thd = ((g_intensity + w_size - 1u) / w_size) * w_size;
-		// number of global threads must be a multiple of the work group size (w_size)
-		assert(g_thd%w_size == 0);
+		if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][k], argOffset[k], sizeof(cl_mem), part.ExtraBuffers + 0)) != CL_SUCCESS ||
+			(ret = clSetKernelArg(ctx->Kernels[kernel_storage][k], argOffset[k] + 1, sizeof(cl_mem), part.ExtraBuffers + 1)) != CL_SUCCESS ||
+			(ret = clSetKernelArg(ctx->Kernels[kernel_storage][k], argOffset[k] + 2, sizeof(cl_ulong), &numThreads)) != CL_SUCCESS)
+		{
+			Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel %d.", err_to_str(ret), k);
+			return ERR_OCL_API;
+		}
 	}
 
-	for(int i = 2; i < 6; ++i)
+	// CN2 Kernel: scratchpads, states, branch 0-3, threads
+	for(int i = 0; i < 6; ++i)
 	{
-		if((ret = clEnqueueWriteBuffer(ctx->CommandQueues, ctx->ExtraBuffers[i], CL_FALSE, sizeof(cl_uint) * g_intensity, sizeof(cl_uint), &zero, 0, NULL, NULL)) != CL_SUCCESS)
+		if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][2], i, sizeof(cl_mem), part.ExtraBuffers + i)) != CL_SUCCESS)
 		{
-			Printer::inst()->print_msg(L1,"Error %s when calling clEnqueueWriteBuffer to zero branch buffer counter %d.", err_to_str(ret), i - 2);
+			Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel 2, argument %d.", err_to_str(ret), i);
 			return ERR_OCL_API;
 		}
 	}
 
-	if((ret = clEnqueueWriteBuffer(ctx->CommandQueues, ctx->OutputBuffer, CL_FALSE, sizeof(cl_uint) * 0xFF, sizeof(cl_uint), &zero, 0, NULL, NULL)) != CL_SUCCESS)
+	if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][2], 6, sizeof(cl_ulong), &numThreads)) != CL_SUCCESS)
 	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clEnqueueReadBuffer to fetch results.", err_to_str(ret));
-		return ERR_OCL_API;
+		Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel 2, argument 6.", err_to_str(ret));
+		return(ERR_OCL_API);
 	}
 
-	clFinish(ctx->CommandQueues);
+	return ERR_SUCCESS;
+}
 
-	size_t Nonce[2] = {ctx->Nonce, 1}, gthreads[2] = { g_thd, 8 }, lthreads[2] = { w_size, 8 };
-	if((ret = clEnqueueNDRangeKernel(ctx->CommandQueues, ctx->Kernels[kernel_storage][0], 2, Nonce, gthreads, lthreads, 0, NULL, NULL)) != CL_SUCCESS)
+/** check if the global job is still the job of the round */
+static inline bool is_stale_job(uint64_t iJobNo)
+{
+	return xmrstak::GlobalStates::inst().iGlobalJobNo.load(std::memory_order_relaxed) != iJobNo;
+}
+
+/** profiling events of one round
+ *
+ * All methods are no-ops if the profiling of the gpu is disabled.
+ */
+struct profile_events
+{
+	profile_events(GpuContext* ctx) : profile(ctx->profile.get())
 	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clEnqueueNDRangeKernel for kernel %d.", err_to_str(ret), 0);
-		return ERR_OCL_API;
+		if(profile)
+			events.reserve(16);
 	}
 
-	size_t tmpNonce = ctx->Nonce;
-
-	if((ret = clEnqueueNDRangeKernel(ctx->CommandQueues, ctx->Kernels[kernel_storage][1], 1, &tmpNonce, &g_thd, &w_size, 0, NULL, NULL)) != CL_SUCCESS)
+	~profile_events()
 	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clEnqueueNDRangeKernel for kernel %d.", err_to_str(ret), 1);
-		return ERR_OCL_API;
+		for(auto& e : events)
+			if(e.second != nullptr)
+				clReleaseEvent(e.second);
 	}
 
-	if((ret = clEnqueueNDRangeKernel(ctx->CommandQueues, ctx->Kernels[kernel_storage][2], 2, Nonce, gthreads, lthreads, 0, NULL, NULL)) != CL_SUCCESS)
+	/** event for the next enqueued command, nullptr if profiling is disabled */
+	cl_event* next(gpuProfile::stage s)
 	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clEnqueueNDRangeKernel for kernel %d.", err_to_str(ret), 2);
-		return ERR_OCL_API;
+		if(!profile)
+			return nullptr;
+		events.emplace_back(s, nullptr);
+		return &events.back().second;
 	}
 
-	if((ret = clEnqueueReadBuffer(ctx->CommandQueues, ctx->ExtraBuffers[2], CL_FALSE, sizeof(cl_uint) * g_intensity, sizeof(cl_uint), BranchNonces, 0, NULL, NULL)) != CL_SUCCESS)
+	/** add the timing of the finished round to the profile of the gpu */
+	void submit()
 	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clEnqueueReadBuffer to fetch results.", err_to_str(ret));
-		return ERR_OCL_API;
+		if(!profile || events.empty())
+			return;
+
+		struct cmd { size_t stage; cl_ulong start; cl_ulong end; };
+		std::vector<cmd> cmds;
+		for(auto& e : events)
+		{
+			cmd c = { e.first, 0, 0 };
+			if(e.second == nullptr ||
+				clGetEventProfilingInfo(e.second, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &c.start, NULL) != CL_SUCCESS ||
+				clGetEventProfilingInfo(e.second, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &c.end, NULL) != CL_SUCCESS)
+				return;
+			cmds.push_back(c);
+		}
+		std::sort(cmds.begin(), cmds.end(), [](const cmd& a, const cmd& b) { return a.start < b.start; });
+
+		double ms[gpuProfile::STAGE_COUNT];
+		std::fill(ms, ms + gpuProfile::STAGE_COUNT, -1.0);
+		ms[gpuProfile::GAP] = 0.0;
+		cl_ulong lastEnd = cmds.front().start;
+		for(auto& c : cmds)
+		{
+			ms[c.stage] = std::max(ms[c.stage], 0.0) + (c.end - c.start) / 1.0e6;
+			if(c.start > lastEnd)
+				ms[gpuProfile::GAP] += (c.start - lastEnd) / 1.0e6;
+			lastEnd = std::max(lastEnd, c.end);
+		}
+		ms[gpuProfile::ROUND] = (lastEnd - cmds.front().start) / 1.0e6;
+		profile->add_round(ms);
 	}
 
-	if((ret = clEnqueueReadBuffer(ctx->CommandQueues, ctx->ExtraBuffers[3], CL_FALSE, sizeof(cl_uint) * g_intensity, sizeof(cl_uint), BranchNonces + 1, 0, NULL, NULL)) != CL_SUCCESS)
+	gpuProfile* profile;
+	std::vector<std::pair<size_t, cl_event>> events;
+};
+
+size_t XMRRunJob(GpuContext* ctx, std::vector<cl_uint>& HashOutput, xmrstak_algo miner_algo, uint64_t iJobNo)
+{
+	HashOutput.clear();
+
+	profile_events prof(ctx);
+
+	// switch to the kernel storage
+	int kernel_storage = miner_algo == ::jconf::inst()->GetCurrentCoinSelection().GetDescription().GetMiningAlgo() ? 0 : 1;
+
+	cl_int ret;
+	cl_uint zero = 0;
+
+	size_t g_intensity = ctx->rawIntensity;
+	size_t w_size = ctx->workSize;
+
+	// number of threads of each partition in this round, the intensity can be smaller than the allocated threads
+	const size_t numParts = ctx->partitions.size();
+	std::vector<size_t> partThreads(numParts, 0);
+	// threads of each branch per partition
+	std::vector<size_t> BranchNonces(numParts * 4, 0);
+	for(size_t p = 0; p < numParts; ++p)
 	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clEnqueueReadBuffer to fetch results.", err_to_str(ret));
-		return ERR_OCL_API;
+		const GpuPartition& part = ctx->partitions[p];
+		if(part.start < g_intensity)
+			partThreads[p] = std::min(part.maxThreads, g_intensity - part.start);
 	}
 
-	if((ret = clEnqueueReadBuffer(ctx->CommandQueues, ctx->ExtraBuffers[4], CL_FALSE, sizeof(cl_uint) * g_intensity, sizeof(cl_uint), BranchNonces + 2, 0, NULL, NULL)) != CL_SUCCESS)
+	/* The transfers are not blocking and use zero and BranchNonces, the queue must be finished
+	 * before an error return releases them.
+	 */
+	auto abort_round = [ctx](size_t err) {
+		clFinish(ctx->CommandQueues);
+		return err;
+	};
+
+	for(size_t p = 0; p < numParts && partThreads[p] != 0; ++p)
 	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clEnqueueReadBuffer to fetch results.", err_to_str(ret));
-		return ERR_OCL_API;
+		for(int i = 2; i < 6; ++i)
+		{
+			if((ret = clEnqueueWriteBuffer(ctx->CommandQueues, ctx->partitions[p].ExtraBuffers[i], CL_FALSE, sizeof(cl_uint) * partThreads[p], sizeof(cl_uint), &zero, 0, NULL, prof.next(gpuProfile::WRITE))) != CL_SUCCESS)
+			{
+				Printer::inst()->print_msg(L1,"Error %s when calling clEnqueueWriteBuffer to zero branch buffer counter %d.", err_to_str(ret), i - 2);
+				return abort_round(ERR_OCL_API);
+			}
+		}
 	}
 
-	if((ret = clEnqueueReadBuffer(ctx->CommandQueues, ctx->ExtraBuffers[5], CL_FALSE, sizeof(cl_uint) * g_intensity, sizeof(cl_uint), BranchNonces + 3, 0, NULL, NULL)) != CL_SUCCESS)
+	if((ret = clEnqueueWriteBuffer(ctx->CommandQueues, ctx->OutputBuffer, CL_FALSE, 0, sizeof(cl_uint), &zero, 0, NULL, prof.next(gpuProfile::WRITE))) != CL_SUCCESS)
 	{
-		Printer::inst()->print_msg(L1,"Error %s when calling clEnqueueReadBuffer to fetch results.", err_to_str(ret));
-		return ERR_OCL_API;
+		Printer::inst()->print_msg(L1,"Error %s when calling clEnqueueWriteBuffer to zero the result counter.", err_to_str(ret));
+		return abort_round(ERR_OCL_API);
 	}
 
-	clFinish(ctx->CommandQueues);
+	// the queue is in order, cn0 starts after the counters are zeroed without waiting on the host
 
-	for(int i = 0; i < 4; ++i)
+	for(size_t p = 0; p < numParts && partThreads[p] != 0; ++p)
 	{
-		if(BranchNonces[i])
+		size_t g_thd = partThreads[p];
+		if(ctx->compMode)
+		{
+			// round up to next multiple of w_size
+			g_thd = ((g_thd + w_size - 1u) / w_size) * w_size;
+			// number of global threads must be a multiple of the work group size (w_size)
+			assert(g_thd%w_size == 0);
+		}
+
+		if((ret = set_partition_args(ctx, kernel_storage, ctx->partitions[p], partThreads[p])) != ERR_SUCCESS)
+			return abort_round(ret);
+
+		// the global offset is the nonce of the first thread of the partition
+		size_t Nonce[2] = {ctx->Nonce + ctx->partitions[p].start, 1}, gthreads[2] = { g_thd, 8 }, lthreads[2] = { w_size, 8 };
+		if((ret = clEnqueueNDRangeKernel(ctx->CommandQueues, ctx->Kernels[kernel_storage][0], 2, Nonce, gthreads, lthreads, 0, NULL, prof.next(gpuProfile::CN0))) != CL_SUCCESS)
+		{
+			Printer::inst()->print_msg(L1,"Error %s when calling clEnqueueNDRangeKernel for kernel %d.", err_to_str(ret), 0);
+			return abort_round(ERR_OCL_API);
+		}
+
+		size_t tmpNonce = Nonce[0];
+
+		if((ret = clEnqueueNDRangeKernel(ctx->CommandQueues, ctx->Kernels[kernel_storage][1], 1, &tmpNonce, &g_thd, &w_size, 0, NULL, prof.next(gpuProfile::CN1))) != CL_SUCCESS)
 		{
-			// Threads
-			if((clSetKernelArg(ctx->Kernels[kernel_storage][i + 3], 4, sizeof(cl_ulong), BranchNonces + i)) != CL_SUCCESS)
+			Printer::inst()->print_msg(L1,"Error %s when calling clEnqueueNDRangeKernel for kernel %d.", err_to_str(ret), 1);
+			return abort_round(ERR_OCL_API);
+		}
+
+		if((ret = clEnqueueNDRangeKernel(ctx->CommandQueues, ctx->Kernels[kernel_storage][2], 2, Nonce, gthreads, lthreads, 0, NULL, prof.next(gpuProfile::CN2))) != CL_SUCCESS)
+		{
+			Printer::inst()->print_msg(L1,"Error %s when calling clEnqueueNDRangeKernel for kernel %d.", err_to_str(ret), 2);
+			return abort_round(ERR_OCL_API);
+		}
+
+		for(int i = 0; i < 4; ++i)
+		{
+			if((ret = clEnqueueReadBuffer(ctx->CommandQueues, ctx->partitions[p].ExtraBuffers[i + 2], CL_FALSE, sizeof(cl_uint) * partThreads[p], sizeof(cl_uint), &BranchNonces[p * 4 + i], 0, NULL, prof.next(gpuProfile::BRANCH_READ))) != CL_SUCCESS)
 			{
-				Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel %d, argument %d.", err_to_str(ret), i + 3, 4);
-				return(ERR_OCL_API);
+				Printer::inst()->print_msg(L1,"Error %s when calling clEnqueueReadBuffer to fetch results.", err_to_str(ret));
+				return abort_round(ERR_OCL_API);
 			}
+		}
+	}
 
-			// round up to next multiple of w_size
-			BranchNonces[i] = ((BranchNonces[i] + w_size - 1u) / w_size) * w_size;
-			// number of global threads must be a multiple of the work group size (w_size)
-			assert(BranchNonces[i]%w_size == 0);
-			size_t tmpNonce = ctx->Nonce;
-			if((ret = clEnqueueNDRangeKernel(ctx->CommandQueues, ctx->Kernels[kernel_storage][i + 3], 1, &tmpNonce, BranchNonces + i, &w_size, 0, NULL, NULL)) != CL_SUCCESS)
+	clFinish(ctx->CommandQueues);
+
+	// skip the finalizers if the job was changed during the round
+	if(is_stale_job(iJobNo))
+	{
+		ctx->Nonce += g_intensity;
+		return ERR_STALE_JOB;
+	}
+
+	for(size_t p = 0; p < numParts && partThreads[p] != 0; ++p)
+	{
+		GpuPartition& part = ctx->partitions[p];
+		for(int i = 0; i < 4; ++i)
+		{
+			size_t& branchThreads = BranchNonces[p * 4 + i];
+			if(branchThreads)
 			{
-				Printer::inst()->print_msg(L1,"Error %s when calling clEnqueueNDRangeKernel for kernel %d.", err_to_str(ret), i + 3);
-				return ERR_OCL_API;
+				// States and nonce buffer of the partition
+				if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][i + 3], 0, sizeof(cl_mem), part.ExtraBuffers + 1)) != CL_SUCCESS ||
+					(ret = clSetKernelArg(ctx->Kernels[kernel_storage][i + 3], 1, sizeof(cl_mem), part.ExtraBuffers + (i + 2))) != CL_SUCCESS)
+				{
+					Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel %d, argument %d.", err_to_str(ret), i + 3, 1);
+					return(ERR_OCL_API);
+				}
+
+				// Threads
+				if((ret = clSetKernelArg(ctx->Kernels[kernel_storage][i + 3], 4, sizeof(cl_ulong), &branchThreads)) != CL_SUCCESS)
+				{
+					Printer::inst()->print_msg(L1,"Error %s when calling clSetKernelArg for kernel %d, argument %d.", err_to_str(ret), i + 3, 4);
+					return(ERR_OCL_API);
+				}
+
+				// round up to next multiple of w_size
+				branchThreads = ((branchThreads + w_size - 1u) / w_size) * w_size;
+				// number of global threads must be a multiple of the work group size (w_size)
+				assert(branchThreads%w_size == 0);
+				size_t tmpNonce = ctx->Nonce + part.start;
+				if((ret = clEnqueueNDRangeKernel(ctx->CommandQueues, ctx->Kernels[kernel_storage][i + 3], 1, &tmpNonce, &branchThreads, &w_size, 0, NULL, prof.next(gpuProfile::stage(gpuProfile::BLAKE + i)))) != CL_SUCCESS)
+				{
+					Printer::inst()->print_msg(L1,"Error %s when calling clEnqueueNDRangeKernel for kernel %d.", err_to_str(ret), i + 3);
+					return ERR_OCL_API;
+				}
 			}
 		}
 	}
 
-	if((ret = clEnqueueReadBuffer(ctx->CommandQueues, ctx->OutputBuffer, CL_TRUE, 0, sizeof(cl_uint) * 0x100, HashOutput, 0, NULL, NULL)) != CL_SUCCESS)
+	// the counter is read together with the first results, the rest of the buffer only if it is required
+	const size_t readAhead = std::min<size_t>(ctx->resultCapacity, 0xFF);
+	HashOutput.resize(readAhead + 2);
+	if((ret = clEnqueueReadBuffer(ctx->CommandQueues, ctx->OutputBuffer, CL_TRUE, 0, sizeof(cl_uint) * HashOutput.size(), HashOutput.data(), 0, NULL, prof.next(gpuProfile::RESULT_READ))) != CL_SUCCESS)
 	{
 		Printer::inst()->print_msg(L1,"Error %s when calling clEnqueueReadBuffer to fetch results.", err_to_str(ret));
 		return ERR_OCL_API;
 	}
 
+	const size_t numFound = HashOutput[0];
+	const size_t numHashValues = std::min(numFound, ctx->resultCapacity);
+	if(numHashValues > readAhead)
+	{
+		HashOutput.resize(numHashValues + 2);
+		if((ret = clEnqueueReadBuffer(ctx->CommandQueues, ctx->OutputBuffer, CL_TRUE, sizeof(cl_uint) * (readAhead + 2), sizeof(cl_uint) * (numHashValues - readAhead),
+			HashOutput.data() + readAhead + 2, 0, NULL, prof.next(gpuProfile::RESULT_READ))) != CL_SUCCESS)
+		{
+			Printer::inst()->print_msg(L1,"Error %s when calling clEnqueueReadBuffer to fetch results.", err_to_str(ret));
+			return ERR_OCL_API;
+		}
+	}
+
 	clFinish(ctx->CommandQueues);
-	auto & numHashValues = HashOutput[0xFF];
-	// avoid out of memory read, we have only storage for 0xFF results
-	if(numHashValues > 0xFF)
-		numHashValues = 0xFF;
+	// remove the counter and the capacity
+	HashOutput.erase(HashOutput.begin(), HashOutput.begin() + 2);
+	HashOutput.resize(numHashValues);
 	ctx->Nonce += g_intensity;
 
+	if(numFound > numHashValues)
+	{
+		// a thread finds at most one nonce, there is no need for a buffer larger than the intensity
+		const size_t capacity = std::min(std::max(ctx->resultCapacity * 2, numFound), std::max(ctx->maxRawIntensity, ctx->resultCapacity));
+		ctx->lostResults += numFound - numHashValues;
+		Printer::inst()->print_msg(L1,"OpenCL device %u - %u results lost, the result buffer has space for %u results.",
+			ctx->deviceIdx, (unsigned int)(numFound - numHashValues), (unsigned int)ctx->resultCapacity);
+		if(capacity > ctx->resultCapacity)
+		{
+			if((ret = resize_result_buffer(ctx, capacity)) != ERR_SUCCESS)
+				return ret;
+			Printer::inst()->print_msg(L1,"OpenCL device %u - Result buffer grown to %u results.", ctx->deviceIdx, (unsigned int)capacity);
+		}
+	}
+
+	// results of an old job are not worth to be verified
+	if(is_stale_job(iJobNo))
+	{
+		HashOutput.clear();
+		return ERR_STALE_JOB;
+	}
+
+	prof.submit();
 	return ERR_SUCCESS;
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "profile.hpp"
 #include "xmrstak/misc/console.hpp"
 #include "xmrstak/jconf.hpp"
 
@@ -10,17 +11,30 @@
 #endif
 
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
 #define ERR_SUCCESS (0)
 #define ERR_OCL_API (2)
 #define ERR_STUPID_PARAMS (1)
+// not an error: the round was abandoned because the job was changed, no results are available
+#define ERR_STALE_JOB (3)
 
 
 
+/** scratchpads, states and branch buffers of a consecutive range of threads */
+struct GpuPartition {
+	// index of the first thread
+	size_t start = 0;
+	// number of threads the buffers are allocated for
+	size_t maxThreads = 0;
+	cl_mem ExtraBuffers[6] = {};
+};
+
 struct GpuContext {
 	/*Input vars*/
+	size_t platformIdx = 0;
 	size_t deviceIdx;
 	size_t rawIntensity;
 	size_t workSize;
@@ -28,18 +42,33 @@ struct GpuContext {
 	int memChunk;
 	bool isNVIDIA = false;
 	int compMode;
+	// source of the AES tables in the OpenCL kernels (AES_MODE)
+	int aesMode = 0;
+	// round time target in milliseconds, 0 = fixed intensity
+	size_t targetLatency = 0;
 
 	/*Output vars*/
 	cl_device_id DeviceID;
-	cl_command_queue CommandQueues;
-	cl_mem InputBuffer;
-	cl_mem OutputBuffer;
-	cl_mem ExtraBuffers[6];
-	cl_program Program[2];
-	cl_kernel Kernels[2][8];
+	cl_platform_id platform = nullptr;
+	cl_context opencl_ctx = nullptr;
+	cl_command_queue CommandQueues = nullptr;
+	cl_mem InputBuffer = nullptr;
+	cl_mem OutputBuffer = nullptr;
+	// the scratchpads are split if they do not fit into one allocation
+	std::vector<GpuPartition> partitions;
+	cl_program Program[2] = {};
+	cl_kernel Kernels[2][8] = {};
 	size_t freeMem;
 	int computeUnits;
 	std::string name;
+	// intensity the buffers are allocated for, rawIntensity can be reduced down to workSize
+	size_t maxRawIntensity;
+	// number of nonces the result buffer can store, the buffer grows if results are lost
+	size_t resultCapacity = 0xFF;
+	// nonces found by the gpu which did not fit into the result buffer
+	uint64_t lostResults = 0;
+	// timing of the OpenCL commands, only set if the profiling is enabled
+	std::shared_ptr<gpuProfile> profile;
 
 	uint32_t Nonce;
 
@@ -47,10 +76,28 @@ struct GpuContext {
 
 uint32_t getNumPlatforms();
 int getAMDPlatformIdx();
+/** all usable platforms, Mesa is only used if no other platform is available */
+std::vector<int> getAMDPlatformIdxs();
 std::vector<GpuContext> getAMDDevices(int index);
 
-size_t InitOpenCL(GpuContext* ctx, size_t num_gpus, size_t platform_idx);
-size_t XMRSetJob(GpuContext* ctx, uint8_t* input, size_t input_len, uint64_t target, xmrstak_algo miner_algo);
-size_t XMRRunJob(GpuContext* ctx, cl_uint* HashOutput, xmrstak_algo miner_algo);
+/** initialize gpus, gpus of different platforms get separate OpenCL contexts */
+size_t InitOpenCL(GpuContext* ctx, size_t num_gpus);
+/** release all OpenCL resources of a gpu
+ *
+ * The context can be initialized again with InitOpenCL afterwards.
+ */
+void ReleaseOpenCLGpu(GpuContext* ctx);
+/** set the work blob and target for the next rounds
+ *
+ * @param input blob with up to 135 byte, the nonce of the thread is inserted at the byte `nonce_offset`
+ */
+size_t XMRSetJob(GpuContext* ctx, const uint8_t* input, size_t input_len, size_t nonce_offset, uint64_t target, xmrstak_algo miner_algo);
+/** run one round
+ *
+ * The round is abandoned with ERR_STALE_JOB as soon as the global job number differs from iJobNo.
+ *
+ * @param HashOutput is set to the nonces found in this round
+ */
+size_t XMRRunJob(GpuContext* ctx, std::vector<cl_uint>& HashOutput, xmrstak_algo miner_algo, uint64_t iJobNo);
 
 
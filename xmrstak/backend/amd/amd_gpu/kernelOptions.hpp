@@ -0,0 +1,21 @@
+#pragma once
+
+#include "xmrstak/backend/cryptonight.hpp"
+
+#include <cstdio>
+#include <string>
+
+/** OpenCL compiler options of the cryptonight kernels
+ *
+ * The options are also the key of the SPIR-V kernels precompiled at build time
+ * and must therefore be created for the runtime and the build tool by this function.
+ */
+inline std::string get_kernel_options(xmrstak_algo algo, size_t workSize, int stridedIndex, int memChunk, bool compMode, int aesMode)
+{
+	char options[512];
+	snprintf(options, sizeof(options),
+		"-DITERATIONS=%d -DMASK=%d -DWORKSIZE=%llu -DSTRIDED_INDEX=%d -DMEM_CHUNK_EXPONENT=%d  -DCOMP_MODE=%d -DMEMORY=%llu -DALGO=%d -DAES_MODE=%d",
+		int(cn_select_iter(algo)), int(cn_select_mask(algo)), (unsigned long long)workSize, stridedIndex, int(1u << memChunk), compMode ? 1 : 0,
+		(unsigned long long)cn_select_memory(algo), int(algo), aesMode);
+	return std::string(options);
+}
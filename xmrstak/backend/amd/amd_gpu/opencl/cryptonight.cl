@@ -435,31 +435,33 @@ inline ulong getIdx()
 
 #define mix_and_propagate(xin) (xin)[(get_local_id(1)) % 8][get_local_id(0)] ^ (xin)[(get_local_id(1) + 1) % 8][get_local_id(0)]
 
+/* replace the bytes of v which overlap with the 32 bit nonce
+ *
+ * @param bit position of the nonce relative to the first bit of v, can be negative
+ */
+inline ulong insert_nonce(ulong v, int bit, ulong nonce)
+{
+	if(bit <= -32 || bit >= 64)
+		return v;
+	if(bit >= 0)
+		return (v & ~(0xFFFFFFFFUL << bit)) | (nonce << bit);
+	return (v & ~(0xFFFFFFFFUL >> -bit)) | (nonce >> -bit);
+}
+
 #define JOIN_DO(x,y) x##y
 #define JOIN(x,y) JOIN_DO(x,y)
 
 __attribute__((reqd_work_group_size(WORKSIZE, 8, 1)))
-__kernel void JOIN(cn0,ALGO)(__global ulong *input, __global uint4 *Scratchpad, __global ulong *states, ulong Threads)
+__kernel void JOIN(cn0,ALGO)(__global ulong *input, __global uint4 *Scratchpad, __global ulong *states, ulong Threads, uint NonceOffset)
 {
 	ulong State[25];
 	uint ExpandedKey1[40];
-	__local uint AES0[256], AES1[256], AES2[256], AES3[256];
+	AES_TABLES_DECL;
 	uint4 text;
 
 	const ulong gIdx = getIdx();
 
-	for(int i = get_local_id(1) * WORKSIZE + get_local_id(0);
-		i < 256;
-		i += WORKSIZE * 8)
-	{
-		const uint tmp = AES0_C[i];
-		AES0[i] = tmp;
-		AES1[i] = rotate(tmp, 8U);
-		AES2[i] = rotate(tmp, 16U);
-		AES3[i] = rotate(tmp, 24U);
-	}
-
-	barrier(CLK_LOCAL_MEM_FENCE);
+	AES_TABLES_INIT(get_local_id(1) * WORKSIZE + get_local_id(0), WORKSIZE * 8);
 
 #if(COMP_MODE==1)
 	// do not use early return here
@@ -476,20 +478,13 @@ __kernel void JOIN(cn0,ALGO)(__global ulong *input, __global uint4 *Scratchpad,
 		Scratchpad += get_group_id(0) * (MEMORY >> 4) * WORKSIZE + MEM_CHUNK * get_local_id(0);
 #endif
 
-		((ulong8 *)State)[0] = vload8(0, input);
-		State[8] = input[8];
-		State[9] = input[9];
-		State[10] = input[10];
-
-		((uint *)State)[9] &= 0x00FFFFFFU;
-		((uint *)State)[9] |= ((get_global_id(0)) & 0xFF) << 24;
-		((uint *)State)[10] &= 0xFF000000U;
-		((uint *)State)[10] |= ((get_global_id(0) >> 8));
-
-		for(int i = 11; i < 25; ++i) State[i] = 0x00UL;
+		// the host pads the blob to one Keccak block (136 byte)
+		const ulong nonce = get_global_id(0) & 0xFFFFFFFFUL;
+		#pragma unroll
+		for(int i = 0; i < 17; ++i)
+			State[i] = insert_nonce(input[i], (int)(NonceOffset << 3) - (i << 6), nonce);
 
-		// Last bit of padding
-		State[16] = 0x8000000000000000UL;
+		for(int i = 17; i < 25; ++i) State[i] = 0x00UL;
 
 		keccakf1600_2(State);
 	}
@@ -525,7 +520,7 @@ __kernel void JOIN(cn0,ALGO)(__global ulong *input, __global uint4 *Scratchpad,
 	{
 		#pragma unroll 10
 		for(int j = 0; j < 10; ++j)
-			text = AES_Round(AES0, AES1, AES2, AES3, text, ((uint4 *)ExpandedKey1)[j]);
+			text = AES_Round(AES_TABLE_ARGS text, ((uint4 *)ExpandedKey1)[j]);
 		barrier(CLK_LOCAL_MEM_FENCE);
 		xin[get_local_id(1)][get_local_id(0)] = text;
 		barrier(CLK_LOCAL_MEM_FENCE);
@@ -544,7 +539,7 @@ __kernel void JOIN(cn0,ALGO)(__global ulong *input, __global uint4 *Scratchpad,
 		{
 			#pragma unroll
 			for(int j = 0; j < 10; ++j)
-				text = AES_Round(AES0, AES1, AES2, AES3, text, ((uint4 *)ExpandedKey1)[j]);
+				text = AES_Round(AES_TABLE_ARGS text, ((uint4 *)ExpandedKey1)[j]);
 
 			Scratchpad[IDX((i << 3) + get_local_id(1))] = text;
 		}
@@ -556,25 +551,16 @@ __attribute__((reqd_work_group_size(WORKSIZE, 1, 1)))
 __kernel void JOIN(cn1,ALGO) (__global uint4 *Scratchpad, __global ulong *states, ulong Threads
 // cryptonight_monero || cryptonight_aeon || cryptonight_ipbc || cryptonight_stellite || cryptonight_masari || cryptonight_bittube2
 #if(ALGO == 3 || ALGO == 5 || ALGO == 6 || ALGO == 7 || ALGO == 8 || ALGO == 10)
-, __global ulong *input
+, __global ulong *input, uint NonceOffset
 #endif
 )
 {
 	ulong a[2], b[2];
-	__local uint AES0[256], AES1[256], AES2[256], AES3[256];
+	AES_TABLES_DECL;
 
 	const ulong gIdx = getIdx();
 
-	for(int i = get_local_id(0); i < 256; i += WORKSIZE)
-	{
-		const uint tmp = AES0_C[i];
-		AES0[i] = tmp;
-		AES1[i] = rotate(tmp, 8U);
-		AES2[i] = rotate(tmp, 16U);
-		AES3[i] = rotate(tmp, 24U);
-	}
-
-	barrier(CLK_LOCAL_MEM_FENCE);
+	AES_TABLES_INIT(get_local_id(0), WORKSIZE);
 // cryptonight_monero || cryptonight_aeon || cryptonight_ipbc || cryptonight_stellite || cryptonight_masari || cryptonight_bittube2
 #if(ALGO == 3 || ALGO == 5 || ALGO == 6 || ALGO == 7 || ALGO == 8 || ALGO == 10)
     uint2 tweak1_2;
@@ -602,10 +588,9 @@ __kernel void JOIN(cn1,ALGO) (__global uint4 *Scratchpad, __global ulong *states
 		b_x = ((uint4 *)b)[0];
 // cryptonight_monero || cryptonight_aeon || cryptonight_ipbc || cryptonight_stellite || cryptonight_masari || cryptonight_bittube2
 #if(ALGO == 3 || ALGO == 5 || ALGO == 6 || ALGO == 7 || ALGO == 8 || ALGO == 10)
-		tweak1_2 = as_uint2(input[4]);
-		tweak1_2.s0 >>= 24;
-		tweak1_2.s0 |= tweak1_2.s1 << 8;
-		tweak1_2.s1 = get_global_id(0);
+		// byte 35 - 42 of the blob including the nonce
+		const ulong tweak = (input[4] >> 24) | (input[5] << 40);
+		tweak1_2 = as_uint2(insert_nonce(tweak, (int)(NonceOffset << 3) - 35 * 8, get_global_id(0) & 0xFFFFFFFFUL));
 		tweak1_2 ^= as_uint2(states[24]);
 #endif
 	}
@@ -627,9 +612,9 @@ __kernel void JOIN(cn1,ALGO) (__global uint4 *Scratchpad, __global ulong *states
 			((uint4 *)c)[0] = Scratchpad[IDX((idx0 & MASK) >> 4)];
 // cryptonight_bittube2
 #if(ALGO == 10)
-			((uint4 *)c)[0] = AES_Round_bittube2(AES0, AES1, AES2, AES3, ((uint4 *)c)[0], ((uint4 *)a)[0]);
+			((uint4 *)c)[0] = AES_Round_bittube2(AES_TABLE_ARGS ((uint4 *)c)[0], ((uint4 *)a)[0]);
 #else
-			((uint4 *)c)[0] = AES_Round(AES0, AES1, AES2, AES3, ((uint4 *)c)[0], ((uint4 *)a)[0]);
+			((uint4 *)c)[0] = AES_Round(AES_TABLE_ARGS ((uint4 *)c)[0], ((uint4 *)a)[0]);
 #endif
 			b_x ^= ((uint4 *)c)[0];
 // cryptonight_monero || cryptonight_aeon || cryptonight_ipbc || cryptonight_stellite || cryptonight_masari || cryptonight_bittube2
@@ -699,25 +684,14 @@ __kernel void JOIN(cn1,ALGO) (__global uint4 *Scratchpad, __global ulong *states
 __attribute__((reqd_work_group_size(WORKSIZE, 8, 1)))
 __kernel void JOIN(cn2,ALGO) (__global uint4 *Scratchpad, __global ulong *states, __global uint *Branch0, __global uint *Branch1, __global uint *Branch2, __global uint *Branch3, ulong Threads)
 {
-	__local uint AES0[256], AES1[256], AES2[256], AES3[256];
+	AES_TABLES_DECL;
 	uint ExpandedKey2[40];
 	ulong State[25];
 	uint4 text;
 
 	const ulong gIdx = getIdx();
 
-	for(int i = get_local_id(1) * WORKSIZE + get_local_id(0);
-		i < 256;
-		i += WORKSIZE * 8)
-	{
-		const uint tmp = AES0_C[i];
-		AES0[i] = tmp;
-		AES1[i] = rotate(tmp, 8U);
-		AES2[i] = rotate(tmp, 16U);
-		AES3[i] = rotate(tmp, 24U);
-	}
-
-	barrier(CLK_LOCAL_MEM_FENCE);
+	AES_TABLES_INIT(get_local_id(1) * WORKSIZE + get_local_id(0), WORKSIZE * 8);
 
 #if(COMP_MODE==1)
 	// do not use early return here
@@ -768,7 +742,7 @@ __kernel void JOIN(cn2,ALGO) (__global uint4 *Scratchpad, __global ulong *states
 
 			#pragma unroll 10
 			for(int j = 0; j < 10; ++j)
-				text = AES_Round(AES0, AES1, AES2, AES3, text, ((uint4 *)ExpandedKey2)[j]);
+				text = AES_Round(AES_TABLE_ARGS text, ((uint4 *)ExpandedKey2)[j]);
 
 
 			barrier(CLK_LOCAL_MEM_FENCE);
@@ -784,7 +758,7 @@ __kernel void JOIN(cn2,ALGO) (__global uint4 *Scratchpad, __global ulong *states
 
 			#pragma unroll 10
 			for(int j = 0; j < 10; ++j)
-				text = AES_Round(AES0, AES1, AES2, AES3, text, ((uint4 *)ExpandedKey2)[j]);
+				text = AES_Round(AES_TABLE_ARGS text, ((uint4 *)ExpandedKey2)[j]);
 
 
 			barrier(CLK_LOCAL_MEM_FENCE);
@@ -801,7 +775,7 @@ __kernel void JOIN(cn2,ALGO) (__global uint4 *Scratchpad, __global ulong *states
 
 			#pragma unroll 10
 			for(int j = 0; j < 10; ++j)
-				text = AES_Round(AES0, AES1, AES2, AES3, text, ((uint4 *)ExpandedKey2)[j]);
+				text = AES_Round(AES_TABLE_ARGS text, ((uint4 *)ExpandedKey2)[j]);
 		}
 #endif
 	}
@@ -816,7 +790,7 @@ __kernel void JOIN(cn2,ALGO) (__global uint4 *Scratchpad, __global ulong *states
 	{
 		#pragma unroll 10
 		for(int j = 0; j < 10; ++j)
-			text = AES_Round(AES0, AES1, AES2, AES3, text, ((uint4 *)ExpandedKey2)[j]);
+			text = AES_Round(AES_TABLE_ARGS text, ((uint4 *)ExpandedKey2)[j]);
 		barrier(CLK_LOCAL_MEM_FENCE);
 		xin[get_local_id(1)][get_local_id(0)] = text;
 		barrier(CLK_LOCAL_MEM_FENCE);
@@ -866,6 +840,17 @@ R"===(
 
 #define VSWAP4(x)	((((x) >> 24) & 0xFFU) | (((x) >> 8) & 0xFF00U) | (((x) << 8) & 0xFF0000U) | (((x) << 24) & 0xFF000000U))
 
+/* The result buffer starts with the number of found nonces followed by the capacity.
+ * The counter is also incremented if the buffer is full, the host detects the lost nonces
+ * and grows the buffer.
+ */
+inline void store_result(__global uint *output, uint nonce)
+{
+	uint outIdx = atomic_inc(output);
+	if(outIdx < output[1])
+		output[outIdx + 2] = nonce;
+}
+
 __kernel void Skein(__global ulong *states, __global uint *BranchBuf, __global uint *output, ulong Target, ulong Threads)
 {
 	const ulong idx = get_global_id(0) - get_global_offset(0);
@@ -916,9 +901,7 @@ __kernel void Skein(__global ulong *states, __global uint *BranchBuf, __global u
 		// and expect an accurate result for target > 32-bit without implementing carries
 		if(p.s3 <= Target)
 		{
-			ulong outIdx = atomic_inc(output + 0xFF);
-			if(outIdx < 0xFF)
-				output[outIdx] = BranchBuf[idx] + get_global_offset(0);
+			store_result(output, BranchBuf[idx] + get_global_offset(0));
 		}
 	}
 	mem_fence(CLK_GLOBAL_MEM_FENCE);
@@ -992,9 +975,7 @@ __kernel void JH(__global ulong *states, __global uint *BranchBuf, __global uint
 		// and expect an accurate result for target > 32-bit without implementing carries
 		if(h7l <= Target)
 		{
-			ulong outIdx = atomic_inc(output + 0xFF);
-			if(outIdx < 0xFF)
-				output[outIdx] = BranchBuf[idx] + get_global_offset(0);
+			store_result(output, BranchBuf[idx] + get_global_offset(0));
 		}
 	}
 }
@@ -1070,9 +1051,7 @@ __kernel void Blake(__global ulong *states, __global uint *BranchBuf, __global u
 		uint2 t = (uint2)(h[6],h[7]);
 		if( as_ulong(t) <= Target)
 		{
-			ulong outIdx = atomic_inc(output + 0xFF);
-			if(outIdx < 0xFF)
-				output[outIdx] = BranchBuf[idx] + get_global_offset(0);
+			store_result(output, BranchBuf[idx] + get_global_offset(0));
 		}
 	}
 }
@@ -1131,9 +1110,7 @@ __kernel void Groestl(__global ulong *states, __global uint *BranchBuf, __global
 		// and expect an accurate result for target > 32-bit without implementing carries
 		if(State[7] <= Target)
 		{
-			ulong outIdx = atomic_inc(output + 0xFF);
-			if(outIdx < 0xFF)
-				output[outIdx] = BranchBuf[idx] + get_global_offset(0);
+			store_result(output, BranchBuf[idx] + get_global_offset(0));
 		}
 	}
 }
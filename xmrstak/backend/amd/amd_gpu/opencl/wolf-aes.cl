@@ -74,42 +74,124 @@ static const __constant uint AES0_C[256] =
 
 #define BYTE(x, y)	(amd_bfe((x), (y) << 3U, 8U))
 
-inline uint4 AES_Round_bittube2(const __local uint *AES0, const __local uint *AES1, const __local uint *AES2, const __local uint *AES3, uint4 x, uint4 k)
+/* AES_MODE selects the source of the AES T-tables
+ *   0 = four rotated tables in local memory
+ *   1 = one table in local memory, the other three are rotated on the fly
+ *   2 = table in constant memory, no local memory is used
+ *   3 = no tables, the S-box and MixColumns are computed for all four bytes of a column at once
+ */
+#ifndef AES_MODE
+#	define AES_MODE 0
+#endif
+
+#if(AES_MODE == 0)
+#	define AES_TABLE_PARAMS const __local uint *AES0, const __local uint *AES1, const __local uint *AES2, const __local uint *AES3,
+#	define AES_TABLE_ARGS AES0, AES1, AES2, AES3,
+#	define AES_TABLES_DECL __local uint AES0[256], AES1[256], AES2[256], AES3[256]
+#	define AES_TABLES_INIT(first, step)				\
+	for(int i = (first); i < 256; i += (step))		\
+	{												\
+		const uint tmp = AES0_C[i];					\
+		AES0[i] = tmp;								\
+		AES1[i] = rotate(tmp, 8U);					\
+		AES2[i] = rotate(tmp, 16U);					\
+		AES3[i] = rotate(tmp, 24U);					\
+	}												\
+	barrier(CLK_LOCAL_MEM_FENCE)
+#	define AES_T(t, i) AES##t[i]
+#elif(AES_MODE == 1)
+#	define AES_TABLE_PARAMS const __local uint *AES0,
+#	define AES_TABLE_ARGS AES0,
+#	define AES_TABLES_DECL __local uint AES0[256]
+#	define AES_TABLES_INIT(first, step)				\
+	for(int i = (first); i < 256; i += (step))		\
+		AES0[i] = AES0_C[i];						\
+	barrier(CLK_LOCAL_MEM_FENCE)
+#	define AES_T(t, i) rotate(AES0[i], (t) * 8U)
+#else
+#	define AES_TABLE_PARAMS
+#	define AES_TABLE_ARGS
+#	define AES_TABLES_DECL
+#	define AES_TABLES_INIT(first, step)
+#	define AES_T(t, i) rotate(AES0_C[i], (t) * 8U)
+#endif
+
+#if(AES_MODE == 3)
+
+// multiply each byte by 2 in GF(2^8)
+inline uint aes_xtime4(const uint x)
+{
+	return ((x & 0x7F7F7F7FU) << 1) ^ (((x >> 7) & 0x01010101U) * 0x1BU);
+}
+
+// multiply the four bytes of a and b pairwise in GF(2^8)
+inline uint aes_gf_mul4(uint a, const uint b)
+{
+	uint r = 0U;
+	#pragma unroll
+	for(uint i = 0; i < 8U; ++i)
+	{
+		r ^= a & (((b >> i) & 0x01010101U) * 0xFFU);
+		a = aes_xtime4(a);
+	}
+	return r;
+}
+
+// rotate each byte left by n bits
+#define AES_ROTL_BYTES(x, n) ((((x) << (n)) & (((0xFFU << (n)) & 0xFFU) * 0x01010101U)) | (((x) >> (8U - (n))) & (((1U << (n)) - 1U) * 0x01010101U)))
+
+// AES S-box of four bytes: inverse x^254 in GF(2^8) followed by the affine transformation
+inline uint aes_sbox4(const uint x)
+{
+	const uint x2 = aes_gf_mul4(x, x);
+	const uint x3 = aes_gf_mul4(x2, x);
+	const uint x6 = aes_gf_mul4(x3, x3);
+	const uint x12 = aes_gf_mul4(x6, x6);
+	const uint x14 = aes_gf_mul4(x12, x2);
+	const uint x15 = aes_gf_mul4(x12, x3);
+	const uint x30 = aes_gf_mul4(x15, x15);
+	const uint x60 = aes_gf_mul4(x30, x30);
+	const uint x120 = aes_gf_mul4(x60, x60);
+	const uint x240 = aes_gf_mul4(x120, x120);
+	const uint inv = aes_gf_mul4(x240, x14);
+
+	return inv ^ AES_ROTL_BYTES(inv, 1U) ^ AES_ROTL_BYTES(inv, 2U) ^ AES_ROTL_BYTES(inv, 3U) ^ AES_ROTL_BYTES(inv, 4U) ^ 0x63636363U;
+}
+
+// MixColumns of one column, byte r is row r
+inline uint aes_mix_column(const uint c)
+{
+	const uint r1 = rotate(c, 24U);
+	return aes_xtime4(c ^ r1) ^ r1 ^ rotate(c, 16U) ^ rotate(c, 8U);
+}
+
+// SubBytes and MixColumns of the column built from byte 0 of a, byte 1 of b, byte 2 of c and byte 3 of d
+#	define AES_COLUMN(a, b, c, d) aes_mix_column(aes_sbox4(((a) & 0xFFU) | ((b) & 0xFF00U) | ((c) & 0xFF0000U) | ((d) & 0xFF000000U)))
+#else
+#	define AES_COLUMN(a, b, c, d) (AES_T(0, BYTE(a, 0)) ^ AES_T(1, BYTE(b, 1)) ^ AES_T(2, BYTE(c, 2)) ^ AES_T(3, BYTE(d, 3)))
+#endif
+
+inline uint4 AES_Round_bittube2(AES_TABLE_PARAMS uint4 x, uint4 k)
 {
 	x = ~x;
-	k.s0 ^= AES0[BYTE(x.s0, 0)] ^ AES1[BYTE(x.s1, 1)] ^ AES2[BYTE(x.s2, 2)] ^ AES3[BYTE(x.s3, 3)];
+	k.s0 ^= AES_COLUMN(x.s0, x.s1, x.s2, x.s3);
 	x.s0 ^= k.s0;
-	k.s1 ^= AES0[BYTE(x.s1, 0)] ^ AES1[BYTE(x.s2, 1)] ^ AES2[BYTE(x.s3, 2)] ^ AES3[BYTE(x.s0, 3)];
+	k.s1 ^= AES_COLUMN(x.s1, x.s2, x.s3, x.s0);
 	x.s1 ^= k.s1;
-	k.s2 ^= AES0[BYTE(x.s2, 0)] ^ AES1[BYTE(x.s3, 1)] ^ AES2[BYTE(x.s0, 2)] ^ AES3[BYTE(x.s1, 3)];
+	k.s2 ^= AES_COLUMN(x.s2, x.s3, x.s0, x.s1);
 	x.s2 ^= k.s2;
-	k.s3 ^= AES0[BYTE(x.s3, 0)] ^ AES1[BYTE(x.s0, 1)] ^ AES2[BYTE(x.s1, 2)] ^ AES3[BYTE(x.s2, 3)];
+	k.s3 ^= AES_COLUMN(x.s3, x.s0, x.s1, x.s2);
 	return k;
 }
 
-uint4 AES_Round(const __local uint *AES0, const __local uint *AES1, const __local uint *AES2, const __local uint *AES3, const uint4 X, uint4 key)
+uint4 AES_Round(AES_TABLE_PARAMS const uint4 X, uint4 key)
 {
-	key.s0 ^= AES0[BYTE(X.s0, 0)];
-    key.s1 ^= AES0[BYTE(X.s1, 0)];
-    key.s2 ^= AES0[BYTE(X.s2, 0)];
-    key.s3 ^= AES0[BYTE(X.s3, 0)];
-
-	key.s0 ^= AES2[BYTE(X.s2, 2)];
-    key.s1 ^= AES2[BYTE(X.s3, 2)];
-    key.s2 ^= AES2[BYTE(X.s0, 2)];
-    key.s3 ^= AES2[BYTE(X.s1, 2)];
-
-	key.s0 ^= AES1[BYTE(X.s1, 1)];
-    key.s1 ^= AES1[BYTE(X.s2, 1)];
-    key.s2 ^= AES1[BYTE(X.s3, 1)];
-    key.s3 ^= AES1[BYTE(X.s0, 1)];
-
-	key.s0 ^= AES3[BYTE(X.s3, 3)];
-    key.s1 ^= AES3[BYTE(X.s0, 3)];
-    key.s2 ^= AES3[BYTE(X.s1, 3)];
-    key.s3 ^= AES3[BYTE(X.s2, 3)];
-
-    return key;
+	key.s0 ^= AES_COLUMN(X.s0, X.s1, X.s2, X.s3);
+	key.s1 ^= AES_COLUMN(X.s1, X.s2, X.s3, X.s0);
+	key.s2 ^= AES_COLUMN(X.s2, X.s3, X.s0, X.s1);
+	key.s3 ^= AES_COLUMN(X.s3, X.s0, X.s1, X.s2);
+
+	return key;
 }
 
 #endif
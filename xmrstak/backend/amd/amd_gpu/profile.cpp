@@ -0,0 +1,99 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#include "profile.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+gpuProfile::gpuProfile() : rounds(0)
+{
+	for(size_t s = 0; s < STAGE_COUNT; ++s)
+	{
+		samples[s].reserve(history);
+		pos[s] = 0;
+	}
+}
+
+const char* gpuProfile::stage_name(size_t s)
+{
+	const char* names[STAGE_COUNT] = {
+		"write", "cn0", "cn1", "cn2", "branch read",
+		"blake", "groestl", "jh", "skein", "result read",
+		"host gap", "round"
+	};
+	return s < STAGE_COUNT ? names[s] : "unknown";
+}
+
+void gpuProfile::add_round(const double (&ms)[STAGE_COUNT])
+{
+	std::lock_guard<std::mutex> lck(mtx);
+	for(size_t s = 0; s < STAGE_COUNT; ++s)
+	{
+		if(ms[s] < 0.0)
+			continue;
+
+		if(samples[s].size() < history)
+			samples[s].push_back(ms[s]);
+		else
+			samples[s][pos[s]] = ms[s];
+		pos[s] = (pos[s] + 1) % history;
+	}
+	rounds++;
+}
+
+void gpuProfile::report(std::string& out, const std::string& title)
+{
+	std::vector<double> sorted[STAGE_COUNT];
+	uint64_t numRounds;
+	{
+		std::lock_guard<std::mutex> lck(mtx);
+		for(size_t s = 0; s < STAGE_COUNT; ++s)
+			sorted[s] = samples[s];
+		numRounds = rounds;
+	}
+
+	char buf[128];
+	snprintf(buf, sizeof(buf), "PROFILE %s (last %u of %llu rounds, ms)\n", title.c_str(),
+		(unsigned int)std::min<uint64_t>(numRounds, history), (unsigned long long)numRounds);
+	out.append(buf);
+	out.append("| stage       |     mean |      p50 |      p90 |      p99 |  count |\n");
+
+	for(size_t s = 0; s < STAGE_COUNT; ++s)
+	{
+		std::vector<double>& v = sorted[s];
+		if(v.empty())
+			continue;
+
+		std::sort(v.begin(), v.end());
+		double mean = 0.0;
+		for(double x : v)
+			mean += x;
+		mean /= v.size();
+
+		auto percentile = [&v](size_t p) { return v[(v.size() - 1) * p / 100]; };
+		snprintf(buf, sizeof(buf), "| %-11s | %8.3f | %8.3f | %8.3f | %8.3f | %6u |\n", stage_name(s), mean,
+			percentile(50), percentile(90), percentile(99), (unsigned int)v.size());
+		out.append(buf);
+	}
+}
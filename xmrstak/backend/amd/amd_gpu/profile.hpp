@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/** rolling per-stage timing of the OpenCL commands of one gpu
+ *
+ * The timestamps are taken from the OpenCL profiling events and are only
+ * available if the command queue was created with CL_QUEUE_PROFILING_ENABLE.
+ */
+class gpuProfile
+{
+public:
+	enum stage : size_t
+	{
+		WRITE = 0, // zero the branch and result counters
+		CN0,
+		CN1,
+		CN2,
+		BRANCH_READ, // read the branch counters
+		BLAKE,
+		GROESTL,
+		JH,
+		SKEIN,
+		RESULT_READ, // read the results
+		GAP, // device idle time between two commands, e.g. waiting for the host
+		ROUND, // start of the first till the end of the last command
+		STAGE_COUNT
+	};
+
+	// number of rounds used for the rolling statistic
+	static constexpr size_t history = 256;
+
+	gpuProfile();
+
+	/** add the timing of one round
+	 *
+	 * @param ms time per stage in milliseconds, a negative value marks a stage which was not executed
+	 */
+	void add_round(const double (&ms)[STAGE_COUNT]);
+
+	/** append the per-stage mean and percentiles of the last rounds to out */
+	void report(std::string& out, const std::string& title);
+
+private:
+	static const char* stage_name(size_t s);
+
+	std::mutex mtx;
+	std::vector<double> samples[STAGE_COUNT];
+	size_t pos[STAGE_COUNT];
+	uint64_t rounds;
+};
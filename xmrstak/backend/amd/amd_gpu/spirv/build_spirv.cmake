@@ -0,0 +1,83 @@
+# Compile all OpenCL kernel variants to SPIR-V and embed them into a C++ source file.
+#
+# usage: cmake -DOPTIONS_FILE=... -DOPENCL_DIR=... -DWORK_DIR=... -DOUTPUT=...
+#              -DCLANG=... -DLLVM_SPIRV=... -P build_spirv.cmake
+#
+# OPTIONS_FILE  compiler options, one kernel variant per line (created by xmr-stak-spirv-options)
+# OPENCL_DIR    directory with the kernel sources (xmrstak/backend/amd/amd_gpu/opencl)
+# WORK_DIR      directory for temporary files
+# OUTPUT        generated C++ file
+
+# read a kernel source, the files are C++ raw strings
+function(read_kernel name var)
+    file(READ "${OPENCL_DIR}/${name}" content)
+    string(REPLACE "R\"===(" "" content "${content}")
+    string(REPLACE ")===\"" "" content "${content}")
+    set(${var} "${content}" PARENT_SCOPE)
+endfunction()
+
+# assemble the kernel source in the same way as InitOpenCL()
+read_kernel("cryptonight.cl" source)
+read_kernel("wolf-aes.cl" wolf_aes)
+read_kernel("wolf-skein.cl" wolf_skein)
+read_kernel("jh.cl" jh)
+read_kernel("blake256.cl" blake256)
+read_kernel("groestl256.cl" groestl256)
+string(REPLACE "XMRSTAK_INCLUDE_WOLF_AES" "${wolf_aes}" source "${source}")
+string(REPLACE "XMRSTAK_INCLUDE_WOLF_SKEIN" "${wolf_skein}" source "${source}")
+string(REPLACE "XMRSTAK_INCLUDE_JH" "${jh}" source "${source}")
+string(REPLACE "XMRSTAK_INCLUDE_BLAKE256" "${blake256}" source "${source}")
+string(REPLACE "XMRSTAK_INCLUDE_GROESTL256" "${groestl256}" source "${source}")
+
+file(MAKE_DIRECTORY "${WORK_DIR}")
+set(source_file "${WORK_DIR}/cryptonight_full.cl")
+file(WRITE "${source_file}" "${source}")
+
+file(STRINGS "${OPTIONS_FILE}" variants)
+list(LENGTH variants num_variants)
+message(STATUS "Compile ${num_variants} OpenCL kernel variants to SPIR-V")
+
+set(arrays "")
+set(table "")
+set(i 0)
+foreach(options IN LISTS variants)
+    separate_arguments(option_list UNIX_COMMAND "${options}")
+    set(bc_file "${WORK_DIR}/kernel_${i}.bc")
+    set(spv_file "${WORK_DIR}/kernel_${i}.spv")
+
+    execute_process(
+        COMMAND "${CLANG}" -c -x cl -cl-std=CL1.2 -target spir64 -O2 -emit-llvm
+            -Xclang -finclude-default-header ${option_list} "${source_file}" -o "${bc_file}"
+        RESULT_VARIABLE result
+        ERROR_VARIABLE error)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "clang failed for '${options}':\n${error}")
+    endif()
+
+    execute_process(
+        COMMAND "${LLVM_SPIRV}" "${bc_file}" -o "${spv_file}"
+        RESULT_VARIABLE result
+        ERROR_VARIABLE error)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "llvm-spirv failed for '${options}':\n${error}")
+    endif()
+
+    file(READ "${spv_file}" hex HEX)
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," hex "${hex}")
+    string(APPEND arrays "static const unsigned char spirv_${i}[] = {${hex}};\n")
+    string(APPEND table "\t{ \"${options}\", spirv_${i}, sizeof(spirv_${i}) },\n")
+    math(EXPR i "${i} + 1")
+endforeach()
+
+if(i EQUAL 0)
+    message(FATAL_ERROR "no OpenCL kernel variant selected for SPIR-V")
+endif()
+
+file(WRITE "${OUTPUT}.tmp"
+    "// generated by build_spirv.cmake, do not edit\n"
+    "#include \"xmrstak/backend/amd/amd_gpu/spirvKernels.hpp\"\n\n"
+    "${arrays}\n"
+    "const spirv_kernel spirv_kernels[] = {\n${table}};\n"
+    "const size_t spirv_kernels_count = sizeof(spirv_kernels) / sizeof(spirv_kernels[0]);\n")
+# only touch the output if the build was successful
+file(RENAME "${OUTPUT}.tmp" "${OUTPUT}")
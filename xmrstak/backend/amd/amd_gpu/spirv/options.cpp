@@ -0,0 +1,83 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+/* Build tool: write the OpenCL compiler options of all kernel variants which are
+ * precompiled to SPIR-V, one variant per line.
+ *
+ * usage: xmr-stak-spirv-options OUTPUT_FILE WORKSIZES STRIDED_INDEXES MEM_CHUNKS COMP_MODES AES_MODES
+ * each list is separated by ','
+ */
+
+#include "xmrstak/backend/amd/amd_gpu/kernelOptions.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static std::vector<int> parse_list(const std::string& list)
+{
+	std::vector<int> values;
+	std::stringstream ss(list);
+	std::string item;
+	while(std::getline(ss, item, ','))
+	{
+		if(!item.empty())
+			values.push_back(std::atoi(item.c_str()));
+	}
+	return values;
+}
+
+int main(int argc, char** argv)
+{
+	if(argc != 7)
+	{
+		std::cerr << "usage: " << argv[0] << " OUTPUT_FILE WORKSIZES STRIDED_INDEXES MEM_CHUNKS COMP_MODES AES_MODES" << std::endl;
+		return 1;
+	}
+
+	std::ofstream out(argv[1]);
+	if(!out)
+	{
+		std::cerr << "can not write " << argv[1] << std::endl;
+		return 1;
+	}
+
+	const std::vector<int> workSizes = parse_list(argv[2]);
+	const std::vector<int> stridedIndexes = parse_list(argv[3]);
+	const std::vector<int> memChunks = parse_list(argv[4]);
+	const std::vector<int> compModes = parse_list(argv[5]);
+	const std::vector<int> aesModes = parse_list(argv[6]);
+
+	for(int algo = cryptonight; algo <= cryptonight_bittube2; ++algo)
+		for(int workSize : workSizes)
+			for(int stridedIndex : stridedIndexes)
+				for(int memChunk : memChunks)
+					for(int compMode : compModes)
+						for(int aesMode : aesModes)
+							out << get_kernel_options(xmrstak_algo(algo), workSize, stridedIndex, memChunk, compMode != 0, aesMode) << "\n";
+
+	return 0;
+}
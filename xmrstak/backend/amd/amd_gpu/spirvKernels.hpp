@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/** OpenCL kernels precompiled to SPIR-V at build time (CMake option `OpenCL_SPIRV`) */
+struct spirv_kernel
+{
+	// compiler options used to create the kernel, see get_kernel_options()
+	const char* options;
+	const unsigned char* data;
+	size_t size;
+};
+
+#ifdef CONF_SPIRV
+// defined in the file generated by xmrstak/backend/amd/amd_gpu/spirv/build_spirv.cmake
+extern const spirv_kernel spirv_kernels[];
+extern const size_t spirv_kernels_count;
+#endif
+
+/** find the precompiled kernel for the compiler options
+ *
+ * @return nullptr if no kernel was precompiled for the options
+ */
+#ifdef CONF_SPIRV
+inline const spirv_kernel* find_spirv_kernel(const std::string& options)
+{
+	for(size_t i = 0; i < spirv_kernels_count; ++i)
+	{
+		if(options == spirv_kernels[i].options)
+			return spirv_kernels + i;
+	}
+	return nullptr;
+}
+#else
+inline const spirv_kernel* find_spirv_kernel(const std::string& /*options*/)
+{
+	return nullptr;
+}
+#endif
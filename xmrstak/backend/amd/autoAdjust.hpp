@@ -3,6 +3,7 @@
 
 #include "amd_gpu/gpu.hpp"
 #include "autoAdjust.hpp"
+#include "autoTune.hpp"
 #include "jconf.hpp"
 
 #include "xmrstak/misc/console.hpp"
@@ -39,17 +40,21 @@ public:
 	 *
 	 * Routine exit the application and print the adjusted values if needed else
 	 * nothing is happened.
+	 * If the option `--autotune` is used the values are measured on the gpus.
 	 */
 	bool printConfig() {
-		int platformIndex = getAMDPlatformIdx();
+		std::vector<int> platformIndexes = getAMDPlatformIdxs();
 
-		if(platformIndex == -1) {
+		if(platformIndexes.empty()) {
 			Printer::inst()->print_msg(L0,"WARNING: No AMD OpenCL platform found. Possible driver issues or wrong vendor driver.");
 			return false;
 		}
 
-		devVec = getAMDDevices(platformIndex);
-
+		// use the gpus of all platforms
+		for(int platformIndex : platformIndexes) {
+			std::vector<GpuContext> platformDevs = getAMDDevices(platformIndex);
+			devVec.insert(devVec.end(), platformDevs.begin(), platformDevs.end());
+		}
 
 		int deviceCount = devVec.size();
 
@@ -58,7 +63,7 @@ public:
 			return false;
 		}
 
-		generateThreadConfig(platformIndex);
+		generateThreadConfig(platformIndexes.front());
 		return true;
 	}
 
@@ -80,6 +85,8 @@ private:
 			cn_select_memory(::jconf::inst()->GetCurrentCoinSelection().GetDescription().GetMiningAlgoRoot())
 		);
 
+		autoTune tuner(params::inst().autotune_sample_sec * 1000u);
+
 		std::string conf;
 		for(auto& ctx : devVec) {
 			size_t minFreeMem = 128u * byteToMiB;
@@ -113,6 +120,12 @@ private:
 				minFreeMem = 512u * byteToMiB;
 			}
 
+			// OpenCL CPU devices (e.g. POCL) run one work group per compute unit
+			cl_device_type devType = CL_DEVICE_TYPE_GPU;
+			clGetDeviceInfo(ctx.DeviceID, CL_DEVICE_TYPE, sizeof(cl_device_type), &devType, NULL);
+			if(devType & CL_DEVICE_TYPE_CPU)
+				maxThreads = 8u * ctx.computeUnits;
+
 			// increase all intensity limits by two for aeon
 			if(::jconf::inst()->GetCurrentCoinSelection().GetDescription().GetMiningAlgo() == cryptonight_lite)
 				maxThreads *= 2u;
@@ -127,18 +140,33 @@ private:
 			size_t intensity = (possibleIntensity / (8 * ctx.computeUnits)) * ctx.computeUnits * 8;
 			//If the intensity is 0, then it's because the multiple of the unit count is greater than intensity
 			if (intensity == 0) {
-				Printer::inst()->print_msg(L0, "WARNING: Auto detected intensity unexpectedly low. Try to set the environment variable GPU_SINGLE_ALLOC_PERCENT.");
+				Printer::inst()->print_msg(L0, "WARNING: Auto detected intensity unexpectedly low.");
 				intensity = possibleIntensity;
 
 			}
 			if (intensity != 0) {
+				// set 8 threads per block (this is a good value for the most gpus)
+				ctx.rawIntensity = intensity;
+				ctx.workSize = 8;
+				ctx.stridedIndex = 1;
+				ctx.memChunk = 2;
+				ctx.compMode = true;
+
+				double hps = 0.0;
+				if(params::inst().autotune)
+					hps = tuner.tune(ctx, intensity);
+
 				conf += std::string("  // gpu: ") + ctx.name + " memory:" + std::to_string(availableMem / byteToMiB) + "\n";
 				conf += std::string("  // compute units: ") + std::to_string(ctx.computeUnits) + "\n";
-				// set 8 threads per block (this is a good value for the most gpus)
-				conf += std::string("  { \"index\" : ") + std::to_string(ctx.deviceIdx) + ",\n" +
-					"    \"intensity\" : " + std::to_string(intensity) + ", \"worksize\" : " + std::to_string(8) + ",\n" +
-					"    \"strided_index\" : 1, \"mem_chunk\" : 2,\n"
-					"    \"comp_mode\" : true\n" +
+				if(hps > 0.0) {
+					char hpsStr[32];
+					snprintf(hpsStr, sizeof(hpsStr), "%.1f", hps);
+					conf += std::string("  // autotune: ") + hpsStr + " H/s\n";
+				}
+				conf += std::string("  { \"index\" : ") + std::to_string(ctx.deviceIdx) + ", \"platform_index\" : " + std::to_string(ctx.platformIdx) + ",\n" +
+					"    \"intensity\" : " + std::to_string(ctx.rawIntensity) + ", \"worksize\" : " + std::to_string(ctx.workSize) + ",\n" +
+					"    \"strided_index\" : " + std::to_string(ctx.stridedIndex) + ", \"mem_chunk\" : " + std::to_string(ctx.memChunk) + ",\n" +
+					"    \"comp_mode\" : " + (ctx.compMode ? "true" : "false") + ", \"aes_mode\" : " + std::to_string(ctx.aesMode) + "\n" +
 					"  },\n";
 			} else {
 				Printer::inst()->print_msg(L0, "WARNING: Ignore gpu %s, %s MiB free memory is not enough to suggest settings.", ctx.name.c_str(), std::to_string(availableMem / byteToMiB).c_str());
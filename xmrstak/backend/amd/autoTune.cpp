@@ -0,0 +1,309 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#include "autoTune.hpp"
+
+#include "xmrstak/backend/cpu/minethd.hpp"
+#include "xmrstak/backend/GlobalStates.hpp"
+#include "xmrstak/misc/console.hpp"
+#include "xmrstak/jconf.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+namespace xmrstak
+{
+namespace amd
+{
+
+autoTune::autoTune(size_t sampleMs) :
+	sampleMs(sampleMs)
+{
+	algo = ::jconf::inst()->GetCurrentCoinSelection().GetDescription().GetMiningAlgo();
+	hash_fun = cpu::minethd::func_selector(algo);
+	cpu_ctx = cpu::minethd::minethd_alloc_ctx();
+}
+
+autoTune::~autoTune()
+{
+	if(cpu_ctx != nullptr)
+		cryptonight_free_ctx(cpu_ctx);
+}
+
+std::string autoTune::key(const GpuContext& cfg)
+{
+	return std::to_string(cfg.platformIdx) + "/" + std::to_string(cfg.deviceIdx) + "/" + std::to_string(cfg.rawIntensity) + "/" +
+		std::to_string(cfg.workSize) + "/" + std::to_string(cfg.stridedIndex) + "/" +
+		std::to_string(cfg.memChunk) + "/" + std::to_string(cfg.compMode) + "/" + std::to_string(cfg.aesMode);
+}
+
+autoTune::sample autoTune::measure(const GpuContext& cfg)
+{
+	using namespace std::chrono;
+
+	auto it = measured.find(key(cfg));
+	if(it != measured.end())
+		return it->second;
+
+	GpuContext ctx;
+	ctx.platformIdx = cfg.platformIdx;
+	ctx.deviceIdx = cfg.deviceIdx;
+	ctx.rawIntensity = cfg.rawIntensity;
+	ctx.workSize = cfg.workSize;
+	ctx.stridedIndex = cfg.stridedIndex;
+	ctx.memChunk = cfg.memChunk;
+	ctx.compMode = cfg.compMode;
+	ctx.aesMode = cfg.aesMode;
+	ctx.isNVIDIA = cfg.isNVIDIA;
+
+	sample res = {0.0, false};
+	const char* reason = "";
+
+	// random block header, the nonce is inserted by the gpu
+	uint8_t blob[112];
+	const size_t blob_len = 76;
+	std::mt19937 rnd(uint32_t(cfg.deviceIdx + cfg.rawIntensity));
+	for(auto& b : blob)
+		b = uint8_t(rnd());
+	blob[0] = std::max<uint8_t>(blob[0], ::jconf::inst()->GetCurrentCoinSelection().GetDescription().GetMiningForkVersion());
+
+	if(InitOpenCL(&ctx, 1) != ERR_SUCCESS)
+		reason = " (initialization failed)";
+	else
+	{
+		// about two results per round are expected, enough to validate the gpu on the CPU
+		uint64_t target = ~uint64_t(0) / std::max<uint64_t>(ctx.rawIntensity / 2u, 1u);
+
+		// the global job is not changed during the autotune
+		uint64_t jobNo = GlobalStates::inst().iGlobalJobNo.load(std::memory_order_relaxed);
+		std::vector<cl_uint> results;
+		// the first round includes lazy initializations of the driver and is not measured
+		bool error = XMRSetJob(&ctx, blob, blob_len, 39, target, algo) != ERR_SUCCESS ||
+			XMRRunJob(&ctx, results, algo, jobNo) != ERR_SUCCESS;
+
+		std::vector<double> rates;
+		double gpuSec = 0.0;
+		uint64_t hashes = 0;
+		size_t verified = 0;
+		size_t invalid = 0;
+		auto start = steady_clock::now();
+
+		while(!error && (rates.size() < 3 || steady_clock::now() - start < milliseconds(sampleMs)))
+		{
+			auto t0 = steady_clock::now();
+			error = XMRRunJob(&ctx, results, algo, jobNo) != ERR_SUCCESS;
+			double sec = duration<double>(steady_clock::now() - t0).count();
+
+			rates.push_back(ctx.rawIntensity / sec);
+			gpuSec += sec;
+			hashes += ctx.rawIntensity;
+
+			for(size_t i = 0; i < results.size() && i < 4; ++i)
+			{
+				uint8_t bWorkBlob[112];
+				uint8_t bResult[32];
+				memcpy(bWorkBlob, blob, blob_len);
+				*(uint32_t*)(bWorkBlob + 39) = results[i];
+				hash_fun(bWorkBlob, blob_len, bResult, cpu_ctx);
+				if(*((uint64_t*)(bResult + 24)) >= target)
+					invalid++;
+				verified++;
+			}
+		}
+
+		double mean = 0.0;
+		double var = 0.0;
+		for(double r : rates)
+			mean += r;
+		mean /= std::max<size_t>(rates.size(), 1u);
+		for(double r : rates)
+			var += (r - mean) * (r - mean);
+		double rsd = rates.size() > 1 ? std::sqrt(var / (rates.size() - 1)) / mean : 0.0;
+
+		if(error)
+			reason = " (OpenCL error)";
+		else if(invalid != 0 || verified == 0)
+			reason = " (invalid results)";
+		else if(rsd > 0.15)
+			reason = " (unsteady hash rate)";
+		else
+			res.stable = true;
+
+		if(gpuSec > 0.0)
+			res.hps = hashes / gpuSec;
+	}
+	ReleaseOpenCLGpu(&ctx);
+
+	Printer::inst()->print_msg(L0, "Autotune GPU %u: intensity %u worksize %u strided_index %d mem_chunk %d comp_mode %s aes_mode %d: %.1f H/s%s",
+		int(cfg.deviceIdx), int(cfg.rawIntensity), int(cfg.workSize), cfg.stridedIndex, cfg.memChunk,
+		cfg.compMode ? "true" : "false", cfg.aesMode, res.hps, reason);
+
+	measured[key(cfg)] = res;
+	return res;
+}
+
+bool autoTune::search(const std::vector<GpuContext>& candidates, GpuContext& best, double& bestHps)
+{
+	bool changed = false;
+	size_t misses = 0;
+	for(const auto& cfg : candidates)
+	{
+		sample s = measure(cfg);
+		// a candidate must be at least 1% faster to avoid selecting measurement noise
+		if(s.stable && s.hps > bestHps * 1.01)
+		{
+			best = cfg;
+			bestHps = s.hps;
+			changed = true;
+			misses = 0;
+		}
+		else if(++misses >= 2)
+			break;
+	}
+	return changed;
+}
+
+double autoTune::tune(GpuContext& ctx, size_t maxIntensity)
+{
+	size_t maxWorkSize = 0;
+	if(clGetDeviceInfo(ctx.DeviceID, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &maxWorkSize, NULL) != CL_SUCCESS)
+		maxWorkSize = 8 * 8;
+	// some kernels spawn 8 times more threads than the user is configuring
+	maxWorkSize /= 8;
+
+	const size_t granularity = 8u * std::max(ctx.computeUnits, 1);
+	auto align = [&](GpuContext& cfg, size_t intensity) {
+		size_t step = std::max(granularity, cfg.workSize);
+		step = (step / cfg.workSize) * cfg.workSize;
+		size_t aligned = (intensity / step) * step;
+		// strided_index 2 and disabled comp_mode need a multiple of the worksize
+		if(aligned == 0)
+			aligned = std::max((intensity / cfg.workSize) * cfg.workSize, cfg.workSize);
+		cfg.rawIntensity = aligned;
+	};
+
+	Printer::inst()->print_msg(L0, "Autotune GPU %u (%s), this takes a few minutes ...", int(ctx.deviceIdx), ctx.name.c_str());
+
+	GpuContext best = ctx;
+	double bestHps = 0.0;
+	search({ctx}, best, bestHps);
+
+	// intensity: start at the memory limit and go down, more threads are not always faster
+	std::vector<GpuContext> candidates;
+	for(size_t i = 7; i >= 2; --i)
+	{
+		GpuContext cfg = best;
+		align(cfg, maxIntensity * i / 8);
+		candidates.push_back(cfg);
+	}
+	search(candidates, best, bestHps);
+
+	// worksize
+	candidates.clear();
+	for(size_t ws = 16; ws <= maxWorkSize && ws <= 128; ws *= 2)
+	{
+		GpuContext cfg = best;
+		cfg.workSize = ws;
+		align(cfg, best.rawIntensity);
+		candidates.push_back(cfg);
+	}
+	search(candidates, best, bestHps);
+
+	// scratchpad layout
+	candidates.clear();
+	for(int stridedIndex = 0; stridedIndex <= 1; ++stridedIndex)
+	{
+		GpuContext cfg = best;
+		cfg.stridedIndex = stridedIndex;
+		candidates.push_back(cfg);
+	}
+	search(candidates, best, bestHps);
+
+	candidates.clear();
+	for(int memChunk = 1; memChunk <= 4; ++memChunk)
+	{
+		GpuContext cfg = best;
+		cfg.stridedIndex = 2;
+		cfg.memChunk = memChunk;
+		align(cfg, best.rawIntensity);
+		candidates.push_back(cfg);
+	}
+	search(candidates, best, bestHps);
+
+	// the compatibility checks are only removable if the intensity is a multiple of the worksize
+	if(best.compMode && best.rawIntensity % best.workSize == 0)
+	{
+		GpuContext cfg = best;
+		cfg.compMode = false;
+		search({cfg}, best, bestHps);
+	}
+
+	// AES tables: all modes are measured, the best mode depends on the local memory of the architecture
+	std::string aesReport;
+	for(int aesMode = 0; aesMode <= 3; ++aesMode)
+	{
+		GpuContext cfg = best;
+		cfg.aesMode = aesMode;
+		sample s = measure(cfg);
+		if(s.stable && s.hps > bestHps * 1.01)
+		{
+			best = cfg;
+			bestHps = s.hps;
+		}
+		char buf[64];
+		snprintf(buf, sizeof(buf), "%s%d=%.1f%s", aesMode == 0 ? "" : ", ", aesMode, s.hps, s.stable ? "" : "(unstable)");
+		aesReport += buf;
+	}
+	Printer::inst()->print_msg(L0, "Autotune GPU %u aes_mode H/s: %s, fastest aes_mode %d", int(ctx.deviceIdx), aesReport.c_str(), best.aesMode);
+
+	if(bestHps == 0.0)
+	{
+		Printer::inst()->print_msg(L0, "WARNING: Autotune GPU %u found no stable setting.", int(ctx.deviceIdx));
+		return 0.0;
+	}
+
+	// confirm the winner with a second measurement
+	measured.erase(key(best));
+	sample confirm = measure(best);
+	if(!confirm.stable)
+	{
+		Printer::inst()->print_msg(L0, "WARNING: Autotune GPU %u could not confirm the fastest setting, keep the default setting.", int(ctx.deviceIdx));
+		sample def = measure(ctx);
+		return def.stable ? def.hps : 0.0;
+	}
+
+	ctx.rawIntensity = best.rawIntensity;
+	ctx.workSize = best.workSize;
+	ctx.stridedIndex = best.stridedIndex;
+	ctx.memChunk = best.memChunk;
+	ctx.compMode = best.compMode;
+	ctx.aesMode = best.aesMode;
+	return (bestHps + confirm.hps) / 2.0;
+}
+
+} // namespace amd
+} // namespace xmrstak
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "amd_gpu/gpu.hpp"
+#include "xmrstak/backend/cpu/crypto/cryptonight.h"
+#include "xmrstak/backend/cryptonight.hpp"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace xmrstak
+{
+namespace amd
+{
+
+/** empirical search for the fastest thread configuration of a gpu
+ *
+ * Each candidate is measured with the mining code path (InitOpenCL, XMRSetJob, XMRRunJob)
+ * and all results found by the gpu are validated on the CPU.
+ */
+class autoTune
+{
+public:
+	autoTune(size_t sampleMs);
+	~autoTune();
+
+	/** tune a gpu
+	 *
+	 * The search starts with the settings of the config generator and changes one parameter
+	 * at a time (intensity, worksize, strided_index/mem_chunk, comp_mode, aes_mode). A search over
+	 * one parameter is stopped early if two candidates in a row are not faster.
+	 *
+	 * @param ctx[in,out] gpu with the suggested settings, replaced by the fastest stable settings
+	 * @param maxIntensity largest intensity fitting into the gpu memory
+	 * @return measured hash rate of the selected settings, 0 if no setting was stable
+	 */
+	double tune(GpuContext& ctx, size_t maxIntensity);
+
+private:
+	typedef void (*cn_hash_fun)(const void*, size_t, void*, cryptonight_ctx*);
+
+	struct sample
+	{
+		double hps;
+		bool stable;
+	};
+
+	/** measure the hash rate of a configuration, results are memorized */
+	sample measure(const GpuContext& cfg);
+
+	/** measure all candidates in order and keep the fastest stable one in best
+	 *
+	 * @return true if best was changed
+	 */
+	bool search(const std::vector<GpuContext>& candidates, GpuContext& best, double& bestHps);
+
+	static std::string key(const GpuContext& cfg);
+
+	size_t sampleMs;
+	xmrstak_algo algo;
+	cn_hash_fun hash_fun;
+	cryptonight_ctx* cpu_ctx;
+	std::map<std::string, sample> measured;
+};
+
+} // namespace amd
+} // namespace xmrstak
@@ -16,6 +16,18 @@ R"===(
  *                 to use a intensity which is not the multiple of the worksize.
  *                 If you set false and the intensity is not multiple of the worksize the miner can crash:
  *                 in this case set the intensity to a multiple of the worksize or activate comp_mode.
+ * target_latency - (optional) round time in milliseconds, 0 or not set disables the adaptive intensity
+ *                 The miner reduces the intensity (in multiples of worksize, never above 'intensity')
+ *                 until a round takes about this time. Shorter rounds produce less stale results
+ *                 after a job change but can reduce the hash rate.
+ * aes_mode      - (optional) source of the AES tables in the OpenCL kernels, the fastest mode depends on the gpu
+ *                 0 or not set = four rotated tables in local memory
+ *                 1 = one table in local memory, the other three are rotated on the fly
+ *                 2 = table in constant memory
+ *                 3 = no tables, the S-box is computed (uses no memory but many instructions)
+ *                 `--autotune` measures all modes.
+ * platform_index - (optional) OpenCL platform of the GPU, default is the global 'platform_index'
+ *                 GPUs of different platforms (e.g. AMD and NVIDIA) can be used at the same time.
  * "gpu_threads_conf" :
  * [
  *	{ "index" : 0, "intensity" : 1000, "worksize" : 8, "strided_index" : true, "mem_chunk" : 2, "comp_mode" : true },
@@ -31,6 +43,7 @@ GPUCONFIG
 
 /*
  * Platform index. This will be 0 unless you have different OpenCL platform - eg. AMD and Intel.
+ * This is the default for all GPUs without an own 'platform_index'.
  */
 "platform_index" : PLATFORMINDEX,
 
@@ -106,13 +106,17 @@ bool jconf::GetThreadConfig(size_t id, thd_cfg &cfg)
 	if(!oThdConf.IsObject())
 		return false;
 
-	const Value *idx, *intensity, *w_size, *stridedIndex, *memChunk, *compMode;
+	const Value *idx, *intensity, *w_size, *stridedIndex, *memChunk, *compMode, *targetLatency, *platformIdx, *aesMode;
 	idx = GetObjectMember(oThdConf, "index");
 	intensity = GetObjectMember(oThdConf, "intensity");
 	w_size = GetObjectMember(oThdConf, "worksize");
 	stridedIndex = GetObjectMember(oThdConf, "strided_index");
 	memChunk = GetObjectMember(oThdConf, "mem_chunk");
 	compMode = GetObjectMember(oThdConf, "comp_mode");
+	// optional values
+	targetLatency = GetObjectMember(oThdConf, "target_latency");
+	platformIdx = GetObjectMember(oThdConf, "platform_index");
+	aesMode = GetObjectMember(oThdConf, "aes_mode");
 
 	if(idx == nullptr || intensity == nullptr || w_size == nullptr || memChunk == nullptr ||
 		stridedIndex == nullptr || compMode == nullptr)
@@ -149,6 +153,27 @@ bool jconf::GetThreadConfig(size_t id, thd_cfg &cfg)
 	if(!compMode->IsBool())
 		return false;
 
+	if(targetLatency != nullptr && !targetLatency->IsUint64())
+	{
+		Printer::inst()->print_msg(L0, "ERROR: target_latency must be a number of milliseconds");
+		return false;
+	}
+	cfg.targetLatency = targetLatency != nullptr ? targetLatency->GetUint64() : 0;
+
+	if(platformIdx != nullptr && !platformIdx->IsUint64())
+	{
+		Printer::inst()->print_msg(L0, "ERROR: platform_index must be a number");
+		return false;
+	}
+	cfg.platformIdx = platformIdx != nullptr ? platformIdx->GetUint64() : GetPlatformIdx();
+
+	if(aesMode != nullptr && (!aesMode->IsUint64() || aesMode->GetUint64() > 3))
+	{
+		Printer::inst()->print_msg(L0, "ERROR: aes_mode must be a number in the range [0,3]");
+		return false;
+	}
+	cfg.aesMode = aesMode != nullptr ? (int)aesMode->GetUint64() : 0;
+
 	cfg.index = idx->GetUint64();
 	cfg.w_size = w_size->GetUint64();
 	cfg.intensity = intensity->GetUint64();
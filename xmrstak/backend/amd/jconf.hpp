@@ -28,6 +28,12 @@ public:
 		int stridedIndex;
 		int memChunk;
 		bool compMode;
+		// round time target in milliseconds for the adaptive intensity, 0 = disabled
+		size_t targetLatency;
+		// OpenCL platform of the device, default is the global platform_index
+		size_t platformIdx;
+		// source of the AES tables, 0 = four tables in local memory (default)
+		int aesMode;
 	};
 
 	size_t GetThreadCount();
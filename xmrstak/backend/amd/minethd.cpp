@@ -30,12 +30,14 @@
 #include "xmrstak/misc/configEditor.hpp"
 #include "xmrstak/misc/console.hpp"
 #include "xmrstak/backend/cpu/minethd.hpp"
+#include "xmrstak/backend/nonce_range.hpp"
 #include "xmrstak/jconf.hpp"
 #include "xmrstak/misc/executor.hpp"
 #include "xmrstak/misc/Environment.hpp"
 #include "xmrstak/params.hpp"
 
 #include <assert.h>
+#include <bitset>
 #include <cmath>
 #include <chrono>
 #include <thread>
@@ -44,6 +46,12 @@
 namespace xmrstak {
 namespace amd {
 
+// nonce ranges of all AMD threads, leased in blocks of 2^20 nonces
+static nonce_range& amd_nonces() {
+	static nonce_range range(uint64_t(1) << 20);
+	return range;
+}
+
 minethd::minethd(miner_work &pWork, size_t iNo, GpuContext *ctx) {
 	this->backendType = iBackend::AMD;
 	oWork = pWork;
@@ -53,10 +61,17 @@ minethd::minethd(miner_work &pWork, size_t iNo, GpuContext *ctx) {
 	iHashCount = 0;
 	iTimestamp = 0;
 	pGpuCtx = ctx;
+	std::atomic_store(&pProfile, ctx->profile);
+	iPlatformIdx = ctx->platformIdx;
+	iDeviceIdx = ctx->deviceIdx;
+	iHeartbeat = get_timestamp_ms();
+	iGeneration = 0;
+	bGpuError = false;
+	bSafeModeRequest = false;
 
 	std::future<void> order_guard = order_fix.get_future();
 
-	oWorkThd = std::thread(&minethd::work_main, this);
+	oWorkThd = std::thread(&minethd::work_main, this, ctx, 0u);
 
 	order_guard.wait();
 }
@@ -81,22 +96,41 @@ bool minethd::init_gpus() {
 	jconf::thd_cfg cfg;
 	for(i = 0; i < n; i++) {
 		jconf::inst()->GetThreadConfig(i, cfg);
+		vGpuData[i].platformIdx = cfg.platformIdx;
 		vGpuData[i].deviceIdx = cfg.index;
 		vGpuData[i].rawIntensity = cfg.intensity;
 		vGpuData[i].workSize = cfg.w_size;
 		vGpuData[i].stridedIndex = cfg.stridedIndex;
 		vGpuData[i].memChunk = cfg.memChunk;
 		vGpuData[i].compMode = cfg.compMode;
+		vGpuData[i].targetLatency = cfg.targetLatency;
+		vGpuData[i].aesMode = cfg.aesMode;
 	}
 
-	return InitOpenCL(vGpuData.data(), n, jconf::inst()->GetPlatformIdx()) == ERR_SUCCESS;
+	return InitOpenCL(vGpuData.data(), n) == ERR_SUCCESS;
 }
 
 std::vector<GpuContext> minethd::vGpuData;
 
+void minethd::profile_report(std::string& out)
+{
+	// the context can be replaced by the watchdog at any time, only the profile is used
+	std::shared_ptr<gpuProfile> profile = std::atomic_load(&pProfile);
+	if(profile)
+		profile->report(out, "AMD thread " + std::to_string(iThreadNo) + " platform " +
+			std::to_string(iPlatformIdx) + " gpu " + std::to_string(iDeviceIdx));
+}
+
 std::vector<iBackend*>* minethd::thread_starter(uint32_t threadOffset, miner_work& pWork) {
 	std::vector<iBackend*>* pvThreads = new std::vector<iBackend*>();
 
+	if(params::inst().autotune) {
+		// only measure and store the config, mining is started without `--autotune`
+		autoAdjust adjust;
+		adjust.printConfig();
+		return pvThreads;
+	}
+
 	if(!configEditor::file_exist(params::inst().configFileAMD)) {
 		autoAdjust adjust;
 		if(!adjust.printConfig())
@@ -117,23 +151,182 @@ std::vector<iBackend*>* minethd::thread_starter(uint32_t threadOffset, miner_wor
 	size_t i, n = jconf::inst()->GetThreadCount();
 	pvThreads->reserve(n);
 
+	std::vector<minethd*> threads;
 	jconf::thd_cfg cfg;
 	for (i = 0; i < n; i++) {
 		jconf::inst()->GetThreadConfig(i, cfg);
 
 		minethd* thd = new minethd(pWork, i + threadOffset, &vGpuData[i]);
 		pvThreads->push_back(thd);
+		threads.push_back(thd);
 	}
 
+	// the threads are never destroyed, the watchdog runs as long as the miner
+	std::thread(&minethd::watchdog_main, threads).detach();
+
 	return pvThreads;
 }
 
+void minethd::watchdog_main(std::vector<minethd*> threads) {
+	const uint64_t stallMs = uint64_t(params::inst().amdWatchdogSec) * 1000u;
+
+	while(true) {
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+
+		for(minethd* thd : threads) {
+			uint64_t now = get_timestamp_ms();
+			if(thd->iDownSince == 0) {
+				bool error = thd->bGpuError.load();
+				bool safeMode = !error && thd->bSafeModeRequest.load();
+				uint64_t heartbeat = thd->iHeartbeat.load();
+				bool stalled = !error && !safeMode && stallMs != 0 && now > heartbeat + stallMs;
+				if(!error && !safeMode && !stalled)
+					continue;
+
+				GpuContext* ctx = thd->pGpuCtx.load();
+				if(error)
+					Printer::inst()->print_msg(L0, "AMD: GPU %u (thread %u) returned an error, rebuild the OpenCL context.",
+						int(ctx->deviceIdx), int(thd->iThreadNo));
+				else if(safeMode)
+					Printer::inst()->print_msg(L0, "AMD: GPU %u (thread %u) %u of the last %u results were invalid, rebuild the OpenCL context with safer settings.",
+						int(ctx->deviceIdx), int(thd->iThreadNo), int(std::bitset<32>(thd->iResultWindow).count()), int(thd->iResultsTracked));
+				else
+					Printer::inst()->print_msg(L0, "AMD: GPU %u (thread %u) is not responding since %u s, rebuild the OpenCL context.",
+						int(ctx->deviceIdx), int(thd->iThreadNo), int((now - heartbeat) / 1000u));
+
+				thd->iDownSince = stalled ? heartbeat : now;
+				thd->retire_worker(stalled);
+				if(safeMode && !thd->apply_safe_mode())
+					Printer::inst()->print_msg(L0, "AMD: GPU %u (thread %u) no safer setting left, check the clock and voltage of the GPU.",
+						int(ctx->deviceIdx), int(thd->iThreadNo));
+			}
+
+			if(now < thd->iNextRestart)
+				continue;
+
+			if(thd->restart_worker()) {
+				Printer::inst()->print_msg(L0, "AMD: GPU %u (thread %u) recovered, downtime %.1f s.",
+					int(thd->pGpuCtx.load()->deviceIdx), int(thd->iThreadNo), (get_timestamp_ms() - thd->iDownSince) / 1000.0);
+				thd->iDownSince = 0;
+			}
+			else
+				thd->iNextRestart = get_timestamp_ms() + 10000u;
+		}
+	}
+}
+
+void minethd::retire_worker(bool stalled) {
+	GpuContext* old = pGpuCtx.load();
+
+	// an old worker ends as soon as it returns from the OpenCL call
+	iGeneration.fetch_add(1);
+
+	// the new context gets the configuration, the OpenCL objects are created by restart_worker()
+	std::unique_ptr<GpuContext> ctx(new GpuContext());
+	ctx->platformIdx = old->platformIdx;
+	ctx->deviceIdx = old->deviceIdx;
+	ctx->rawIntensity = old->maxRawIntensity;
+	ctx->workSize = old->workSize;
+	ctx->stridedIndex = old->stridedIndex;
+	ctx->memChunk = old->memChunk;
+	ctx->compMode = old->compMode;
+	ctx->aesMode = old->aesMode;
+	ctx->targetLatency = old->targetLatency;
+	ctx->resultCapacity = old->resultCapacity;
+
+	if(stalled) {
+		// the resources are still used by the hanging OpenCL call, the thread and the context are leaked
+		oWorkThd.detach();
+		ownedCtx.release();
+	}
+	else {
+		oWorkThd.join();
+		ReleaseOpenCLGpu(old);
+	}
 
-void minethd::work_main() {
-	order_fix.set_value();
+	ownedCtx = std::move(ctx);
+	pGpuCtx = ownedCtx.get();
+	iNextRestart = 0;
+}
+
+bool minethd::restart_worker() {
+	GpuContext* ctx = pGpuCtx.load();
+	if(InitOpenCL(ctx, 1) != ERR_SUCCESS) {
+		ReleaseOpenCLGpu(ctx);
+		return false;
+	}
+
+	std::atomic_store(&pProfile, ctx->profile);
+	iHeartbeat = get_timestamp_ms();
+	bGpuError = false;
+	bSafeModeRequest = false;
+	iResultWindow = 0;
+	iResultsTracked = 0;
+	oWorkThd = std::thread(&minethd::work_main, this, ctx, iGeneration.load());
+	return true;
+}
+
+// the safe mode is requested if at least safe_mode_invalid of the last safe_mode_window results are invalid
+static const uint32_t safe_mode_window = 32;
+static const uint32_t safe_mode_invalid = 4;
+
+bool minethd::track_result(bool invalid) {
+	iResultWindow = (iResultWindow << 1) | (invalid ? 1u : 0u);
+	iResultsTracked = std::min(iResultsTracked + 1u, safe_mode_window);
+	return bSafeModeLeft && std::bitset<32>(iResultWindow).count() >= safe_mode_invalid;
+}
+
+bool minethd::apply_safe_mode() {
+	GpuContext* ctx = pGpuCtx.load();
+	if(iSafeModeBaseIntensity == 0)
+		iSafeModeBaseIntensity = ctx->rawIntensity;
+
+	// a step which does not change the current setting is skipped
+	for(int step = iSafeModeStep; ; ++step) {
+		char change[64];
+		if(step == 0) {
+			if(ctx->compMode)
+				continue;
+			ctx->compMode = 1;
+			snprintf(change, sizeof(change), "comp_mode false -> true");
+		}
+		else if(step == 2) {
+			if(ctx->stridedIndex == 0)
+				continue;
+			int stridedIndex = ctx->stridedIndex - 1;
+			snprintf(change, sizeof(change), "strided_index %d -> %d", ctx->stridedIndex, stridedIndex);
+			ctx->stridedIndex = stridedIndex;
+		}
+		else {
+			size_t intensity = (ctx->rawIntensity * 3u / 4u) / ctx->workSize * ctx->workSize;
+			if(intensity < ctx->workSize || intensity < iSafeModeBaseIntensity / 4u) {
+				iSafeModeStep = step;
+				bSafeModeLeft = false;
+				return false;
+			}
+			snprintf(change, sizeof(change), "intensity %u -> %u", int(ctx->rawIntensity), int(intensity));
+			ctx->rawIntensity = intensity;
+		}
+
+		iSafeModeStep = step + 1;
+		Printer::inst()->print_msg(L0, "AMD: GPU %u (thread %u) safe mode step %d: %s", int(ctx->deviceIdx), int(iThreadNo), step + 1, change);
+		return true;
+	}
+}
+
+
+void minethd::work_main(GpuContext* ctx, uint32_t generation) {
+	if(generation == 0)
+		order_fix.set_value();
+	else
+		GlobalStates::inst().consume_work(oWork, iJobNo);
 	std::this_thread::yield();
 
-	uint64_t iCount = 0;
+	uint64_t iCount = iHashCount.load(std::memory_order_relaxed);
+	// nonces found in a round, reused to avoid an allocation per round
+	std::vector<cl_uint> results;
+	// lost results of the previous contexts
+	const uint64_t iLostBase = iLostResults.load(std::memory_order_relaxed);
 	cryptonight_ctx* cpu_ctx;
 	cpu_ctx = cpu::minethd::minethd_alloc_ctx();
 
@@ -144,17 +337,40 @@ void minethd::work_main() {
 	uint8_t version = 0;
 	size_t lastPoolId = 0;
 
+	// exponential moving average of the round time, used by the adaptive intensity
+	double avgRoundMs = 0.0;
+
+	/* The worker was replaced by the watchdog. A replaced worker must not touch the thread state
+	 * (oWork, iJobNo, the flags for the watchdog), a new worker is already running. It is checked
+	 * after each OpenCL call, a hanging call is the reason for the replacement.
+	 */
+	auto replaced = [&]() {
+		if(iGeneration.load(std::memory_order_relaxed) == generation)
+			return false;
+		cryptonight_free_ctx(cpu_ctx);
+		return true;
+	};
+	// give the gpu back to the watchdog, the context is rebuilt
+	auto gpu_error = [&]() {
+		cryptonight_free_ctx(cpu_ctx);
+		bGpuError = true;
+	};
+	// the timeout only keeps the heartbeat for the watchdog alive
+	auto wait_for_job = [&]() {
+		while (!GlobalStates::inst().wait_for_job(iJobNo, std::chrono::seconds(1))) {
+			iHeartbeat.store(get_timestamp_ms(), std::memory_order_relaxed);
+		}
+	};
+
 	while (bQuit == 0) {
+		iHeartbeat.store(get_timestamp_ms(), std::memory_order_relaxed);
 		if (oWork.bStall) {
 			/* We are stalled here because the Executor didn't find a job for us yet,
 			 * either because of network latency, or a socket problem. Since we are
 			 * raison d'etre of this software it us sensible to just wait until we have something
 			 */
 
-			while (GlobalStates::inst().iGlobalJobNo.load(std::memory_order_relaxed) == iJobNo) {
-				std::this_thread::sleep_for(std::chrono::milliseconds(100));
-			}
-
+			wait_for_job();
 			GlobalStates::inst().consume_work(oWork, iJobNo);
 			continue;
 		}
@@ -172,34 +388,85 @@ void minethd::work_main() {
 			version = new_version;
 		}
 
-		uint32_t h_per_round = pGpuCtx->rawIntensity;
-		size_t round_ctr = 0;
+		uint32_t h_per_round = ctx->rawIntensity;
+		// rounds left in the leased nonce range
+		uint64_t rounds_left = 0;
+		bool exhausted = false;
 
 		assert(sizeof(job_result::sJobID) == sizeof(pool_job::sJobID));
 		uint64_t target = oWork.iTarget;
 
-		XMRSetJob(pGpuCtx, oWork.bWorkBlob, oWork.iWorkSize, target, miner_algo);
-
-		if(oWork.bNiceHash) {
-		    pGpuCtx->Nonce = *(uint32_t*)(oWork.bWorkBlob + 39);
+		size_t setRet = XMRSetJob(ctx, oWork.bWorkBlob, oWork.iWorkSize, 39, target, miner_algo);
+		if(replaced())
+			return;
+		if(setRet == ERR_OCL_API) {
+			gpu_error();
+			return;
+		}
+		if(setRet != ERR_SUCCESS) {
+			// the job can not be mined with this gpu, wait for the next one
+			oWork.bStall = true;
+			continue;
 		}
 
+		// the high bits fixed by the pool are kept
+		const uint32_t blobNonce = *(uint32_t*)(oWork.bWorkBlob + 39);
+
 		while(GlobalStates::inst().iGlobalJobNo.load(std::memory_order_relaxed) == iJobNo) {
-			//Allocate a new nonce every 16 rounds
-			if((round_ctr++ & 0xF) == 0) {
-				GlobalStates::inst().calc_start_nonce(pGpuCtx->Nonce, oWork.bNiceHash, h_per_round * 16);
+			//Allocate nonces for up to 16 rounds
+			if(rounds_left == 0) {
+				// the intensity is only changed at the nonce allocation, a reserved nonce range is never exceeded
+				if(ctx->targetLatency != 0 && avgRoundMs > 0.0 && adjust_intensity(ctx, avgRoundMs)) {
+					size_t adjustRet = XMRSetJob(ctx, oWork.bWorkBlob, oWork.iWorkSize, 39, target, miner_algo);
+					if(replaced())
+						return;
+					if(adjustRet != ERR_SUCCESS) {
+						gpu_error();
+						return;
+					}
+					avgRoundMs = 0.0;
+				}
+				h_per_round = ctx->rawIntensity;
+				uint64_t offset;
+				uint64_t leased = amd_nonces().lease(iJobNo, h_per_round, uint64_t(h_per_round) * 16, offset);
 				// check if the job is still valid, there is a small possibility that the job is switched
 				if(GlobalStates::inst().iGlobalJobNo.load(std::memory_order_relaxed) != iJobNo)
 					break;
+				if(leased == 0) {
+					exhausted = true;
+					break;
+				}
+				ctx->Nonce = GlobalStates::nonce_with_prefix(blobNonce, oWork.iNoncePrefixBits, offset);
+				rounds_left = leased / h_per_round;
+			}
+			rounds_left--;
+
+			auto roundStart = std::chrono::steady_clock::now();
+			size_t runRet = XMRRunJob(ctx, results, miner_algo, iJobNo);
+			if(replaced())
+				return;
+			if(runRet == ERR_OCL_API) {
+				gpu_error();
+				return;
+			}
+			if(runRet == ERR_STALE_JOB)
+				iAbandonedRounds.fetch_add(1, std::memory_order_relaxed);
+			double roundMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - roundStart).count();
+			// rounds stopped early would distort the distribution
+			if(runRet != ERR_STALE_JOB)
+				oRoundTime.record(uint64_t(roundMs * 1000.0));
+
+			if(ctx->targetLatency != 0) {
+				avgRoundMs = avgRoundMs == 0.0 ? roundMs : avgRoundMs * 0.875 + roundMs * 0.125;
+				stale_stats& stats = ctx->rawIntensity == ctx->maxRawIntensity ? baseStats : adaptedStats;
+				stats.rounds++;
+				if(GlobalStates::inst().iGlobalJobNo.load(std::memory_order_relaxed) != iJobNo)
+					stats.stale++;
 			}
-			
-
-			cl_uint results[0x100];
-			memset(results,0,sizeof(cl_uint)*(0x100));
-
-			XMRRunJob(pGpuCtx, results, miner_algo);
 
-			for(size_t i = 0; i < results[0xFF]; i++) {
+			iLostResults.store(iLostBase + ctx->lostResults, std::memory_order_relaxed);
+			bool safeMode = false;
+			for(size_t i = 0; i < results.size(); i++) {
 				uint8_t	bWorkBlob[112];
 				uint8_t	bResult[32];
 
@@ -208,23 +475,81 @@ void minethd::work_main() {
 
 				*(uint32_t*)(bWorkBlob + 39) = results[i];
 
+				auto verifyStart = std::chrono::steady_clock::now();
 				hash_fun(bWorkBlob, oWork.iWorkSize, bResult, cpu_ctx);
-				if ( (*((uint64_t*)(bResult + 24))) < oWork.iTarget)
+				oVerifyTime.record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - verifyStart).count());
+				bool invalid = (*((uint64_t*)(bResult + 24))) >= oWork.iTarget;
+				if (!invalid)
+				{
+					iValidResults.fetch_add(1, std::memory_order_relaxed);
 					Executor::inst()->push_event(ex_event(job_result(oWork.sJobID, results[i], bResult, iThreadNo, miner_algo), oWork.iPoolId));
+				}
 				else
-					Executor::inst()->push_event(ex_event("AMD Invalid Result", pGpuCtx->deviceIdx, oWork.iPoolId));
+				{
+					iInvalidResults.fetch_add(1, std::memory_order_relaxed);
+					Executor::inst()->push_event(ex_event("AMD Invalid Result", ctx->deviceIdx, oWork.iPoolId));
+				}
+				safeMode |= track_result(invalid);
+			}
+
+			if(safeMode) {
+				// the watchdog rebuilds the context with safer settings
+				cryptonight_free_ctx(cpu_ctx);
+				bSafeModeRequest = true;
+				return;
 			}
 
-			iCount += pGpuCtx->rawIntensity;
+			iCount += ctx->rawIntensity;
 			uint64_t iStamp = get_timestamp_ms();
 			iHashCount.store(iCount, std::memory_order_relaxed);
 			iTimestamp.store(iStamp, std::memory_order_relaxed);
+			iHeartbeat.store(iStamp, std::memory_order_relaxed);
 			std::this_thread::yield();
 		}
 
+		if(exhausted) {
+			// the nonces of the job are used, mining on would only create duplicated shares
+			if(GlobalStates::inst().report_nonces_exhausted(iJobNo)) {
+				Printer::inst()->print_msg(L1, "AMD: nonce space of job %s is exhausted.", oWork.sJobID);
+				Executor::inst()->push_event(ex_event(EV_NONCE_EXHAUSTED, oWork.iPoolId));
+			}
+			wait_for_job();
+		}
+
 		GlobalStates::inst().consume_work(oWork, iJobNo);
 	}
 }
 
+bool minethd::adjust_intensity(GpuContext* ctx, double avgRoundMs) {
+	const size_t w_size = ctx->workSize;
+	const size_t current = ctx->rawIntensity;
+
+	if(current == ctx->maxRawIntensity && fBaseRoundMs == 0.0)
+		fBaseRoundMs = avgRoundMs;
+
+	// limit the step size to keep the control loop stable
+	double ratio = double(ctx->targetLatency) / avgRoundMs;
+	ratio = std::min(std::max(ratio, 0.5), 2.0);
+
+	size_t intensity = (size_t(current * ratio) / w_size) * w_size;
+	intensity = std::max(intensity, w_size);
+	// the buffers are allocated for the configured intensity
+	intensity = std::min(intensity, ctx->maxRawIntensity);
+
+	// ignore changes smaller than 5% to avoid oscillation
+	if(intensity == current || std::abs(double(intensity) - double(current)) < 0.05 * current)
+		return false;
+
+	ctx->rawIntensity = intensity;
+
+	double expectedRoundMs = avgRoundMs * intensity / current;
+	double staleWindow = fBaseRoundMs > 0.0 ? 100.0 * (1.0 - expectedRoundMs / fBaseRoundMs) : 0.0;
+	Printer::inst()->print_msg(L1, "AMD: GPU %u intensity %u -> %u, round %.1f ms -> %.1f ms (target %u ms), stale window reduced by %.0f%%",
+		int(ctx->deviceIdx), int(current), int(intensity), avgRoundMs, expectedRoundMs, int(ctx->targetLatency), staleWindow);
+	Printer::inst()->print_msg(L2, "AMD: GPU %u stale rounds %.2f%% with configured intensity, %.2f%% with adapted intensity",
+		int(ctx->deviceIdx), baseStats.ratio(), adaptedStats.ratio());
+	return true;
+}
+
 } // namespace amd
 } // namespace xmrstak
@@ -10,6 +10,7 @@
 #include <thread>
 #include <atomic>
 #include <future>
+#include <memory>
 
 namespace xmrstak
 {
@@ -23,12 +24,57 @@ public:
 	static std::vector<iBackend*>* thread_starter(uint32_t threadOffset, miner_work& pWork);
 	static bool init_gpus();
 
+	void profile_report(std::string& out) override;
+
 private:
 	typedef void (*cn_hash_fun)(const void*, size_t, void*, cryptonight_ctx*);
 
 	minethd(miner_work &pWork, size_t iNo, GpuContext *ctx);
 
-	void work_main();
+	/** mine with the gpu context
+	 *
+	 * The thread ends if the gpu returns an error or the watchdog replaced the thread
+	 * (the generation was changed).
+	 */
+	void work_main(GpuContext* ctx, uint32_t generation);
+
+	/** restart broken or hanging gpu threads */
+	static void watchdog_main(std::vector<minethd*> threads);
+
+	/** stop using the worker thread and its gpu context
+	 *
+	 * @param stalled true if the worker thread hangs in a OpenCL call, the context
+	 *                and the thread are abandoned instead of released
+	 */
+	void retire_worker(bool stalled);
+
+	/** create a new gpu context and start a new worker thread
+	 *
+	 * @return false if the gpu could not be initialized, the watchdog tries again later
+	 */
+	bool restart_worker();
+
+	/** record the CPU verification of a gpu result
+	 *
+	 * @return true if too many of the last results were invalid and a safer setting is left
+	 */
+	bool track_result(bool invalid);
+
+	/** change the configuration of the not yet initialized context to the next safer setting
+	 *
+	 * The steps are: enable comp_mode, reduce the intensity, reduce strided_index
+	 * and finally reduce the intensity down to a quarter of the configured intensity.
+	 *
+	 * @return false if no safer setting is left
+	 */
+	bool apply_safe_mode();
+
+	/** adapt the intensity to the round time target of the gpu
+	 *
+	 * @param avgRoundMs average round time with the current intensity
+	 * @return true if the intensity was changed
+	 */
+	bool adjust_intensity(GpuContext* ctx, double avgRoundMs);
 
 	uint64_t iJobNo;
 	
@@ -40,7 +86,54 @@ private:
 	bool bQuit;
 
 	//Mutable ptr to vector below, different for each thread
-	GpuContext* pGpuCtx;
+	std::atomic<GpuContext*> pGpuCtx;
+	// context created by a recovery, the initial context is part of vGpuData
+	std::unique_ptr<GpuContext> ownedCtx;
+	/* profile of the current context, accessed with std::atomic_load/std::atomic_store
+	 * The reports keep it alive, a retired context can be deleted at any time.
+	 */
+	std::shared_ptr<gpuProfile> pProfile;
+	// the gpu is the same for all contexts of the thread
+	size_t iPlatformIdx;
+	size_t iDeviceIdx;
+
+	// timestamp (ms) of the last sign of life of the worker thread
+	std::atomic<uint64_t> iHeartbeat;
+	// incremented if the worker thread is replaced, an old worker ends as soon as it sees the change
+	std::atomic<uint32_t> iGeneration;
+	// set by the worker thread before it ends because the gpu returned an error
+	std::atomic<bool> bGpuError;
+	// timestamp (ms) since the gpu is not working, 0 if the gpu is working
+	uint64_t iDownSince = 0;
+	// timestamp (ms) of the next attempt to restart the worker
+	uint64_t iNextRestart = 0;
+
+	// CPU verification of the last results, a set bit is an invalid result
+	uint32_t iResultWindow = 0;
+	// number of results in iResultWindow
+	uint32_t iResultsTracked = 0;
+	// set by the worker thread before it ends because too many results were invalid
+	std::atomic<bool> bSafeModeRequest;
+	// next safe mode step, see apply_safe_mode()
+	int iSafeModeStep = 0;
+	bool bSafeModeLeft = true;
+	// intensity before the first safe mode step
+	size_t iSafeModeBaseIntensity = 0;
+
+	// statistics of the adaptive intensity, rounds which overlapped a job change are stale
+	struct stale_stats
+	{
+		uint64_t rounds = 0;
+		uint64_t stale = 0;
+
+		double ratio() const { return rounds == 0 ? 0.0 : 100.0 * stale / rounds; }
+	};
+	// rounds with the configured intensity
+	stale_stats baseStats;
+	// rounds with the adapted intensity
+	stale_stats adaptedStats;
+	// average round time with the configured intensity
+	double fBaseRoundMs = 0.0;
 
 	// WARNING - this vector (but not its contents) must be immutable
 	// once the threads are started
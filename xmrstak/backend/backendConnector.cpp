@@ -59,7 +59,7 @@ std::vector<iBackend*>* BackendConnector::thread_starter(miner_work& pWork) {
 	plugin amdplugin(backendName, "xmrstak_opencl_backend");
 	std::vector<iBackend*>* amdThreads = amdplugin.startBackend(static_cast<uint32_t>(pvThreads->size()), pWork, Environment::inst());
 	pvThreads->insert(std::end(*pvThreads), std::begin(*amdThreads), std::end(*amdThreads));
-	if(amdThreads->size() == 0)
+	if(amdThreads->size() == 0 && !params::inst().autotune)
 		Printer::inst()->print_msg(L0, "WARNING: backend %s (OpenCL) disabled.", backendName.c_str());
 
 	GlobalStates::inst().iThreadCount = pvThreads->size();
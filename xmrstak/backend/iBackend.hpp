@@ -1,6 +1,7 @@
 #pragma once
 
 #include "xmrstak/backend/GlobalStates.hpp"
+#include "xmrstak/misc/telemetry.hpp"
 
 #include <atomic>
 #include <cstdint>
@@ -38,12 +39,27 @@ namespace xmrstak
 
 		std::atomic<uint64_t> iHashCount;
 		std::atomic<uint64_t> iTimestamp;
+		// rounds stopped early because the job was changed
+		std::atomic<uint64_t> iAbandonedRounds;
+		// found nonces which were dropped by the backend, e.g. because a result buffer was full
+		std::atomic<uint64_t> iLostResults;
+		// results which passed or failed the cpu verification
+		std::atomic<uint64_t> iValidResults;
+		std::atomic<uint64_t> iInvalidResults;
+		// duration of a hash round and of the cpu verification of a result in microseconds
+		histogram oRoundTime;
+		histogram oVerifyTime;
 		uint32_t iThreadNo;
 		BackendType backendType = UNKNOWN;
 
-		iBackend() : iHashCount(0), iTimestamp(0)
+		iBackend() : iHashCount(0), iTimestamp(0), iAbandonedRounds(0), iLostResults(0), iValidResults(0), iInvalidResults(0)
 		{
 		}
+
+		virtual ~iBackend() {}
+
+		/** append the timing statistic of the backend to out, nothing if the profiling is disabled */
+		virtual void profile_report(std::string& /*out*/) {}
 	};
 
 } // namespace xmrstak
@@ -20,13 +20,15 @@ namespace xmrstak
 		uint64_t    iTarget;
 		bool        bNiceHash;
 		bool        bStall;
+		// number of high nonce bits fixed by the pool, the miner only changes the remaining bits
+		uint8_t     iNoncePrefixBits;
 		size_t      iPoolId;
 
-		miner_work() : iWorkSize(0), bNiceHash(false), bStall(true), iPoolId(invalid_pool_id) { }
+		miner_work() : iWorkSize(0), bNiceHash(false), bStall(true), iNoncePrefixBits(0), iPoolId(invalid_pool_id) { }
 
 		miner_work(const char* sJobID, const uint8_t* bWork, uint32_t iWorkSize,
 			uint64_t iTarget, bool bNiceHash, size_t iPoolId) : iWorkSize(iWorkSize),
-			iTarget(iTarget), bNiceHash(bNiceHash), bStall(false), iPoolId(iPoolId)
+			iTarget(iTarget), bNiceHash(bNiceHash), bStall(false), iNoncePrefixBits(bNiceHash ? 8 : 0), iPoolId(iPoolId)
 		{
 			assert(iWorkSize <= sizeof(bWorkBlob));
 			memcpy(this->sJobID, sJobID, sizeof(miner_work::sJobID));
@@ -43,6 +45,7 @@ namespace xmrstak
 			iTarget = from.iTarget;
 			bNiceHash = from.bNiceHash;
 			bStall = from.bStall;
+			iNoncePrefixBits = from.iNoncePrefixBits;
 			iPoolId = from.iPoolId;
 
 			assert(iWorkSize <= sizeof(bWorkBlob));
@@ -53,7 +56,7 @@ namespace xmrstak
 		}
 
 		miner_work(miner_work&& from) : iWorkSize(from.iWorkSize), iTarget(from.iTarget),
-			bStall(from.bStall), iPoolId(from.iPoolId)
+			bNiceHash(from.bNiceHash), bStall(from.bStall), iNoncePrefixBits(from.iNoncePrefixBits), iPoolId(from.iPoolId)
 		{
 			assert(iWorkSize <= sizeof(bWorkBlob));
 			memcpy(sJobID, from.sJobID, sizeof(sJobID));
@@ -68,6 +71,7 @@ namespace xmrstak
 			iTarget = from.iTarget;
 			bNiceHash = from.bNiceHash;
 			bStall = from.bStall;
+			iNoncePrefixBits = from.iNoncePrefixBits;
 			iPoolId = from.iPoolId;
 
 			assert(iWorkSize <= sizeof(bWorkBlob));
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "xmrstak/backend/GlobalStates.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+
+namespace xmrstak
+{
+
+/** nonce ranges of the threads of one backend
+ *
+ * The backend leases big blocks from GlobalStates and splits them into the
+ * ranges of its threads, the global nonce counter is only touched once per block.
+ */
+class nonce_range
+{
+public:
+	explicit nonce_range(uint64_t blockSize) : blockSize(blockSize) {}
+
+	/** lease the nonces of a thread
+	 *
+	 * @param iJobNo job of the thread
+	 * @param granule the range is a multiple of this number of nonces
+	 * @param count wanted number of nonces, a multiple of granule
+	 * @param[out] offset first nonce of the range without the nonce prefix of the pool
+	 * @return number of leased nonces, 0 if the job is outdated or the nonce space of the job is exhausted
+	 */
+	uint64_t lease(uint64_t iJobNo, uint64_t granule, uint64_t count, uint64_t& offset)
+	{
+		std::lock_guard<std::mutex> lck(mtx);
+		if(jobNo != iJobNo)
+		{
+			// never fill the block of an outdated job with nonces of the new job
+			if(GlobalStates::inst().iGlobalJobNo.load(std::memory_order_relaxed) != iJobNo)
+				return 0;
+			jobNo = iJobNo;
+			next = end = 0;
+		}
+
+		if(end - next < granule)
+		{
+			// the rest of the old block is smaller than a range and is dropped
+			uint64_t n = GlobalStates::inst().lease_nonces(std::max(blockSize, count), next);
+			end = next + n;
+			if(n < granule)
+			{
+				next = end;
+				return 0;
+			}
+		}
+
+		offset = next;
+		uint64_t n = std::min(count, (end - next) / granule * granule);
+		next += n;
+		return n;
+	}
+
+private:
+	std::mutex mtx;
+	const uint64_t blockSize;
+	uint64_t jobNo = 0;
+	uint64_t next = 0;
+	uint64_t end = 0;
+};
+
+} // namespace xmrstak
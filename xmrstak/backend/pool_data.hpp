@@ -10,7 +10,8 @@ namespace xmrstak
 
 struct pool_data
 {
-	uint32_t iSavedNonce;
+	// nonce offset of the pool job without the nonce prefix
+	uint64_t iSavedNonce;
 	size_t   pool_id;
 
 	pool_data() : iSavedNonce(0), pool_id(invalid_pool_id)
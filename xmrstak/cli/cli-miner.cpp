@@ -31,6 +31,9 @@
 #include "xmrstak/misc/configEditor.hpp"
 #include "xmrstak/version.hpp"
 #include "xmrstak/misc/utility.hpp"
+#include "xmrstak/http/httpd.hpp"
+#include "xmrstak/net/stratum_proxy.hpp"
+#include "xmrstak/misc/job_trace.hpp"
 
 
 #include <stdlib.h>
@@ -52,6 +55,8 @@
 #endif // _WIN32
 
 int do_benchmark(int block_version, int wait_sec, int work_sec);
+int do_trace_replay(const std::string& file, double speed, int wait_sec, int work_sec);
+int do_autotune();
 
 void help()
 {
@@ -65,17 +70,38 @@ void help()
 	cout<<"  -V, --version-long         show long version number"<<endl;
 	cout<<"  -c, --config FILE          common miner configuration file"<<endl;
 	cout<<"  -C, --poolconf FILE        pool configuration file"<<endl;
+	cout<<"  -i, --httpd HTTP_PORT      port of the statistics server, 0 disables the server"<<endl;
+	cout<<"  --proxy PORT               serve the jobs of the pool to other miners on PORT"<<endl;
+	cout<<"  --proxy-bits BITS                ... nonce bits used to split the jobs, up to"<<endl;
+	cout<<"                             2^BITS - 1 miners can connect, default: 8"<<endl;
 #ifdef _WIN32
 	cout<<"  --noUAC                    disable the UAC dialog"<<endl;
 #endif
 	cout<<"  --benchmark BLOCKVERSION   ONLY do a benchmark and exit"<<endl;
 	cout<<"  --benchwait WAIT_SEC             ... benchmark wait time"<<endl;
 	cout<<"  --benchwork WORK_SEC             ... benchmark work time"<<endl;
+	cout<<"  --trace-record FILE        write all jobs received from the pools to FILE"<<endl;
+	cout<<"  --trace-replay FILE        ONLY mine the jobs of a recorded trace and exit,"<<endl;
+	cout<<"                             --benchwait is used before the first job and the"<<endl;
+	cout<<"                             last job is mined for --benchwork seconds"<<endl;
+	cout<<"  --trace-speed FACTOR             ... replay FACTOR times faster than recorded"<<endl;
 #ifndef CONF_NO_OPENCL
 	cout<<"  --noCache               disable the AMD(OpenCL) cache for precompiled binaries"<<endl;
+	cout<<"  --cacheLimit MiB           size limit of the AMD(OpenCL) cache, 0 means unlimited"<<endl;
+	cout<<"                             default: 256"<<endl;
 	cout<<"  --openCLVendor VENDOR      use OpenCL driver of VENDOR and devices AMD"<<endl;
 	cout<<"                             default: AMD"<<endl;
+	cout<<"  --openCLDeviceType TYPE    use OpenCL devices of TYPE: gpu, cpu or all"<<endl;
+	cout<<"                             default: gpu"<<endl;
+	cout<<"  --openCLProfile            measure the time of each OpenCL kernel and transfer,"<<endl;
+	cout<<"                             the statistic is shown in the hashrate report"<<endl;
+	cout<<"  --amdWatchdog SEC          rebuild the OpenCL context of a GPU which does not"<<endl;
+	cout<<"                             finish a round within SEC seconds, 0 disables the check"<<endl;
+	cout<<"                             default: 30"<<endl;
 	cout<<"  --amd FILE                 AMD backend miner config file"<<endl;
+	cout<<"  --autotune                 ONLY measure the fastest AMD settings, write them"<<endl;
+	cout<<"                             to the AMD backend config file and exit"<<endl;
+	cout<<"  --autotunetime SAMPLE_SEC        ... measure time per tested setting"<<endl;
 #endif
 	cout<<" "<<endl;
 	cout<<"The following options can be used for automatic start without a guided config,"<<endl;
@@ -407,6 +433,89 @@ int main(int argc, char *argv[])
 		{
 			params::inst().cache = false;
 		}
+		else if(opName.compare("--cacheLimit") == 0)
+		{
+			++i;
+			if( i >= argc )
+			{
+				Printer::inst()->print_msg(L0, "No argument for parameter '--cacheLimit' given");
+				win_exit();
+				return 1;
+			}
+			char* endp = nullptr;
+			long int limit = strtol(argv[i], &endp, 10);
+			if(endp == argv[i] || *endp != '\0' || limit < 0)
+			{
+				Printer::inst()->print_msg(L0, "'--cacheLimit' must be a positive number of MiB or 0");
+				win_exit();
+				return 1;
+			}
+			params::inst().cacheLimit = limit;
+		}
+		else if(opName.compare("--openCLDeviceType") == 0)
+		{
+			++i;
+			if( i >=argc )
+			{
+				Printer::inst()->print_msg(L0, "No argument for parameter '--openCLDeviceType' given");
+				win_exit();
+				return 1;
+			}
+			std::string type(argv[i]);
+			if(type != "gpu" && type != "cpu" && type != "all")
+			{
+				Printer::inst()->print_msg(L0, "'--openCLDeviceType' must be 'gpu', 'cpu' or 'all'");
+				win_exit();
+				return 1;
+			}
+			params::inst().openCLDeviceType = type;
+		}
+		else if(opName.compare("--openCLProfile") == 0)
+		{
+			params::inst().openCLProfile = true;
+		}
+		else if(opName.compare("--amdWatchdog") == 0)
+		{
+			++i;
+			if( i >= argc )
+			{
+				Printer::inst()->print_msg(L0, "No argument for parameter '--amdWatchdog' given");
+				win_exit();
+				return 1;
+			}
+			char* endp = nullptr;
+			long int sec = strtol(argv[i], &endp, 10);
+			if(endp == argv[i] || *endp != '\0' || sec < 0)
+			{
+				Printer::inst()->print_msg(L0, "'--amdWatchdog' must be a positive number of seconds or 0");
+				win_exit();
+				return 1;
+			}
+			params::inst().amdWatchdogSec = sec;
+		}
+		else if(opName.compare("--autotune") == 0)
+		{
+			params::inst().autotune = true;
+		}
+		else if(opName.compare("--autotunetime") == 0)
+		{
+			++i;
+			if( i >= argc )
+			{
+				Printer::inst()->print_msg(L0, "No argument for parameter '--autotunetime' given");
+				win_exit();
+				return 1;
+			}
+			char* endp = nullptr;
+			long int samplesec = strtol(argv[i], &endp, 10);
+			if(endp == argv[i] || *endp != '\0' || samplesec < 1 || samplesec > 60)
+			{
+				Printer::inst()->print_msg(L0, "Autotune sample seconds must be in the range [1,60]");
+				win_exit();
+				return 1;
+			}
+			params::inst().autotune_sample_sec = samplesec;
+		}
 		else if(opName.compare("--amd") == 0)
 		{
 			++i;
@@ -536,6 +645,63 @@ int main(int argc, char *argv[])
 			}
 			params::inst().configFilePools = argv[i];
 		}
+		else if(opName.compare("-i") == 0 || opName.compare("--httpd") == 0)
+		{
+			++i;
+			if( i >=argc )
+			{
+				Printer::inst()->print_msg(L0, "No argument for parameter '-i/--httpd' given");
+				win_exit();
+				return 1;
+			}
+			char* endp = nullptr;
+			long int port = strtol(argv[i], &endp, 10);
+			if(endp == argv[i] || *endp != '\0' || port < 0 || port > 65535)
+			{
+				Printer::inst()->print_msg(L0, "HTTP port must be in the range [0,65535]");
+				win_exit();
+				return 1;
+			}
+			params::inst().httpd_port = port;
+		}
+		else if(opName.compare("--proxy") == 0)
+		{
+			++i;
+			if( i >=argc )
+			{
+				Printer::inst()->print_msg(L0, "No argument for parameter '--proxy' given");
+				win_exit();
+				return 1;
+			}
+			char* endp = nullptr;
+			long int port = strtol(argv[i], &endp, 10);
+			if(endp == argv[i] || *endp != '\0' || port < 1 || port > 65535)
+			{
+				Printer::inst()->print_msg(L0, "Proxy port must be in the range [1,65535]");
+				win_exit();
+				return 1;
+			}
+			params::inst().proxyPort = port;
+		}
+		else if(opName.compare("--proxy-bits") == 0)
+		{
+			++i;
+			if( i >=argc )
+			{
+				Printer::inst()->print_msg(L0, "No argument for parameter '--proxy-bits' given");
+				win_exit();
+				return 1;
+			}
+			char* endp = nullptr;
+			long int bits = strtol(argv[i], &endp, 10);
+			if(endp == argv[i] || *endp != '\0' || bits < 1 || bits > 16)
+			{
+				Printer::inst()->print_msg(L0, "Proxy bits must be in the range [1,16]");
+				win_exit();
+				return 1;
+			}
+			params::inst().proxyBits = bits;
+		}
 		else if(opName.compare("--noUAC") == 0)
 		{
 			params::inst().allowUAC = false;
@@ -597,6 +763,39 @@ int main(int argc, char *argv[])
 			}
 			params::inst().benchmark_work_sec = worksec;
 		}
+		else if(opName.compare("--trace-record") == 0 || opName.compare("--trace-replay") == 0)
+		{
+			++i;
+			if( i >= argc )
+			{
+				Printer::inst()->print_msg(L0, "No argument for parameter '%s' given", opName.c_str());
+				win_exit();
+				return 1;
+			}
+			if(opName.compare("--trace-record") == 0)
+				params::inst().traceRecordFile = argv[i];
+			else
+				params::inst().traceReplayFile = argv[i];
+		}
+		else if(opName.compare("--trace-speed") == 0)
+		{
+			++i;
+			if( i >= argc )
+			{
+				Printer::inst()->print_msg(L0, "No argument for parameter '--trace-speed' given");
+				win_exit();
+				return 1;
+			}
+			char* endp = nullptr;
+			double speed = strtod(argv[i], &endp);
+			if(endp == argv[i] || *endp != '\0' || !(speed >= 0.01 && speed <= 1000.0))
+			{
+				Printer::inst()->print_msg(L0, "Trace speed must be in the range [0.01,1000]");
+				win_exit();
+				return 1;
+			}
+			params::inst().traceSpeed = speed;
+		}
 		else
 		{
 			Printer::inst()->print_msg(L0, "Parameter unknown '%s'",argv[i]);
@@ -656,6 +855,47 @@ int main(int argc, char *argv[])
 		return do_benchmark(params::inst().benchmark_block_version, params::inst().benchmark_wait_sec, params::inst().benchmark_work_sec);
 	}
 
+	if(!params::inst().traceReplayFile.empty())
+	{
+		Printer::inst()->print_str("!!!! Doing only a trace replay and exiting. To mine, remove the '--trace-replay' option. !!!!\n");
+		return do_trace_replay(params::inst().traceReplayFile, params::inst().traceSpeed, params::inst().benchmark_wait_sec, params::inst().benchmark_work_sec);
+	}
+
+	if(params::inst().autotune)
+	{
+		Printer::inst()->print_str("!!!! Doing only an autotune and exiting. To mine, remove the '--autotune' option. !!!!\n");
+		return do_autotune();
+	}
+
+	if(!params::inst().traceRecordFile.empty())
+	{
+		if(!job_trace::inst()->start(params::inst().traceRecordFile, jconf::inst()->GetMiningCoin()))
+		{
+			Printer::inst()->print_msg(L0, "Can't create the job trace '%s'.", params::inst().traceRecordFile.c_str());
+			win_exit();
+			return 1;
+		}
+		Printer::inst()->print_msg(L0, "Recording the jobs to '%s'.", params::inst().traceRecordFile.c_str());
+	}
+
+	if(jconf::inst()->GetHttpdPort() != params::httpd_port_disabled)
+	{
+		if(!httpd::inst()->start_daemon())
+		{
+			win_exit();
+			return 1;
+		}
+	}
+
+	if(params::inst().proxyPort != 0)
+	{
+		if(!stratum_proxy::inst()->start(params::inst().proxyPort, params::inst().proxyBits))
+		{
+			win_exit();
+			return 1;
+		}
+	}
+
 	Executor::inst()->ex_start(jconf::inst()->DaemonMode());
 
 	uint64_t lastTime = get_timestamp_ms();
@@ -708,9 +948,6 @@ int do_benchmark(int block_version, int wait_sec, int work_sec)
 	Printer::inst()->print_msg(L0, "Wait %d sec until all backends are initialized",wait_sec);
 	std::this_thread::sleep_for(std::chrono::seconds(wait_sec));
 
-	/* AMD is currently only supporting work sizes up to 84byte
-	 * \todo fix this issue
-	 */
 	xmrstak::miner_work benchWork = xmrstak::miner_work("", work, 84, 0, false, 0);
 	Printer::inst()->print_msg(L0, "Start a %d second benchmark...",work_sec);
 	xmrstak::GlobalStates::inst().switch_work(benchWork, dat);
@@ -735,3 +972,118 @@ int do_benchmark(int block_version, int wait_sec, int work_sec)
 	Printer::inst()->print_msg(L0, "Benchmark Total: %.1f H/S", fTotalHps);
 	return 0;
 }
+
+int do_trace_replay(const std::string& file, double speed, int wait_sec, int work_sec)
+{
+	using namespace std::chrono;
+
+	xmrstak::job_trace_reader reader;
+	std::string sError;
+	if(!reader.open(file, sError))
+	{
+		Printer::inst()->print_msg(L0, "Can't replay the job trace '%s': %s", file.c_str(), sError.c_str());
+		return 1;
+	}
+
+	std::vector<xmrstak::trace_job> jobs;
+	xmrstak::trace_job job;
+	while(reader.next(job))
+		jobs.push_back(job);
+
+	if(jobs.empty())
+	{
+		Printer::inst()->print_msg(L0, "The job trace '%s' has no jobs.", file.c_str());
+		return 1;
+	}
+
+	// the algorithm is selected by the block version and the currency of the config, like for pool jobs
+	if(reader.get_currency() != jconf::inst()->GetMiningCoin())
+		Printer::inst()->print_msg(L0, "WARNING: the trace was recorded for '%s' but the config mines '%s'.",
+			reader.get_currency().c_str(), jconf::inst()->GetMiningCoin().c_str());
+
+	Printer::inst()->print_msg(L0, "Prepare the replay of %llu jobs, speed factor %.2f", int_port(jobs.size()), speed);
+
+	xmrstak::pool_data dat;
+	xmrstak::miner_work oWork = xmrstak::miner_work();
+	std::vector<xmrstak::iBackend*>* pvThreads = xmrstak::BackendConnector::thread_starter(oWork);
+
+	Printer::inst()->print_msg(L0, "Wait %d sec until all backends are initialized", wait_sec);
+	std::this_thread::sleep_for(seconds(wait_sec));
+
+	auto counters = [pvThreads](uint64_t& hashes, uint64_t& valid, uint64_t& invalid, uint64_t& lost) {
+		hashes = valid = invalid = lost = 0;
+		for(xmrstak::iBackend* backend : *pvThreads)
+		{
+			hashes += backend->iHashCount.load(std::memory_order_relaxed);
+			valid += backend->iValidResults.load(std::memory_order_relaxed);
+			invalid += backend->iInvalidResults.load(std::memory_order_relaxed);
+			lost += backend->iLostResults.load(std::memory_order_relaxed);
+		}
+	};
+
+	uint64_t iHashes, iValid, iInvalid, iLost;
+	counters(iHashes, iValid, iInvalid, iLost);
+	const uint64_t iHashesStart = iHashes, iValidStart = iValid, iInvalidStart = iInvalid, iLostStart = iLost;
+	double fExpected = 0.0;
+
+	// the jobs are switched on a fixed schedule, a late switch does not delay the following jobs
+	const steady_clock::time_point tReplayStart = steady_clock::now();
+	steady_clock::time_point tJobStart = tReplayStart;
+	for(size_t i = 0; i < jobs.size(); i++)
+	{
+		const xmrstak::trace_job& tj = jobs[i];
+		xmrstak::miner_work replayWork(tj.sJobID, tj.bWorkBlob, tj.iWorkLen, tj.iTarget, tj.bNiceHash, 0);
+		if(tj.iNoncePrefixBits > replayWork.iNoncePrefixBits)
+			replayWork.iNoncePrefixBits = tj.iNoncePrefixBits;
+
+		dat.iSavedNonce = 0;
+		xmrstak::GlobalStates::inst().switch_work(replayWork, dat);
+
+		steady_clock::time_point tJobEnd;
+		if(i + 1 < jobs.size())
+			tJobEnd = tReplayStart + microseconds((uint64_t)((jobs[i + 1].iTimeUs - jobs[0].iTimeUs) / speed));
+		else
+			tJobEnd = tJobStart + seconds(work_sec);
+		std::this_thread::sleep_until(tJobEnd);
+
+		uint64_t iHashesNow, iValidNow, iInvalidNow, iLostNow;
+		counters(iHashesNow, iValidNow, iInvalidNow, iLostNow);
+		steady_clock::time_point tNow = steady_clock::now();
+		double fSec = duration_cast<microseconds>(tNow - tJobStart).count() / 1e6;
+		uint64_t iDiff = jpsock::t64_to_diff(tj.iTarget);
+		double fJobExpected = (double)(iHashesNow - iHashes) / iDiff;
+		fExpected += fJobExpected;
+
+		Printer::inst()->print_msg(L0, "Job %3llu %-16.16s v%u diff %8llu %7.1f s: %10llu hashes %9.1f H/s, results %llu (expected %.1f), invalid %llu, lost %llu",
+			int_port(i), tj.sJobID, (unsigned int)tj.bWorkBlob[0], int_port(iDiff), fSec, int_port(iHashesNow - iHashes),
+			fSec > 0.0 ? (iHashesNow - iHashes) / fSec : 0.0, int_port(iValidNow - iValid), fJobExpected,
+			int_port(iInvalidNow - iInvalid), int_port(iLostNow - iLost));
+
+		iHashes = iHashesNow;
+		iValid = iValidNow;
+		iInvalid = iInvalidNow;
+		iLost = iLostNow;
+		tJobStart = tNow;
+	}
+
+	xmrstak::GlobalStates::inst().switch_work(oWork, dat);
+
+	double fTotalSec = duration_cast<microseconds>(tJobStart - tReplayStart).count() / 1e6;
+	Printer::inst()->print_msg(L0, "Replay Total: %.1f s, %llu hashes %.1f H/s, results %llu (expected %.1f), invalid %llu, lost %llu",
+		fTotalSec, int_port(iHashes - iHashesStart), fTotalSec > 0.0 ? (iHashes - iHashesStart) / fTotalSec : 0.0,
+		int_port(iValid - iValidStart), fExpected, int_port(iInvalid - iInvalidStart), int_port(iLost - iLostStart));
+	return iInvalid != iInvalidStart ? 1 : 0;
+}
+
+int do_autotune()
+{
+	Printer::inst()->print_msg(L0, "Prepare autotune, every setting is measured for %d sec", xmrstak::params::inst().autotune_sample_sec);
+
+	// the backends only write their tuned config and start no mining threads
+	xmrstak::miner_work oWork = xmrstak::miner_work();
+	std::vector<xmrstak::iBackend*>* pvThreads = xmrstak::BackendConnector::thread_starter(oWork);
+
+	Printer::inst()->print_msg(L0, "Autotune finished, start the miner without '--autotune' to use the measured settings.");
+	delete pvThreads;
+	return 0;
+}
@@ -43,6 +43,17 @@ R"===(
  */
 "h_print_time" : 60,
 
+/*
+ * Built-in web server
+ * The reports of the miner are available as plain text (/h, /r, /c), as JSON (/api.json) and
+ * in the Prometheus text format (/metrics), e.g. "curl http://127.0.0.1:PORT/api.json".
+ * The server has no authentication, don't expose the port to untrusted networks.
+ * Ports lower than 1024 on Linux systems will require root.
+ *
+ * httpd_port - Port we should listen on. Default, 0, will switch off the server.
+ */
+"httpd_port" : 0,
+
 /*
  * Manual hardware AES override
  *
@@ -0,0 +1,178 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#include "httpd.hpp"
+#include "xmrstak/jconf.hpp"
+#include "xmrstak/misc/console.hpp"
+#include "xmrstak/misc/executor.hpp"
+#include "xmrstak/net/sock_server.hpp"
+
+#include <cstring>
+#include <string>
+#include <thread>
+
+namespace
+{
+// size limit of the request header, the body of a request is never read
+constexpr size_t iMaxRequestSize = 4096;
+// a client which does not send its request within this time is dropped
+constexpr int iClientTimeoutSec = 5;
+
+#ifdef MSG_NOSIGNAL
+constexpr int iSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int iSendFlags = 0;
+#endif
+
+void set_client_timeout(SOCKET client)
+{
+#ifdef _WIN32
+	DWORD timeout = iClientTimeoutSec * 1000;
+#else
+	timeval timeout;
+	timeout.tv_sec = iClientTimeoutSec;
+	timeout.tv_usec = 0;
+#endif
+	setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+	setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+}
+
+struct http_route
+{
+	const char* path;
+	ex_event_name report;
+	const char* contentType;
+};
+
+const http_route routes[] = {
+	{ "/", EV_HTTP_HASHRATE, "text/plain; charset=utf-8" },
+	{ "/h", EV_HTTP_HASHRATE, "text/plain; charset=utf-8" },
+	{ "/r", EV_HTTP_RESULTS, "text/plain; charset=utf-8" },
+	{ "/c", EV_HTTP_CONNSTAT, "text/plain; charset=utf-8" },
+	{ "/api.json", EV_HTTP_JSON, "application/json" },
+	{ "/metrics", EV_HTTP_METRICS, "text/plain; version=0.0.4; charset=utf-8" }
+};
+} // namespace
+
+bool httpd::start_daemon()
+{
+	uint64_t iPort = jconf::inst()->GetHttpdPort();
+
+	std::string sError;
+	hListen = sock_listen((uint16_t)iPort, 16, sError);
+	if(hListen == INVALID_SOCKET)
+	{
+		Printer::inst()->print_msg(L0, "HTTP Daemon %s", sError.c_str());
+		return false;
+	}
+
+	Printer::inst()->print_msg(L1, "HTTP Daemon listening on port %llu.", int_port(iPort));
+	std::thread(&httpd::serve_loop, this).detach();
+	return true;
+}
+
+void httpd::serve_loop()
+{
+	while(true)
+	{
+		SOCKET client = sock_accept(hListen, nullptr);
+		set_client_timeout(client);
+		serve_request(client);
+		sock_close(client);
+	}
+}
+
+void httpd::serve_request(SOCKET client)
+{
+	std::string request;
+	char buf[1024];
+
+	while(request.find("\r\n\r\n") == std::string::npos && request.find("\n\n") == std::string::npos)
+	{
+		if(request.size() >= iMaxRequestSize)
+		{
+			send_response(client, "431 Request Header Fields Too Large", "text/plain", "Request too large.\n");
+			return;
+		}
+
+		int ret = recv(client, buf, sizeof(buf), 0);
+		if(ret <= 0)
+			return;
+		request.append(buf, ret);
+	}
+
+	// request line: METHOD SP PATH SP VERSION
+	size_t methodEnd = request.find(' ');
+	size_t pathEnd = methodEnd == std::string::npos ? std::string::npos : request.find_first_of(" \r\n", methodEnd + 1);
+	if(pathEnd == std::string::npos)
+	{
+		send_response(client, "400 Bad Request", "text/plain", "Bad request.\n");
+		return;
+	}
+
+	std::string method = request.substr(0, methodEnd);
+	std::string path = request.substr(methodEnd + 1, pathEnd - methodEnd - 1);
+	path = path.substr(0, path.find('?'));
+
+	for(const http_route& route : routes)
+	{
+		if(path != route.path)
+			continue;
+
+		if(method != "GET")
+		{
+			send_response(client, "405 Method Not Allowed", "text/plain", "Only GET is supported.\n");
+			return;
+		}
+
+		std::string body;
+		Executor::inst()->get_http_report(route.report, body);
+		send_response(client, "200 OK", route.contentType, body);
+		return;
+	}
+
+	send_response(client, "404 Not Found", "text/plain", "Not found, try /h, /r, /c, /api.json or /metrics.\n");
+}
+
+void httpd::send_response(SOCKET client, const char* status, const char* contentType, const std::string& body)
+{
+	std::string rsp;
+	rsp.reserve(body.size() + 256);
+	rsp.append("HTTP/1.0 ").append(status).append("\r\n");
+	rsp.append("Content-Type: ").append(contentType).append("\r\n");
+	rsp.append("Content-Length: ").append(std::to_string(body.size())).append("\r\n");
+	if(strncmp(status, "405", 3) == 0)
+		rsp.append("Allow: GET\r\n");
+	rsp.append("Cache-Control: no-cache\r\n");
+	rsp.append("Connection: close\r\n\r\n");
+	rsp.append(body);
+
+	size_t pos = 0;
+	while(pos < rsp.size())
+	{
+		int ret = send(client, rsp.c_str() + pos, (int)(rsp.size() - pos), iSendFlags);
+		if(ret <= 0)
+			return;
+		pos += ret;
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "xmrstak/misc/Environment.hpp"
+#include "xmrstak/net/socks.hpp"
+
+#include <string>
+
+/** minimal HTTP/1.0 server for the statistics of the miner
+ *
+ * One thread serves the requests one after another, a report is created by the executor
+ * thread (see Executor::get_http_report), the mining threads are never locked.
+ */
+class httpd
+{
+public:
+	static httpd* inst()
+	{
+		auto& env = xmrstak::Environment::inst();
+		if(env.pHttpd == nullptr)
+			env.pHttpd = new httpd;
+		return env.pHttpd;
+	};
+
+	/** listen on the configured port and start the server thread
+	 *
+	 * @return false if the port can not be opened
+	 */
+	bool start_daemon();
+
+private:
+	httpd() = default;
+
+	void serve_loop();
+	void serve_request(SOCKET client);
+	void send_response(SOCKET client, const char* status, const char* contentType, const std::string& body);
+
+	SOCKET hListen = INVALID_SOCKET;
+};
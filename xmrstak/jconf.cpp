@@ -52,7 +52,7 @@ using namespace rapidjson;
  */
 enum configEnum {
 	aPoolList, sCurrency, bTlsSecureAlgo, iCallTimeout, iNetRetry, iGiveUpLimit, iVerboseLevel, bPrintMotd, iAutohashTime,
-	bDaemonMode, sOutputFile, bPreferIpv4, bAesOverride, sUseSlowMem
+	iHttpdPort, bDaemonMode, sOutputFile, bPreferIpv4, bAesOverride, sUseSlowMem
 };
 
 struct configVal {
@@ -73,6 +73,7 @@ configVal oConfigValues[] = {
 	{ iVerboseLevel, "verbose_level", kNumberType },
 	{ bPrintMotd, "print_motd", kTrueType },
 	{ iAutohashTime, "h_print_time", kNumberType },
+	{ iHttpdPort, "httpd_port", kNumberType },
 	{ bDaemonMode, "daemon_mode", kTrueType },
 	{ sOutputFile, "output_file", kStringType },
 	{ bPreferIpv4, "prefer_ipv4", kTrueType },
@@ -229,6 +230,18 @@ uint64_t jconf::GetAutohashTime()
 	return prv->configValues[iAutohashTime]->GetUint64();
 }
 
+uint16_t jconf::GetHttpdPort()
+{
+	if(xmrstak::params::inst().httpd_port == xmrstak::params::httpd_port_unset)
+	{
+		// a config file created before the statistics server has no httpd_port, the server is disabled
+		if(prv->configValues[iHttpdPort] == nullptr)
+			return 0;
+		return prv->configValues[iHttpdPort]->GetUint();
+	}
+	return xmrstak::params::inst().httpd_port;
+}
+
 
 bool jconf::DaemonMode()
 {
@@ -403,6 +416,10 @@ bool jconf::parse_file(const char* sFilename, bool main_conf)
 
 			prv->configValues[i] = GetObjectMember(root, oConfigValues[i].sName);
 
+			// httpd_port is optional, it is missing in older config files
+			if(prv->configValues[i] == nullptr && i == iHttpdPort)
+				continue;
+
 			if(prv->configValues[i] == nullptr)
 			{
 				Printer::inst()->print_msg(L0, "Invalid config file '%s'. Missing value \"%s\".", sFilename, oConfigValues[i].sName);
@@ -535,6 +552,14 @@ bool jconf::parse_config(const char* sFilename, const char* sFilenamePools)
 		return false;
 	}
 
+	if(prv->configValues[iHttpdPort] != nullptr &&
+		(!prv->configValues[iHttpdPort]->IsUint() || prv->configValues[iHttpdPort]->GetUint() > 0xFFFF))
+	{
+		Printer::inst()->print_msg(L0,
+			"Invalid config file. httpd_port has to be in the range 0 to 65535.");
+		return false;
+	}
+
 	if(prv->configValues[bAesOverride]->IsBool())
 		bHaveAes = prv->configValues[bAesOverride]->GetBool();
 
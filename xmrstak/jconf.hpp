@@ -57,6 +57,8 @@ public:
 	bool PrintMotd();
 	uint64_t GetAutohashTime();
 
+	uint16_t GetHttpdPort();
+
 	const char* GetOutputFile();
 
 	uint64_t GetCallTimeout();
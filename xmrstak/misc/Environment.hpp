@@ -3,12 +3,15 @@
 class Printer;
 class jconf;
 class Executor;
+class httpd;
+class stratum_proxy;
 
 namespace xmrstak
 {
 
 struct GlobalStates;
 struct params;
+class job_trace;
 
 struct Environment {
 	static inline Environment& inst(Environment* init = nullptr) {
@@ -29,6 +32,9 @@ struct Environment {
 	jconf* pJconfConfig = nullptr;
 	Executor* pExecutor = nullptr;
 	params* pParams = nullptr;
+	httpd* pHttpd = nullptr;
+	job_trace* pJobTrace = nullptr;
+	stratum_proxy* pStratumProxy = nullptr;
 };
 
 } // namespace xmrstak
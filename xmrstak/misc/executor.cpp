@@ -24,6 +24,7 @@
 #include "xmrstak/jconf.hpp"
 #include "executor.hpp"
 #include "xmrstak/net/jpsock.hpp"
+#include "xmrstak/net/stratum_proxy.hpp"
 
 #include "telemetry.hpp"
 #include "xmrstak/backend/miner_work.hpp"
@@ -33,6 +34,7 @@
 
 #include "xmrstak/jconf.hpp"
 #include "xmrstak/misc/console.hpp"
+#include "xmrstak/misc/utility.hpp"
 #include "xmrstak/version.hpp"
 
 #include <thread>
@@ -49,34 +51,50 @@
 #endif // _WIN32
 
 void Executor::push_timed_event(ex_event&& ev, size_t sec) {
+	push_timed_event(std::move(ev), std::chrono::steady_clock::now() + std::chrono::seconds(sec), std::chrono::milliseconds(0));
+}
+
+void Executor::push_timed_event(ex_event&& ev, std::chrono::steady_clock::time_point deadline, std::chrono::milliseconds period) {
 	std::unique_lock<std::mutex> lck(timed_event_mutex);
-	lTimedEvents.emplace_back(std::move(ev), sec_to_ticks(sec));
+	vTimedEvents.emplace_back(new timed_event(std::move(ev), deadline, iTimedEventSeq++, period));
+	std::push_heap(vTimedEvents.begin(), vTimedEvents.end(), timed_event_later);
+
+	// wake the clock thread if the new event is the next one
+	bool bFirst = vTimedEvents.front()->deadline == deadline;
+	lck.unlock();
+	if(bFirst)
+		timed_event_cv.notify_one();
 }
 
 void Executor::ex_clock_thd() {
-	size_t tick = 0;
+	std::unique_lock<std::mutex> lck(timed_event_mutex);
 	while (true) {
-		std::this_thread::sleep_for(std::chrono::milliseconds(size_t(iTickTime)));
-
-		push_event(ex_event(EV_PERF_TICK));
-
-		//Eval pool choice every fourth tick
-		if((tick++ & 0x03) == 0)
-			push_event(ex_event(EV_EVAL_POOL_CHOICE));
-
-		// Service timed events
-		std::unique_lock<std::mutex> lck(timed_event_mutex);
-		std::list<timed_event>::iterator ev = lTimedEvents.begin();
-		while (ev != lTimedEvents.end()) {
-			ev->ticks_left--;
-			if(ev->ticks_left == 0) {
-				push_event(std::move(ev->event));
-				ev = lTimedEvents.erase(ev);
-			} else {
-				ev++;
-			}
+		if(vTimedEvents.empty()) {
+			timed_event_cv.wait(lck);
+			continue;
+		}
+
+		auto deadline = vTimedEvents.front()->deadline;
+		if(std::chrono::steady_clock::now() < deadline) {
+			// a new earlier event wakes us up
+			timed_event_cv.wait_until(lck, deadline);
+			continue;
+		}
+
+		std::pop_heap(vTimedEvents.begin(), vTimedEvents.end(), timed_event_later);
+		std::unique_ptr<timed_event> ev = std::move(vTimedEvents.back());
+		vTimedEvents.pop_back();
+
+		if(ev->period.count() != 0) {
+			// the next deadline is based on the previous one and does not drift
+			push_event(ex_event(ev->event.iName, ev->event.iPoolId));
+			ev->deadline += ev->period;
+			ev->seq = iTimedEventSeq++;
+			vTimedEvents.emplace_back(std::move(ev));
+			std::push_heap(vTimedEvents.begin(), vTimedEvents.end(), timed_event_later);
+		} else {
+			push_event(std::move(ev->event));
 		}
-		lck.unlock();
 	}
 }
 
@@ -219,6 +237,8 @@ void Executor::log_socket_error(jpsock* pool, std::string&& sError) {
 	Printer::inst()->print_msg(L1, "SOCKET ERROR - %s", vSocketLog.back().msg.c_str());
 
 	push_event(ex_event(EV_EVAL_POOL_CHOICE));
+	// reconnect as soon as the retry time is over
+	push_timed_event(ex_event(EV_EVAL_POOL_CHOICE), jconf::inst()->GetNetRetry());
 }
 
 void Executor::log_result_error(std::string&& sError) {
@@ -241,6 +261,12 @@ void Executor::log_result_error(std::string&& sError) {
 void Executor::log_result_ok(uint64_t iActualDiff) {
 	iPoolHashes += iPoolDiff;
 
+	auto tNow = std::chrono::steady_clock::now();
+	if(bHaveLastShare)
+		oShareInterval.record(std::chrono::duration_cast<std::chrono::microseconds>(tNow - tLastShare).count());
+	tLastShare = tNow;
+	bHaveLastShare = true;
+
 	size_t ln = iTopDiff.size() - 1;
 	if(iActualDiff > iTopDiff[ln]) {
 		iTopDiff[ln] = iActualDiff;
@@ -248,6 +274,7 @@ void Executor::log_result_ok(uint64_t iActualDiff) {
 	}
 
 	vMineResults[0].increment();
+	iPoolGoodRes++;
 }
 
 jpsock* Executor::pick_pool_by_id(size_t pool_id) {
@@ -303,6 +330,12 @@ void Executor::on_pool_have_job(size_t pool_id, pool_job& oPoolJob)
 	jpsock* pool = pick_pool_by_id(pool_id);
 
 	xmrstak::miner_work oWork(oPoolJob.sJobID, oPoolJob.bWorkBlob, oPoolJob.iWorkLen, oPoolJob.iTarget, pool->is_nicehash(), pool_id);
+	if(oPoolJob.iNoncePrefixBits > oWork.iNoncePrefixBits)
+		oWork.iNoncePrefixBits = oPoolJob.iNoncePrefixBits;
+
+	// the own backends mine slot 0 of the nonce space shared with the proxy miners
+	if(stratum_proxy::inst()->is_running())
+		stratum_proxy::inst()->on_upstream_job(oPoolJob, pool_id, oWork);
 
 	xmrstak::pool_data dat;
 	dat.iSavedNonce = oPoolJob.iSavedNonce;
@@ -354,41 +387,75 @@ void Executor::on_miner_result(size_t pool_id, job_result& oResult)
 		return;
 	}
 
-	size_t t_start = get_timestamp_ms();
-	bool bResult = pool->cmd_submit(oResult.sJobID, oResult.iNonce, oResult.bResult,
-		backend_name, backend_hashcount, total_hashcount, oResult.algorithm
-	);
-	size_t t_len = get_timestamp_ms() - t_start;
+	// the reply of the pool arrives as EV_SUBMIT_RESULT
+	if(!pool->cmd_submit(oResult.sJobID, oResult.iNonce, oResult.bResult,
+		backend_name, backend_hashcount, total_hashcount, oResult.algorithm))
+	{
+		log_result_error("[NETWORK ERROR]");
+	}
+}
 
-	if(t_len > 0xFFFF)
-		t_len = 0xFFFF;
-	iPoolCallTimes.push_back((uint16_t)t_len);
+void Executor::on_proxy_share(size_t pool_id, proxy_share& oShare)
+{
+	jpsock* pool = pick_pool_by_id(pool_id);
+	const job_result& oResult = oShare.oResult;
 
-	if(bResult)
+	// the hash count of a proxy miner is unknown
+	if(pool == nullptr || !pool->is_running() || !pool->is_logged_in() ||
+		!pool->cmd_submit(oResult.sJobID, oResult.iNonce, oResult.bResult, "proxy", 0, 0, oResult.algorithm, oShare.iTag))
 	{
-		uint64_t* targets = (uint64_t*)oResult.bResult;
-		log_result_ok(jpsock::t64_to_diff(targets[3]));
-		Printer::inst()->print_msg(L3, "Result accepted by the pool.");
+		stratum_proxy::inst()->on_submit_result(oShare.iTag, submit_rsp(std::string(), 0, 0, true, oShare.iTag));
 	}
-	else
+}
+
+void Executor::on_submit_result(size_t pool_id, submit_rsp& oRsp)
+{
+	// a share of a proxy miner is not part of the own results
+	if(oRsp.iProxyTag != 0)
 	{
-		if(!pool->have_sock_error())
-		{
-			Printer::inst()->print_msg(L3, "Result rejected by the pool.");
+		stratum_proxy::inst()->on_submit_result(oRsp.iProxyTag, oRsp);
+		return;
+	}
 
-			std::string error = pool->get_call_error();
+	if(oRsp.bNetworkError)
+	{
+		log_result_error("[NETWORK ERROR]");
+		return;
+	}
 
-			if(strncasecmp(error.c_str(), "Unauthenticated", 15) == 0)
-			{
-				Printer::inst()->print_msg(L2, "Your miner was unable to find a share in time. Either the pool difficulty is too high, or the pool timeout is too low.");
-				pool->disconnect();
-			}
+	oSubmitTime.record(oRsp.iRoundTripUs);
 
-			log_result_error(std::move(error));
-		}
-		else
-			log_result_error("[NETWORK ERROR]");
+	if(oRsp.sError.empty())
+	{
+		log_result_ok(oRsp.iActualDiff);
+		Printer::inst()->print_msg(L3, "Result accepted by the pool.");
+		return;
 	}
+
+	Printer::inst()->print_msg(L3, "Result rejected by the pool.");
+
+	jpsock* pool = pick_pool_by_id(pool_id);
+	if(pool != nullptr && strncasecmp(oRsp.sError.c_str(), "Unauthenticated", 15) == 0)
+	{
+		Printer::inst()->print_msg(L2, "Your miner was unable to find a share in time. Either the pool difficulty is too high, or the pool timeout is too low.");
+		pool->disconnect();
+	}
+
+	log_result_error(std::move(oRsp.sError));
+}
+
+void Executor::on_nonce_exhausted(size_t pool_id)
+{
+	if(pool_id != current_pool_id)
+		return;
+
+	jpsock* pool = pick_pool_by_id(pool_id);
+	if(pool == nullptr || !pool->is_running() || !pool->is_logged_in())
+		return;
+
+	Printer::inst()->print_msg(L2, "All nonces of the job are used, requesting a new job.");
+	// a new job arrives as EV_POOL_HAVE_JOB, until then the miner threads are idle
+	pool->cmd_getjob();
 }
 
 #ifndef _WIN32
@@ -419,7 +486,8 @@ void Executor::ex_main()
 	// \todo collect all backend threads
 	pvThreads = xmrstak::BackendConnector::thread_starter(oWork);
 
-	if(pvThreads->size()==0)
+	// a proxy without own backends is allowed
+	if(pvThreads->size()==0 && !stratum_proxy::inst()->is_running())
 	{
 		Printer::inst()->print_msg(L1, "ERROR: No miner backend enabled.");
 		win_exit();
@@ -468,6 +536,10 @@ void Executor::ex_main()
 	}
 
 	ex_event ev;
+	auto tFirstTick = std::chrono::steady_clock::now() + std::chrono::milliseconds(iTickTime);
+	push_timed_event(ex_event(EV_PERF_TICK), tFirstTick, std::chrono::milliseconds(iTickTime));
+	//Eval pool choice every fourth tick
+	push_timed_event(ex_event(EV_EVAL_POOL_CHOICE), tFirstTick, std::chrono::milliseconds(iTickTime * 4));
 	std::thread clock_thd(&Executor::ex_clock_thd, this);
 
 	eval_pool_choice();
@@ -502,15 +574,37 @@ void Executor::ex_main()
 			on_miner_result(ev.iPoolId, ev.oJobResult);
 			break;
 
+		case EV_SUBMIT_RESULT:
+			on_submit_result(ev.iPoolId, ev.oSubmitRsp);
+			break;
+
+		case EV_PROXY_SHARE:
+			on_proxy_share(ev.iPoolId, ev.oProxyShare);
+			break;
+
 		case EV_EVAL_POOL_CHOICE:
 			eval_pool_choice();
 			break;
 
+		case EV_NONCE_EXHAUSTED:
+			on_nonce_exhausted(ev.iPoolId);
+			break;
+
 		case EV_GPU_RES_ERROR:
 			log_result_error(std::string(ev.oGpuError.error_str + std::string(" GPU ID ") + std::to_string(ev.oGpuError.idx)));
 			break;
 
 		case EV_PERF_TICK:
+			// the replies of asynchronous calls are not waited for, a silent pool is detected here
+			for(jpsock& pool : pools)
+			{
+				if(pool.is_running() && pool.have_call_timeout())
+				{
+					pool.set_socket_error("CALL error: Timeout while waiting for a reply");
+					pool.disconnect();
+				}
+			}
+
 			for (i = 0; i < pvThreads->size(); i++)
 				telem->push_perf_value(i, pvThreads->at(i)->iHashCount.load(std::memory_order_relaxed),
 				pvThreads->at(i)->iTimestamp.load(std::memory_order_relaxed));
@@ -546,6 +640,14 @@ void Executor::ex_main()
 			print_report(ev.iName);
 			break;
 
+		case EV_HTTP_HASHRATE:
+		case EV_HTTP_RESULTS:
+		case EV_HTTP_CONNSTAT:
+		case EV_HTTP_JSON:
+		case EV_HTTP_METRICS:
+			http_report(ev.iName);
+			break;
+
 		case EV_HASHRATE_LOOP:
 			print_report(EV_USR_HASHRATE);
 			push_timed_event(ex_event(EV_HASHRATE_LOOP), jconf::inst()->GetAutohashTime());
@@ -627,9 +729,11 @@ void Executor::hashrate_report(std::string& out)
 				out.append(1, '\n');
 
 			double fTotalCur[3] = { 0.0, 0.0, 0.0};
+			uint64_t iAbandoned = 0;
 			for (i = 0; i < nthd; i++)
 			{
 				double fHps[3];
+				iAbandoned += backEnds[i]->iAbandonedRounds.load(std::memory_order_relaxed);
 
 				uint32_t tid = backEnds[i]->iThreadNo;
 				fHps[0] = telem->calc_telemetry_data(10000, tid);
@@ -662,6 +766,14 @@ void Executor::hashrate_report(std::string& out)
 			out.append(hps_format(fTotalCur[1], num, sizeof(num)));
 			out.append(hps_format(fTotalCur[2], num, sizeof(num)));
 			out.append(" H/s\n");
+			if(iAbandoned != 0)
+			{
+				snprintf(num, sizeof(num), "%llu", int_port(iAbandoned));
+				out.append("Rounds abandoned after a job change (").append(name).append("): ").append(num).append("\n");
+			}
+
+			for (i = 0; i < nthd; i++)
+				backEnds[i]->profile_report(out);
 
 			out.append("-----------------------------------------------------------------\n");
 		}
@@ -730,13 +842,20 @@ void Executor::result_report(std::string& out)
 	out.append("Good results     : ").append(std::to_string(iGoodRes)).append(" / ").
 		append(std::to_string(iTotalRes)).append(num);
 
-	if(iPoolCallTimes.size() != 0)
+	if(iPoolGoodRes != 0)
 	{
-		// Here we use iPoolCallTimes since it also gets reset when we disconnect
-		snprintf(num, sizeof(num), "%.1f sec\n", dConnSec / iPoolCallTimes.size());
+		// iPoolGoodRes is reset together with the connection time
+		snprintf(num, sizeof(num), "%.1f sec\n", dConnSec / iPoolGoodRes);
 		out.append("Avg result time  : ").append(num);
 	}
-	out.append("Pool-side hashes : ").append(std::to_string(iPoolHashes)).append(2, '\n');
+	out.append("Pool-side hashes : ").append(std::to_string(iPoolHashes)).append(1, '\n');
+
+	uint64_t iLostRes = 0;
+	for(xmrstak::iBackend* backend : *pvThreads)
+		iLostRes += backend->iLostResults.load(std::memory_order_relaxed);
+	if(iLostRes != 0)
+		out.append("Lost results     : ").append(std::to_string(iLostRes)).append(" (result buffer of the backend was full)\n");
+	out.append(1, '\n');
 	out.append("Top 10 best results found:\n");
 
 	for(size_t i=0; i < 10; i += 2)
@@ -746,6 +865,9 @@ void Executor::result_report(std::string& out)
 		out.append(num);
 	}
 
+	out.append(1, '\n');
+	latency_report(out);
+
 	out.append("\nError details:\n");
 	if(ln > 1)
 	{
@@ -761,6 +883,33 @@ void Executor::result_report(std::string& out)
 		out.append("Yay! No errors.\n");
 }
 
+void Executor::latency_report(std::string& out)
+{
+	char num[128];
+
+	out.append("Latency (ms):\n");
+	out.append("| Name             |      p50 |      p90 |      p99 |      max |    count |\n");
+
+	auto append_histogram = [&](const std::string& name, const xmrstak::histogram& h) {
+		if(h.count() == 0)
+			return;
+		snprintf(num, sizeof(num), "| %-16.16s | %8.1f | %8.1f | %8.1f | %8.1f | %8llu |\n", name.c_str(),
+			h.quantile(0.5) / 1000.0, h.quantile(0.9) / 1000.0, h.quantile(0.99) / 1000.0, h.max() / 1000.0,
+			int_port(h.count()));
+		out.append(num);
+	};
+
+	append_histogram("Share submit", oSubmitTime);
+	append_histogram("Share interval", oShareInterval);
+	for(xmrstak::iBackend* backend : *pvThreads)
+	{
+		std::string name(xmrstak::iBackend::getName(backend->backendType));
+		name.append(" ").append(std::to_string(backend->iThreadNo));
+		append_histogram(name + " round", backend->oRoundTime);
+		append_histogram(name + " verify", backend->oVerifyTime);
+	}
+}
+
 void Executor::connection_report(std::string& out)
 {
 	char num[128];
@@ -777,16 +926,17 @@ void Executor::connection_report(std::string& out)
 	else
 		out.append("Connected since : <not connected>\n");
 
-	size_t n_calls = iPoolCallTimes.size();
-	if (n_calls > 1)
+	if (oSubmitTime.count() > 1)
 	{
-		//Not-really-but-good-enough median
-		std::nth_element(iPoolCallTimes.begin(), iPoolCallTimes.begin() + n_calls/2, iPoolCallTimes.end());
-		out.append("Pool ping time  : ").append(std::to_string(iPoolCallTimes[n_calls/2])).append(" ms\n");
+		//Median of the submit round trips
+		out.append("Pool ping time  : ").append(std::to_string(oSubmitTime.quantile(0.5) / 1000)).append(" ms\n");
 	}
 	else
 		out.append("Pool ping time  : (n/a)\n");
 
+	if(stratum_proxy::inst()->is_running())
+		stratum_proxy::inst()->proxy_report(out);
+
 	out.append("\nNetwork error log:\n");
 	size_t ln = vSocketLog.size();
 	if(ln > 0)
@@ -826,3 +976,306 @@ void Executor::print_report(ex_event_name ev)
 
 	Printer::inst()->print_str(out.c_str());
 }
+
+void Executor::get_http_report(ex_event_name ev_id, std::string& data)
+{
+	std::lock_guard<std::mutex> lck(httpMutex);
+
+	assert(pHttpString == nullptr);
+	assert(ev_id == EV_HTTP_HASHRATE || ev_id == EV_HTTP_RESULTS || ev_id == EV_HTTP_CONNSTAT ||
+		ev_id == EV_HTTP_JSON || ev_id == EV_HTTP_METRICS);
+
+	pHttpString = &data;
+	httpReady = std::promise<void>();
+	std::future<void> ready = httpReady.get_future();
+
+	push_event(ex_event(ev_id));
+
+	ready.wait();
+	pHttpString = nullptr;
+}
+
+void Executor::http_report(ex_event_name ev)
+{
+	assert(pHttpString != nullptr);
+
+	switch(ev)
+	{
+	case EV_HTTP_HASHRATE:
+		hashrate_report(*pHttpString);
+		break;
+
+	case EV_HTTP_RESULTS:
+		result_report(*pHttpString);
+		break;
+
+	case EV_HTTP_CONNSTAT:
+		connection_report(*pHttpString);
+		break;
+
+	case EV_HTTP_JSON:
+		json_report(*pHttpString);
+		break;
+
+	case EV_HTTP_METRICS:
+		metrics_report(*pHttpString);
+		break;
+
+	default:
+		assert(false);
+		break;
+	}
+
+	httpReady.set_value();
+}
+
+namespace
+{
+// JSON has no NaN, a hashrate which is not available yet is null
+inline const char* json_format(double h, char* buf, size_t l)
+{
+	if(std::isnormal(h) || h == 0.0)
+	{
+		snprintf(buf, l, "%.1f", h);
+		return buf;
+	}
+	else
+		return "null";
+}
+
+// the label values of the Prometheus text format are escaped like JSON strings
+void metric_label_escape(std::string& out, const std::string& str)
+{
+	for(char c : str)
+	{
+		if(c == '"' || c == '\\')
+			out.append(1, '\\').append(1, c);
+		else if(c == '\n')
+			out.append("\\n");
+		else
+			out.append(1, c);
+	}
+}
+
+void metric_header(std::string& out, const char* name, const char* type, const char* help)
+{
+	out.append("# HELP ").append(name).append(1, ' ').append(help).append(1, '\n');
+	out.append("# TYPE ").append(name).append(1, ' ').append(type).append(1, '\n');
+}
+
+void metric_value(std::string& out, const char* name, const std::string& labels, double value)
+{
+	char num[64];
+	snprintf(num, sizeof(num), " %.15g\n", value);
+	out.append(name);
+	if(!labels.empty())
+		out.append(1, '{').append(labels).append(1, '}');
+	out.append(num);
+}
+
+// summary of a histogram in microseconds, the values are exported in seconds
+void metric_summary(std::string& out, const char* name, const std::string& labels, const xmrstak::histogram& h)
+{
+	const double quantiles[] = { 0.5, 0.9, 0.99 };
+	std::string sep = labels.empty() ? "" : ",";
+	for(double q : quantiles)
+	{
+		char ql[32];
+		snprintf(ql, sizeof(ql), "quantile=\"%g\"", q);
+		metric_value(out, name, labels + sep + ql, h.quantile(q) / 1e6);
+	}
+	metric_value(out, (std::string(name) + "_sum").c_str(), labels, h.sum() / 1e6);
+	metric_value(out, (std::string(name) + "_count").c_str(), labels, (double)h.count());
+}
+} // namespace
+
+void Executor::json_report(std::string& out)
+{
+	char num[128];
+	double fTotal[3] = { 0.0, 0.0, 0.0 };
+
+	out.reserve(4096 + pvThreads->size() * 256);
+	out.append("{\"version\":");
+	xmrstak::json_escape(out, get_version_str());
+
+	out.append(",\"hashrate\":{\"threads\":[");
+	for(size_t i = 0; i < pvThreads->size(); i++)
+	{
+		uint32_t tid = pvThreads->at(i)->iThreadNo;
+		double fHps[3];
+		fHps[0] = telem->calc_telemetry_data(10000, tid);
+		fHps[1] = telem->calc_telemetry_data(60000, tid);
+		fHps[2] = telem->calc_telemetry_data(900000, tid);
+
+		out.append(i == 0 ? "[" : ",[");
+		for(size_t j = 0; j < 3; j++)
+		{
+			if(j != 0)
+				out.append(1, ',');
+			out.append(json_format(fHps[j], num, sizeof(num)));
+			fTotal[j] += std::isnormal(fHps[j]) ? fHps[j] : 0.0;
+		}
+		out.append(1, ']');
+	}
+	out.append("],\"total\":[");
+	for(size_t j = 0; j < 3; j++)
+	{
+		if(j != 0)
+			out.append(1, ',');
+		out.append(json_format(fTotal[j], num, sizeof(num)));
+	}
+	out.append("],\"highest\":").append(json_format(fHighestHps, num, sizeof(num))).append(1, '}');
+
+	// counters of the mining threads, same order as the hashrate threads
+	out.append(",\"threads\":[");
+	for(size_t i = 0; i < pvThreads->size(); i++)
+	{
+		xmrstak::iBackend* backend = pvThreads->at(i);
+		snprintf(num, sizeof(num), "%s{\"backend\":\"%s\",\"id\":%u", i == 0 ? "" : ",",
+			xmrstak::iBackend::getName(backend->backendType), (unsigned int)backend->iThreadNo);
+		out.append(num);
+		out.append(",\"hashes\":").append(std::to_string(backend->iHashCount.load(std::memory_order_relaxed)));
+		out.append(",\"invalid_results\":").append(std::to_string(backend->iInvalidResults.load(std::memory_order_relaxed)));
+		out.append(",\"lost_results\":").append(std::to_string(backend->iLostResults.load(std::memory_order_relaxed)));
+		out.append(",\"abandoned_rounds\":").append(std::to_string(backend->iAbandonedRounds.load(std::memory_order_relaxed)));
+		snprintf(num, sizeof(num), ",\"round_time_ms\":[%.1f,%.1f,%.1f]}", backend->oRoundTime.quantile(0.5) / 1000.0,
+			backend->oRoundTime.quantile(0.9) / 1000.0, backend->oRoundTime.quantile(0.99) / 1000.0);
+		out.append(num);
+	}
+	out.append(1, ']');
+
+	size_t iGoodRes = vMineResults[0].count, iTotalRes = iGoodRes;
+	for(size_t i = 1; i < vMineResults.size(); i++)
+		iTotalRes += vMineResults[i].count;
+
+	double dConnSec;
+	{
+		using namespace std::chrono;
+		dConnSec = (double)duration_cast<seconds>(system_clock::now() - tPoolConnTime).count();
+	}
+
+	out.append(",\"results\":{\"diff_current\":").append(std::to_string(iPoolDiff));
+	out.append(",\"shares_good\":").append(std::to_string(iGoodRes));
+	out.append(",\"shares_total\":").append(std::to_string(iTotalRes));
+	snprintf(num, sizeof(num), "%.1f", iPoolGoodRes != 0 ? dConnSec / iPoolGoodRes : 0.0);
+	out.append(",\"avg_time\":").append(num);
+	out.append(",\"hashes_total\":").append(std::to_string(iPoolHashes));
+	out.append(",\"best\":[");
+	for(size_t i = 0; i < iTopDiff.size(); i++)
+		out.append(i == 0 ? "" : ",").append(std::to_string(iTopDiff[i]));
+	out.append("],\"error_log\":[");
+	for(size_t i = 1; i < vMineResults.size(); i++)
+	{
+		out.append(i == 1 ? "" : ",").append("{\"count\":").append(std::to_string(vMineResults[i].count));
+		out.append(",\"last_seen\":").append(std::to_string(std::chrono::system_clock::to_time_t(vMineResults[i].time)));
+		out.append(",\"text\":");
+		xmrstak::json_escape(out, vMineResults[i].msg);
+		out.append(1, '}');
+	}
+	out.append("]}");
+
+	jpsock* pool = pick_pool_by_id(current_pool_id);
+	bool bConnected = pool != nullptr && pool->is_running() && pool->is_logged_in();
+	out.append(",\"connection\":{\"pool\":");
+	xmrstak::json_escape(out, pool != nullptr ? pool->get_pool_addr() : "");
+	out.append(",\"uptime\":").append(std::to_string(bConnected ? (uint64_t)dConnSec : 0));
+	out.append(",\"ping\":").append(std::to_string(oSubmitTime.count() > 1 ? oSubmitTime.quantile(0.5) / 1000 : 0));
+	out.append(",\"error_log\":[");
+	for(size_t i = 0; i < vSocketLog.size(); i++)
+	{
+		out.append(i == 0 ? "" : ",").append("{\"last_seen\":");
+		out.append(std::to_string(std::chrono::system_clock::to_time_t(vSocketLog[i].time)));
+		out.append(",\"text\":");
+		xmrstak::json_escape(out, vSocketLog[i].msg);
+		out.append(1, '}');
+	}
+	out.append("]}}\n");
+}
+
+void Executor::metrics_report(std::string& out)
+{
+	out.reserve(8192 + pvThreads->size() * 2048);
+
+	auto thread_labels = [](xmrstak::iBackend* backend) {
+		return std::string("backend=\"") + xmrstak::iBackend::getName(backend->backendType) +
+			"\",thread=\"" + std::to_string(backend->iThreadNo) + "\"";
+	};
+
+	metric_header(out, "xmrstak_hashrate", "gauge", "Hashes per second of a mining thread averaged over the window.");
+	const struct { size_t ms; const char* name; } windows[] = { { 10000, "10s" }, { 60000, "60s" }, { 900000, "15m" } };
+	for(xmrstak::iBackend* backend : *pvThreads)
+	{
+		for(const auto& w : windows)
+		{
+			double fHps = telem->calc_telemetry_data(w.ms, backend->iThreadNo);
+			// no sample instead of NaN while the window is not filled
+			if(std::isnormal(fHps) || fHps == 0.0)
+				metric_value(out, "xmrstak_hashrate", thread_labels(backend) + ",window=\"" + w.name + "\"", fHps);
+		}
+	}
+
+	metric_header(out, "xmrstak_hashrate_highest", "gauge", "Highest total hashes per second (10s window) since the start.");
+	metric_value(out, "xmrstak_hashrate_highest", "", fHighestHps);
+
+	const struct { const char* name; const char* help; std::atomic<uint64_t> xmrstak::iBackend::*counter; } counters[] = {
+		{ "xmrstak_hashes_total", "Hashes calculated by a mining thread.", &xmrstak::iBackend::iHashCount },
+		{ "xmrstak_invalid_results_total", "Results of a mining thread which failed the CPU verification.", &xmrstak::iBackend::iInvalidResults },
+		{ "xmrstak_lost_results_total", "Results dropped because the result buffer of the device was full.", &xmrstak::iBackend::iLostResults },
+		{ "xmrstak_abandoned_rounds_total", "Rounds stopped early because the job was changed.", &xmrstak::iBackend::iAbandonedRounds }
+	};
+	for(const auto& c : counters)
+	{
+		metric_header(out, c.name, "counter", c.help);
+		for(xmrstak::iBackend* backend : *pvThreads)
+			metric_value(out, c.name, thread_labels(backend), (double)(backend->*c.counter).load(std::memory_order_relaxed));
+	}
+
+	metric_header(out, "xmrstak_round_seconds", "summary", "Duration of a hash round of a mining thread.");
+	for(xmrstak::iBackend* backend : *pvThreads)
+		metric_summary(out, "xmrstak_round_seconds", thread_labels(backend), backend->oRoundTime);
+
+	metric_header(out, "xmrstak_verify_seconds", "summary", "Duration of the CPU verification of a result.");
+	for(xmrstak::iBackend* backend : *pvThreads)
+		metric_summary(out, "xmrstak_verify_seconds", thread_labels(backend), backend->oVerifyTime);
+
+	size_t iGoodRes = vMineResults[0].count, iBadRes = 0;
+	for(size_t i = 1; i < vMineResults.size(); i++)
+		iBadRes += vMineResults[i].count;
+
+	metric_header(out, "xmrstak_shares_total", "counter", "Results by the reply of the pool, rejected includes invalid results of the devices.");
+	metric_value(out, "xmrstak_shares_total", "result=\"accepted\"", (double)iGoodRes);
+	metric_value(out, "xmrstak_shares_total", "result=\"rejected\"", (double)iBadRes);
+
+	jpsock* pool = pick_pool_by_id(current_pool_id);
+	bool bConnected = pool != nullptr && pool->is_running() && pool->is_logged_in();
+	std::string poolLabel("pool=\"");
+	if(pool != nullptr)
+		metric_label_escape(poolLabel, pool->get_pool_addr());
+	poolLabel.append(1, '"');
+
+	metric_header(out, "xmrstak_pool_connected", "gauge", "1 if the miner is logged in to the pool.");
+	metric_value(out, "xmrstak_pool_connected", poolLabel, bConnected ? 1.0 : 0.0);
+
+	double dConnSec;
+	{
+		using namespace std::chrono;
+		dConnSec = bConnected ? (double)duration_cast<seconds>(system_clock::now() - tPoolConnTime).count() : 0.0;
+	}
+	metric_header(out, "xmrstak_pool_uptime_seconds", "gauge", "Time since the connection to the pool was established.");
+	metric_value(out, "xmrstak_pool_uptime_seconds", "", dConnSec);
+
+	metric_header(out, "xmrstak_pool_difficulty", "gauge", "Difficulty of the current job.");
+	metric_value(out, "xmrstak_pool_difficulty", "", (double)iPoolDiff);
+
+	metric_header(out, "xmrstak_pool_hashes_total", "counter", "Hashes credited by the pool since the connection was established.");
+	metric_value(out, "xmrstak_pool_hashes_total", "", (double)iPoolHashes);
+
+	metric_header(out, "xmrstak_network_errors_total", "counter", "Network errors of the pool connections.");
+	metric_value(out, "xmrstak_network_errors_total", "", (double)vSocketLog.size());
+
+	metric_header(out, "xmrstak_submit_seconds", "summary", "Round trip time of the share submits.");
+	metric_summary(out, "xmrstak_submit_seconds", "", oSubmitTime);
+
+	metric_header(out, "xmrstak_share_interval_seconds", "summary", "Time between two accepted shares.");
+	metric_summary(out, "xmrstak_share_interval_seconds", "", oShareInterval);
+}
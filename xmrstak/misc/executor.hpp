@@ -9,7 +9,10 @@
 
 #include <atomic>
 #include <array>
+#include <condition_variable>
 #include <list>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <future>
 #include <chrono>
@@ -26,18 +29,38 @@ public:
 	void ex_start(bool daemon) { daemon ? ex_main() : std::thread(&Executor::ex_main, this).detach(); }
 
 
-	inline void push_event(ex_event&& ev) { oEventQ.push(std::move(ev)); }
+	// a new job is processed before all other waiting events
+	inline void push_event(ex_event&& ev) { oEventQ.push(std::move(ev), ev.iName == EV_POOL_HAVE_JOB); }
 	void push_timed_event(ex_event&& ev, size_t sec);
 
+	/** create a report for the http server, blocks until the executor thread has written the report
+	 *
+	 * @param ev_id one of EV_HTTP_HASHRATE, EV_HTTP_RESULTS, EV_HTTP_CONNSTAT, EV_HTTP_JSON, EV_HTTP_METRICS
+	 */
+	void get_http_report(ex_event_name ev_id, std::string& data);
+
 private:
 	struct timed_event
 	{
+		std::chrono::steady_clock::time_point deadline;
+		// keeps the order of events with the same deadline
+		uint64_t seq;
+		// zero for a single event, else the event is repeated (only events without arguments)
+		std::chrono::milliseconds period;
 		ex_event event;
-		size_t ticks_left;
 
-		timed_event(ex_event&& ev, size_t ticks) : event(std::move(ev)), ticks_left(ticks) {}
+		timed_event(ex_event&& ev, std::chrono::steady_clock::time_point deadline, uint64_t seq, std::chrono::milliseconds period) :
+			deadline(deadline), seq(seq), period(period), event(std::move(ev)) {}
 	};
 
+	void push_timed_event(ex_event&& ev, std::chrono::steady_clock::time_point deadline, std::chrono::milliseconds period);
+
+	// heap order, the std heap functions create a max-heap
+	static bool timed_event_later(const std::unique_ptr<timed_event>& a, const std::unique_ptr<timed_event>& b)
+	{
+		return a->deadline != b->deadline ? a->deadline > b->deadline : a->seq > b->seq;
+	}
+
 	// In milliseconds, has to divide a second (1000ms) into an integer number
 	constexpr static size_t iTickTime = 500;
 
@@ -45,8 +68,11 @@ private:
 	// We will divide up this period according to the config setting
 	constexpr static size_t iDevDonatePeriod = 100 * 60;
 
-	std::list<timed_event> lTimedEvents;
+	// min-heap ordered by the deadline, the clock thread sleeps until the first deadline
+	std::vector<std::unique_ptr<timed_event>> vTimedEvents;
+	uint64_t iTimedEventSeq = 0;
 	std::mutex timed_event_mutex;
+	std::condition_variable timed_event_cv;
 	thdq<ex_event> oEventQ;
 
 	xmrstak::telemetry* telem;
@@ -74,6 +100,15 @@ private:
 
 	void print_report(ex_event_name ev);
 
+	void json_report(std::string& out);
+	void metrics_report(std::string& out);
+	void http_report(ex_event_name ev);
+
+	// only one http report at a time, the string is written by the executor thread
+	std::mutex httpMutex;
+	std::string* pHttpString = nullptr;
+	std::promise<void> httpReady;
+
 	struct sck_error_log
 	{
 		std::chrono::system_clock::time_point time;
@@ -125,20 +160,29 @@ private:
 
 	std::chrono::system_clock::time_point tPoolConnTime;
 	size_t iPoolHashes = 0;
+	// good results since the pool connection, the base of the average result time
+	size_t iPoolGoodRes = 0;
 	uint64_t iPoolDiff = 0;
 
-	// Set it to 16 bit so that we can just let it grow
-	// Maximum realistic growth rate - 5MB / month
-	std::vector<uint16_t> iPoolCallTimes;
+	// round trip time of the share submits and time between accepted shares in microseconds
+	xmrstak::histogram oSubmitTime;
+	xmrstak::histogram oShareInterval;
+	std::chrono::steady_clock::time_point tLastShare;
+	bool bHaveLastShare = false;
 
 	//Those stats are reset if we disconnect
 	inline void reset_stats()
 	{
-		iPoolCallTimes.clear();
+		oSubmitTime.reset();
+		oShareInterval.reset();
+		bHaveLastShare = false;
 		tPoolConnTime = std::chrono::system_clock::now();
 		iPoolHashes = 0;
+		iPoolGoodRes = 0;
 	}
 
+	void latency_report(std::string& out);
+
 	double fHighestHps = 0.0;
 
 	void log_socket_error(jpsock* pool, std::string&& sError);
@@ -149,9 +193,11 @@ private:
 	void on_sock_error(size_t pool_id, std::string&& sError, bool silent);
 	void on_pool_have_job(size_t pool_id, pool_job& oPoolJob);
 	void on_miner_result(size_t pool_id, job_result& oResult);
+	void on_submit_result(size_t pool_id, submit_rsp& oRsp);
+	void on_proxy_share(size_t pool_id, proxy_share& oShare);
+	void on_nonce_exhausted(size_t pool_id);
 	bool get_live_pools(std::vector<jpsock*>& eval_pools);
 	void eval_pool_choice();
 
-	inline size_t sec_to_ticks(size_t sec) { return sec * (1000 / iTickTime); }
 };
 
@@ -0,0 +1,159 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#include "job_trace.hpp"
+#include "xmrstak/net/msgstruct.hpp"
+
+#include <cstring>
+
+namespace xmrstak
+{
+
+namespace
+{
+const char traceMagic[4] = { 'X', 'S', 'J', 'T' };
+constexpr uint32_t iTraceVersion = 1;
+
+// the numbers are stored little endian independent of the machine
+void put_uint(std::string& out, uint64_t v, size_t bytes)
+{
+	for(size_t i = 0; i < bytes; i++)
+		out.append(1, (char)((v >> (8 * i)) & 0xFF));
+}
+
+bool get_uint(FILE* f, uint64_t& v, size_t bytes)
+{
+	uint8_t buf[8];
+	if(fread(buf, 1, bytes, f) != bytes)
+		return false;
+	v = 0;
+	for(size_t i = 0; i < bytes; i++)
+		v |= (uint64_t)buf[i] << (8 * i);
+	return true;
+}
+} // namespace
+
+bool job_trace::start(const std::string& file, const std::string& currency)
+{
+	std::lock_guard<std::mutex> lck(mtx);
+	fTrace = fopen(file.c_str(), "wb");
+	if(fTrace == nullptr)
+		return false;
+
+	std::string header(traceMagic, sizeof(traceMagic));
+	put_uint(header, iTraceVersion, 4);
+	put_uint(header, currency.size() & 0xFF, 1);
+	header.append(currency, 0, currency.size() & 0xFF);
+
+	tStart = std::chrono::steady_clock::now();
+	return fwrite(header.data(), 1, header.size(), fTrace) == header.size() && fflush(fTrace) == 0;
+}
+
+void job_trace::record(const pool_job& oPoolJob, bool bNiceHash)
+{
+	std::lock_guard<std::mutex> lck(mtx);
+	if(fTrace == nullptr)
+		return;
+
+	using namespace std::chrono;
+	uint64_t iTimeUs = duration_cast<microseconds>(steady_clock::now() - tStart).count();
+	size_t iJobIdLen = strnlen(oPoolJob.sJobID, sizeof(pool_job::sJobID));
+
+	std::string rec;
+	rec.reserve(32 + iJobIdLen + oPoolJob.iWorkLen);
+	put_uint(rec, iTimeUs, 8);
+	put_uint(rec, oPoolJob.iTarget, 8);
+	put_uint(rec, oPoolJob.iWorkLen, 1);
+	put_uint(rec, oPoolJob.iNoncePrefixBits, 1);
+	put_uint(rec, bNiceHash ? 1 : 0, 1);
+	put_uint(rec, iJobIdLen, 1);
+	rec.append(oPoolJob.sJobID, iJobIdLen);
+	rec.append((const char*)oPoolJob.bWorkBlob, oPoolJob.iWorkLen);
+
+	// jobs are rare, each record is flushed to keep the trace usable if the miner is killed
+	fwrite(rec.data(), 1, rec.size(), fTrace);
+	fflush(fTrace);
+}
+
+job_trace_reader::~job_trace_reader()
+{
+	if(fTrace != nullptr)
+		fclose(fTrace);
+}
+
+bool job_trace_reader::open(const std::string& file, std::string& sError)
+{
+	fTrace = fopen(file.c_str(), "rb");
+	if(fTrace == nullptr)
+	{
+		sError = "can't open the file";
+		return false;
+	}
+
+	char magic[sizeof(traceMagic)];
+	uint64_t iVersion, iLen;
+	if(fread(magic, 1, sizeof(magic), fTrace) != sizeof(magic) || memcmp(magic, traceMagic, sizeof(magic)) != 0 ||
+		!get_uint(fTrace, iVersion, 4))
+	{
+		sError = "not a job trace";
+		return false;
+	}
+
+	if(iVersion != iTraceVersion)
+	{
+		sError = "unsupported trace version " + std::to_string(iVersion);
+		return false;
+	}
+
+	char currency[256];
+	if(!get_uint(fTrace, iLen, 1) || fread(currency, 1, iLen, fTrace) != iLen)
+	{
+		sError = "truncated header";
+		return false;
+	}
+	sCurrency.assign(currency, iLen);
+	return true;
+}
+
+bool job_trace_reader::next(trace_job& job)
+{
+	uint64_t iWorkLen, iPrefixBits, iFlags, iJobIdLen;
+	if(!get_uint(fTrace, job.iTimeUs, 8) || !get_uint(fTrace, job.iTarget, 8) || !get_uint(fTrace, iWorkLen, 1) ||
+		!get_uint(fTrace, iPrefixBits, 1) || !get_uint(fTrace, iFlags, 1) || !get_uint(fTrace, iJobIdLen, 1))
+		return false;
+
+	// a target of 0 is never sent by a pool, the difficulty of the job would be undefined
+	if(job.iTarget == 0 || iWorkLen > sizeof(trace_job::bWorkBlob) || iJobIdLen >= sizeof(trace_job::sJobID))
+		return false;
+
+	memset(job.sJobID, 0, sizeof(job.sJobID));
+	if(fread(job.sJobID, 1, iJobIdLen, fTrace) != iJobIdLen || fread(job.bWorkBlob, 1, iWorkLen, fTrace) != iWorkLen)
+		return false;
+
+	job.iWorkLen = (uint32_t)iWorkLen;
+	job.iNoncePrefixBits = (uint8_t)iPrefixBits;
+	job.bNiceHash = (iFlags & 1) != 0;
+	return true;
+}
+
+} // namespace xmrstak
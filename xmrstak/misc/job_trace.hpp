@@ -0,0 +1,83 @@
+#pragma once
+
+#include "xmrstak/misc/Environment.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+struct pool_job;
+
+namespace xmrstak
+{
+
+/** job of a trace file
+ *
+ * File layout (little endian): the magic "XSJT", uint32 version, uint8 length and name of the
+ * mined currency, followed by the records. A record is uint64 arrival time in microseconds since
+ * the start of the recording, uint64 target, uint8 blob length, uint8 nonce prefix bits, uint8 flags
+ * (bit 0: nicehash), uint8 job id length, the job id and the blob. The block version (first byte
+ * of the blob) selects the algorithm of the currency.
+ */
+struct trace_job
+{
+	uint64_t iTimeUs = 0;
+	uint64_t iTarget = 0;
+	char sJobID[64] = {};
+	uint8_t bWorkBlob[112];
+	uint32_t iWorkLen = 0;
+	uint8_t iNoncePrefixBits = 0;
+	bool bNiceHash = false;
+};
+
+/** records the jobs received from the pools, enabled with `--trace-record FILE` */
+class job_trace
+{
+public:
+	static job_trace* inst()
+	{
+		auto& env = Environment::inst();
+		if(env.pJobTrace == nullptr)
+			env.pJobTrace = new job_trace;
+		return env.pJobTrace;
+	};
+
+	/** create the trace file, all following jobs are written to it */
+	bool start(const std::string& file, const std::string& currency);
+
+	/** append a job, nothing if the recording is not started */
+	void record(const pool_job& oPoolJob, bool bNiceHash);
+
+private:
+	job_trace() = default;
+
+	std::mutex mtx;
+	FILE* fTrace = nullptr;
+	std::chrono::steady_clock::time_point tStart;
+};
+
+/** sequential reader of a trace file */
+class job_trace_reader
+{
+public:
+	~job_trace_reader();
+
+	/** open the file and read the header
+	 *
+	 * @return false and the reason in sError if the file is not a valid trace
+	 */
+	bool open(const std::string& file, std::string& sError);
+
+	/** @return false at the end of the trace or if the record is truncated or invalid */
+	bool next(trace_job& job);
+
+	const std::string& get_currency() const { return sCurrency; }
+
+private:
+	FILE* fTrace = nullptr;
+	std::string sCurrency;
+};
+
+} // namespace xmrstak
@@ -24,73 +24,67 @@
 #include "telemetry.hpp"
 #include "xmrstak/net/msgstruct.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <cstring>
 #include <chrono>
+#include <memory>
+#include <new>
 
 namespace xmrstak
 {
 
-telemetry::telemetry(size_t iThd)
+telemetry::telemetry(size_t iThd) : iThdCount(iThd)
 {
-	ppHashCounts = new uint64_t*[iThd];
-	ppTimestamps = new uint64_t*[iThd];
-	iBucketTop = new uint32_t[iThd];
+	// new does not respect the alignment of thd_data before C++17
+	size_t iSpace = sizeof(thd_data) * iThd + iCacheLine;
+	pThdMem = ::operator new(iSpace);
+	void* pAligned = pThdMem;
+	pThdData = static_cast<thd_data*>(std::align(iCacheLine, sizeof(thd_data) * iThd, pAligned, iSpace));
 
 	for (size_t i = 0; i < iThd; i++)
 	{
-		ppHashCounts[i] = new uint64_t[iBucketSize];
-		ppTimestamps[i] = new uint64_t[iBucketSize];
-		iBucketTop[i] = 0;
-		memset(ppHashCounts[i], 0, sizeof(uint64_t) * iBucketSize);
-		memset(ppTimestamps[i], 0, sizeof(uint64_t) * iBucketSize);
+		thd_data* d = new (pThdData + i) thd_data;
+		d->iFirstStamp = 0;
+		d->iLastSecond = 0;
+		memset(&d->oLatest, 0, sizeof(sample));
+		d->pSlots = new sample[iSlotCount];
+		memset(d->pSlots, 0, sizeof(sample) * iSlotCount);
 	}
 }
 
+telemetry::~telemetry()
+{
+	for (size_t i = 0; i < iThdCount; i++)
+		delete[] pThdData[i].pSlots;
+	::operator delete(pThdMem);
+}
+
 double telemetry::calc_telemetry_data(size_t iLastMillisec, size_t iThread)
 {
+	const thd_data& d = pThdData[iThread];
 	uint64_t iTimeNow = get_timestamp_ms();
 
-	uint64_t iEarliestHashCnt = 0;
-	uint64_t iEarliestStamp = 0;
-	uint64_t iLatestStamp = 0;
-	uint64_t iLatestHashCnt = 0;
-	bool bHaveFullSet = false;
-
-	//Start at 1, buckettop points to next empty
-	for (size_t i = 1; i < iBucketSize; i++)
-	{
-		size_t idx = (iBucketTop[iThread] - i) & iBucketMask; //overflow expected here
-
-		if (ppTimestamps[iThread][idx] == 0)
-			break; //That means we don't have the data yet
-
-		if (iLatestStamp == 0)
-		{
-			iLatestStamp = ppTimestamps[iThread][idx];
-			iLatestHashCnt = ppHashCounts[iThread][idx];
-		}
-
-		if (iTimeNow - ppTimestamps[iThread][idx] > iLastMillisec)
-		{
-			bHaveFullSet = true;
-			break; //We are out of the requested time period
-		}
+	//We need a sample older than the requested time period
+	if (d.iFirstStamp == 0 || iTimeNow - d.iFirstStamp <= iLastMillisec)
+		return nan("");
 
-		iEarliestStamp = ppTimestamps[iThread][idx];
-		iEarliestHashCnt = ppHashCounts[iThread][idx];
-	}
+	//First slot which starts inside of the time period
+	uint64_t iSecond = (iTimeNow - iLastMillisec + 999) / 1000;
+	if (iSecond > d.iLastSecond || d.iLastSecond - iSecond >= iSlotCount)
+		return nan("");
 
-	if (!bHaveFullSet || iEarliestStamp == 0 || iLatestStamp == 0)
+	const sample& oEarliest = d.pSlots[iSecond & iSlotMask];
+	if (oEarliest.iSecond != iSecond)
 		return nan("");
 
 	//Don't think that can happen, but just in case
-	if (iLatestStamp - iEarliestStamp == 0)
+	if (d.oLatest.iTimestamp - oEarliest.iTimestamp == 0)
 		return nan("");
 
 	double fHashes, fTime;
-	fHashes = static_cast<double>(iLatestHashCnt - iEarliestHashCnt);
-	fTime = static_cast<double>(iLatestStamp - iEarliestStamp);
+	fHashes = static_cast<double>(d.oLatest.iHashCount - oEarliest.iHashCount);
+	fTime = static_cast<double>(d.oLatest.iTimestamp - oEarliest.iTimestamp);
 	fTime /= 1000.0;
 
 	return fHashes / fTime;
@@ -98,11 +92,96 @@ double telemetry::calc_telemetry_data(size_t iLastMillisec, size_t iThread)
 
 void telemetry::push_perf_value(size_t iThd, uint64_t iHashCount, uint64_t iTimestamp)
 {
-	size_t iTop = iBucketTop[iThd];
-	ppHashCounts[iThd][iTop] = iHashCount;
-	ppTimestamps[iThd][iTop] = iTimestamp;
+	//A thread without a finished round has no timestamp
+	if (iTimestamp == 0)
+		return;
 
-	iBucketTop[iThd] = (iTop + 1) & iBucketMask;
+	thd_data& d = pThdData[iThd];
+	uint64_t iSecond = iTimestamp / 1000;
+	sample oSample = { iSecond, iHashCount, iTimestamp };
+
+	if (d.iFirstStamp == 0)
+	{
+		d.iFirstStamp = iTimestamp;
+		d.iLastSecond = iSecond - 1;
+	}
+
+	/* The sample is the first one at or after the start of every second since the last sample.
+	 * Older slots of a long gap are overwritten anyway, at most iSlotCount slots are written.
+	 */
+	if (iSecond > d.iLastSecond)
+	{
+		uint64_t iFrom = iSecond - d.iLastSecond > iSlotCount ? iSecond - iSlotCount + 1 : d.iLastSecond + 1;
+		for (uint64_t s = iFrom; s <= iSecond; s++)
+		{
+			oSample.iSecond = s;
+			d.pSlots[s & iSlotMask] = oSample;
+		}
+		d.iLastSecond = iSecond;
+	}
+
+	d.oLatest = oSample;
+}
+
+histogram::histogram()
+{
+	// the largest values must stay inside of iBuckets
+	static_assert(bucket_index(iSubCount - 1) == iSubCount - 1, "first bucket");
+	static_assert(bucket_index(iSubCount) == iSubCount, "first exponent bucket");
+	static_assert(bucket_index((uint64_t(1) << iMaxBits) - 1) == iBucketCount - 1, "largest value of the range");
+	static_assert(bucket_index(uint64_t(1) << iMaxBits) == iBucketCount - 1, "first value above the range");
+	static_assert(bucket_index(UINT64_MAX) == iBucketCount - 1, "largest value");
+	reset();
+}
+
+void histogram::reset()
+{
+	for (size_t i = 0; i < iBucketCount; i++)
+		iBuckets[i].store(0, std::memory_order_relaxed);
+	iCount.store(0, std::memory_order_relaxed);
+	iSum.store(0, std::memory_order_relaxed);
+	iMax.store(0, std::memory_order_relaxed);
+}
+
+uint64_t histogram::bucket_limit(size_t iBucket)
+{
+	if (iBucket < iSubCount)
+		return iBucket;
+
+	size_t iExp = iBucket / iSubCount + iSubBits - 1;
+	uint64_t iSub = iBucket % iSubCount;
+	return ((iSubCount + iSub + 1) << (iExp - iSubBits)) - 1;
+}
+
+void histogram::record(uint64_t iValue)
+{
+	iBuckets[bucket_index(iValue)].fetch_add(1, std::memory_order_relaxed);
+	iCount.fetch_add(1, std::memory_order_relaxed);
+	iSum.fetch_add(iValue, std::memory_order_relaxed);
+
+	uint64_t iOld = iMax.load(std::memory_order_relaxed);
+	while (iValue > iOld && !iMax.compare_exchange_weak(iOld, iValue, std::memory_order_relaxed))
+		;
+}
+
+uint64_t histogram::quantile(double fQuantile) const
+{
+	uint64_t iTotal = count();
+	if (iTotal == 0)
+		return 0;
+
+	uint64_t iRank = static_cast<uint64_t>(std::ceil(fQuantile * iTotal));
+	if (iRank == 0)
+		iRank = 1;
+
+	uint64_t iSeen = 0;
+	for (size_t i = 0; i < iBucketCount; i++)
+	{
+		iSeen += iBuckets[i].load(std::memory_order_relaxed);
+		if (iSeen >= iRank)
+			return i == iBucketCount - 1 ? max() : std::min(bucket_limit(i), max());
+	}
+	return max();
 }
 
 } // namespace xmrstak
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <cstring>
 
@@ -10,15 +11,89 @@ class telemetry
 {
 public:
 	telemetry(size_t iThd);
+	~telemetry();
 	void push_perf_value(size_t iThd, uint64_t iHashCount, uint64_t iTimestamp);
 	double calc_telemetry_data(size_t iLastMillisec, size_t iThread);
 
 private:
-	constexpr static size_t iBucketSize = 2 << 11; //Power of 2 to simplify calculations
-	constexpr static size_t iBucketMask = iBucketSize - 1;
-	uint32_t* iBucketTop;
-	uint64_t** ppHashCounts;
-	uint64_t** ppTimestamps;
+	/* Each slot holds the first sample at or after the start of a second, a slot is written once.
+	 * The rate of a window needs only the slot of the window start and the latest sample.
+	 */
+	constexpr static size_t iSlotCount = 1 << 10; //Seconds, more than the longest window (15 min)
+	constexpr static size_t iSlotMask = iSlotCount - 1;
+	constexpr static size_t iCacheLine = 64;
+
+	struct sample
+	{
+		uint64_t iSecond;
+		uint64_t iHashCount;
+		uint64_t iTimestamp;
+	};
+
+	// one cache line per thread
+	struct alignas(iCacheLine) thd_data
+	{
+		uint64_t iFirstStamp;
+		uint64_t iLastSecond;
+		sample oLatest;
+		sample* pSlots;
+	};
+
+	thd_data* pThdData;
+	void* pThdMem;
+	size_t iThdCount;
+};
+
+/** streaming histogram with logarithmic buckets and a fixed memory size
+ *
+ * Values are stored with 4 bit precision (error below 6.25 %) up to 2^40, larger values
+ * are counted in the last bucket. record() is lock free and can be called by several threads.
+ */
+class histogram
+{
+public:
+	histogram();
+	void record(uint64_t iValue);
+	void reset();
+
+	/** value below which the fraction fQuantile (0.0 - 1.0) of the recorded values lies, 0 if empty */
+	uint64_t quantile(double fQuantile) const;
+	uint64_t max() const { return iMax.load(std::memory_order_relaxed); }
+	uint64_t count() const { return iCount.load(std::memory_order_relaxed); }
+	uint64_t sum() const { return iSum.load(std::memory_order_relaxed); }
+
+private:
+	constexpr static size_t iSubBits = 4;
+	constexpr static size_t iSubCount = 1 << iSubBits;
+	constexpr static size_t iMaxBits = 40;
+	constexpr static size_t iBucketCount = (iMaxBits - iSubBits + 1) * iSubCount;
+
+	/** exponent of the highest set bit of iValue (at least iExp), values of 2^iMaxBits and above
+	 * get iMaxBits - 1 and are counted in the last bucket
+	 */
+	constexpr static size_t bucket_exp(uint64_t iValue, size_t iExp)
+	{
+		return iExp < iMaxBits - 1 && (iValue >> (iExp + 1)) != 0 ? bucket_exp(iValue, iExp + 1) : iExp;
+	}
+
+	constexpr static size_t bucket_index(uint64_t iValue, size_t iExp)
+	{
+		// the highest bit is implied by the exponent, the next iSubBits bits select the sub bucket
+		return (iValue >> (iExp + 1)) != 0 ? iBucketCount - 1 :
+			(iExp - iSubBits + 1) * iSubCount + ((iValue >> (iExp - iSubBits)) & (iSubCount - 1));
+	}
+
+	constexpr static size_t bucket_index(uint64_t iValue)
+	{
+		return iValue < iSubCount ? size_t(iValue) : bucket_index(iValue, bucket_exp(iValue, iSubBits));
+	}
+
+	static uint64_t bucket_limit(size_t iBucket);
+
+	std::atomic<uint64_t> iBuckets[iBucketCount];
+	std::atomic<uint64_t> iCount;
+	std::atomic<uint64_t> iSum;
+	std::atomic<uint64_t> iMax;
 };
 
 } // namespace xmrstak
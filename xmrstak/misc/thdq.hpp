@@ -1,49 +1,183 @@
-#pragma once
-
-#include <queue>
-#include <thread>
-#include <mutex>
-#include <condition_variable>
-
-template <typename T>
-class thdq
-{
-public:
-	T pop()
-	{
-		std::unique_lock<std::mutex> mlock(mutex_);
-		while (queue_.empty()) { cond_.wait(mlock); }
-		auto item = std::move(queue_.front());
-		queue_.pop();
-		return item;
-	}
-
-	void pop(T& item)
-	{
-		std::unique_lock<std::mutex> mlock(mutex_);
-		while (queue_.empty()) { cond_.wait(mlock); }
-		item = queue_.front();
-		queue_.pop();
-	}
-
-	void push(const T& item)
-	{
-		std::unique_lock<std::mutex> mlock(mutex_);
-		queue_.push(item);
-		mlock.unlock();
-		cond_.notify_one();
-	}
-
-	void push(T&& item)
-	{
-		std::unique_lock<std::mutex> mlock(mutex_);
-		queue_.push(std::move(item));
-		mlock.unlock();
-		cond_.notify_one();
-	}
-
-private:
-	std::queue<T> queue_;
-	std::mutex mutex_;
-	std::condition_variable cond_;
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/** bounded lock-free ring for many producers and one consumer
+ *
+ * The slots are allocated once, a push moves the item into a free slot.
+ * Each slot carries a sequence number which tells if it is free or filled
+ * for the current round of the ring (Dmitry Vyukov's bounded queue).
+ */
+template <typename T, size_t N>
+class mpsc_ring
+{
+	static_assert((N & (N - 1)) == 0, "the ring size must be a power of 2");
+
+public:
+	mpsc_ring() : cells_(new cell[N]), enqueue_pos_(0), dequeue_pos_(0)
+	{
+		for (size_t i = 0; i < N; i++)
+			cells_[i].seq.store(i, std::memory_order_relaxed);
+	}
+
+	/** @return false if the ring is full */
+	bool try_push(T&& item)
+	{
+		size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+		cell* c;
+		while (true)
+		{
+			c = &cells_[pos & (N - 1)];
+			size_t seq = c->seq.load(std::memory_order_acquire);
+			intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+			if (dif == 0)
+			{
+				if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (dif < 0)
+				return false;
+			else
+				pos = enqueue_pos_.load(std::memory_order_relaxed);
+		}
+
+		c->item = std::move(item);
+		c->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** only called by the consumer thread
+	 *
+	 * @return false if the ring is empty
+	 */
+	bool try_pop(T& item)
+	{
+		cell& c = cells_[dequeue_pos_ & (N - 1)];
+		if (c.seq.load(std::memory_order_acquire) != dequeue_pos_ + 1)
+			return false;
+
+		item = std::move(c.item);
+		// the slot is free for the next round of the ring
+		c.seq.store(dequeue_pos_ + N, std::memory_order_release);
+		dequeue_pos_++;
+		return true;
+	}
+
+private:
+	struct cell
+	{
+		std::atomic<size_t> seq;
+		T item;
+	};
+
+	std::unique_ptr<cell[]> cells_;
+	std::atomic<size_t> enqueue_pos_;
+	size_t dequeue_pos_;
+};
+
+/** event queue of the executor, many producers and one consumer
+ *
+ * Items of the priority lane are popped before all other items, e.g. a new job
+ * never waits behind a burst of results. Both lanes are lock free, the mutex is
+ * only taken to wake up the sleeping consumer and if a lane is full.
+ */
+template <typename T>
+class thdq
+{
+public:
+	thdq() : waiting_(false), spilled_prio_(false), spilled_(false) {}
+
+	T pop()
+	{
+		T item;
+		while (!try_pop(item))
+		{
+			waiting_.store(true);
+			// a producer pushes first and checks waiting_ afterwards, recheck after announcing the wait
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (try_pop(item))
+			{
+				waiting_.store(false);
+				break;
+			}
+			std::unique_lock<std::mutex> mlock(mutex_);
+			cond_.wait(mlock, [this]() { return !waiting_.load(); });
+		}
+		return item;
+	}
+
+	void push(T&& item, bool priority = false)
+	{
+		if (priority)
+			push_lane(prio_, spill_prio_, spilled_prio_, std::move(item));
+		else
+			push_lane(normal_, spill_, spilled_, std::move(item));
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (waiting_.load())
+		{
+			std::unique_lock<std::mutex> mlock(mutex_);
+			waiting_.store(false);
+			mlock.unlock();
+			cond_.notify_one();
+		}
+	}
+
+private:
+	template <size_t N>
+	void push_lane(mpsc_ring<T, N>& ring, std::deque<T>& spill, std::atomic<bool>& spilled, T&& item)
+	{
+		/* If the lane is full (the consumer is behind or blocked by a push of its own) the item is spilled.
+		 * A producer never passes its own spilled items, the ring is only used again after the spill was drained.
+		 */
+		if (!spilled.load() && ring.try_push(std::move(item)))
+			return;
+
+		std::unique_lock<std::mutex> mlock(mutex_);
+		spill.push_back(std::move(item));
+		spilled.store(true);
+	}
+
+	bool try_pop(T& item)
+	{
+		if (prio_.try_pop(item))
+			return true;
+		if (spilled_prio_.load() && pop_spill(spill_prio_, spilled_prio_, item))
+			return true;
+		if (normal_.try_pop(item))
+			return true;
+		return spilled_.load() && pop_spill(spill_, spilled_, item);
+	}
+
+	bool pop_spill(std::deque<T>& spill, std::atomic<bool>& spilled, T& item)
+	{
+		std::unique_lock<std::mutex> mlock(mutex_);
+		if (spill.empty())
+			return false;
+		item = std::move(spill.front());
+		spill.pop_front();
+		if (spill.empty())
+			spilled.store(false);
+		return true;
+	}
+
+	mpsc_ring<T, 64> prio_;
+	mpsc_ring<T, 1024> normal_;
+
+	// used only if a lane is full
+	std::deque<T> spill_prio_;
+	std::deque<T> spill_;
+
+	std::atomic<bool> waiting_;
+	std::atomic<bool> spilled_prio_;
+	std::atomic<bool> spilled_;
+	std::mutex mutex_;
+	std::condition_variable cond_;
 };
@@ -1,5 +1,6 @@
 #include <string>
 #include <algorithm>
+#include <cstdio>
 
 
 namespace xmrstak
@@ -18,4 +19,25 @@ namespace xmrstak
 					}
 				);
 	}
+
+	void json_escape(std::string& out, const std::string& str)
+	{
+		out.append(1, '"');
+		for(char c : str)
+		{
+			if(c == '"' || c == '\\')
+				out.append(1, '\\').append(1, c);
+			else if(c == '\n')
+				out.append("\\n");
+			else if((unsigned char)c < 0x20)
+			{
+				char esc[8];
+				snprintf(esc, sizeof(esc), "\\u%04x", (unsigned int)c);
+				out.append(esc);
+			}
+			else
+				out.append(1, c);
+		}
+		out.append(1, '"');
+	}
 } // namespace xmrstak
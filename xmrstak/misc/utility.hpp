@@ -9,4 +9,7 @@ namespace xmrstak
 	 * @return true if both strings are equal, else false
 	 */
 	bool strcmp_i(const std::string& str1, const std::string& str2);
+
+	/** append str as quoted JSON string to out */
+	void json_escape(std::string& out, const std::string& str);
 } // namespace xmrstak
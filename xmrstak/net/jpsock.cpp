@@ -33,6 +33,7 @@
 #include "xmrstak/misc/executor.hpp"
 #include "xmrstak/jconf.hpp"
 #include "xmrstak/misc/jext.hpp"
+#include "xmrstak/misc/job_trace.hpp"
 #include "xmrstak/version.hpp"
 
 using namespace rapidjson;
@@ -221,6 +222,16 @@ void jpsock::jpsock_thread()
 	if(bCallWaiting)
 		call_cond.notify_one();
 
+	// the pool will never answer the asynchronous calls
+	std::unique_lock<std::mutex> plock(pending_mutex);
+	for(const auto& it : pending_calls)
+	{
+		if(!it.second.bGetJob)
+			Executor::inst()->push_event(ex_event(submit_rsp(std::string(), it.second.iActualDiff, 0, true, it.second.iProxyTag), pool_id));
+	}
+	pending_calls.clear();
+	plock.unlock();
+
 	bLoggedIn = false;
 
 	if(bHaveSocketError && !quiet_close)
@@ -355,6 +366,24 @@ bool jpsock::process_line(char* line, size_t len)
 			sError = msg->GetString();
 		}
 
+		if(iCallId >= iFirstAsyncCallId)
+		{
+			std::unique_lock<std::mutex> plock(pending_mutex);
+			auto it = pending_calls.find(iCallId);
+			if(it == pending_calls.end())
+			{
+				plock.unlock();
+				return set_socket_error("PARSE error: Unexpected call response");
+			}
+
+			pending_call call = it->second;
+			pending_calls.erase(it);
+			plock.unlock();
+
+			opq_json_val v(mt);
+			return process_async_reply(call, &v, sError, iErrorLen);
+		}
+
 		std::unique_lock<std::mutex> mlock(call_mutex);
 		if (prv->oCallRsp.pCallData == nullptr)
 		{
@@ -477,7 +506,17 @@ bool jpsock::process_pool_job(const opq_json_val* params, const uint64_t message
 	else
 		return set_socket_error("PARSE error: Job error 5");
 
+	// the pool fixed the high bits of the nonce in the blob, e.g. a proxy which splits the nonce space between its miners
+	const Value* prefix_bits = GetObjectMember(*params->val, "nonce_prefix_bits");
+	if(prefix_bits != nullptr)
+	{
+		if(!prefix_bits->IsUint() || prefix_bits->GetUint() > 24)
+			return set_socket_error("PARSE error: Invalid nonce prefix");
+		oPoolJob.iNoncePrefixBits = prefix_bits->GetUint();
+	}
+
 	iJobDiff = t64_to_diff(oPoolJob.iTarget);
+	xmrstak::job_trace::inst()->record(oPoolJob, nicehash);
 
 	std::unique_lock<std::mutex> lck(job_mutex);
 	oCurrentJob = oPoolJob;
@@ -652,7 +691,7 @@ bool jpsock::cmd_login()
 	return true;
 }
 
-bool jpsock::cmd_submit(const char* sJobId, uint32_t iNonce, const uint8_t* bResult, const char* backend_name, uint64_t backend_hashcount, uint64_t total_hashcount, xmrstak_algo algo)
+bool jpsock::cmd_submit(const char* sJobId, uint32_t iNonce, const uint8_t* bResult, const char* backend_name, uint64_t backend_hashcount, uint64_t total_hashcount, xmrstak_algo algo, uint64_t iProxyTag)
 {
 	char cmd_buffer[1024];
 	char sNonce[9];
@@ -714,15 +753,94 @@ bool jpsock::cmd_submit(const char* sJobId, uint32_t iNonce, const uint8_t* bRes
 	bin2hex(bResult, 32, sResult);
 	sResult[64] = '\0';
 
-	snprintf(cmd_buffer, sizeof(cmd_buffer), "{\"method\":\"submit\",\"params\":{\"id\":\"%s\",\"job_id\":\"%s\",\"nonce\":\"%s\",\"result\":\"%s\"%s%s%s},\"id\":1}\n",
-		sMinerId, sJobId, sNonce, sResult, sBackend, sHashcount, sAlgo);
+	uint64_t iCallId = iNextCallId++;
+	snprintf(cmd_buffer, sizeof(cmd_buffer), "{\"method\":\"submit\",\"params\":{\"id\":\"%s\",\"job_id\":\"%s\",\"nonce\":\"%s\",\"result\":\"%s\"%s%s%s},\"id\":%llu}\n",
+		sMinerId, sJobId, sNonce, sResult, sBackend, sHashcount, sAlgo, int_port(iCallId));
 
-	uint64_t messageId = 0;
-	opq_json_val oResult(nullptr);
-	return cmd_ret_wait(cmd_buffer, oResult, messageId);
+	pending_call call;
+	call.bGetJob = false;
+	call.iActualDiff = t64_to_diff(((const uint64_t*)bResult)[3]);
+	call.iProxyTag = iProxyTag;
+	return cmd_async(cmd_buffer, iCallId, call);
+}
+
+bool jpsock::cmd_getjob()
+{
+	char cmd_buffer[256];
+
+	uint64_t iCallId = iNextCallId++;
+	snprintf(cmd_buffer, sizeof(cmd_buffer), "{\"method\":\"getjob\",\"params\":{\"id\":\"%s\"},\"id\":%llu}\n",
+		sMinerId, int_port(iCallId));
+
+	pending_call call;
+	call.bGetJob = true;
+	call.iActualDiff = 0;
+	call.iProxyTag = 0;
+	return cmd_async(cmd_buffer, iCallId, call);
+}
+
+bool jpsock::cmd_async(const char* sPacket, uint64_t iCallId, const pending_call& call)
+{
+	//printf("SEND: %s\n", sPacket);
+
+	// the reply can arrive before send() returns
+	std::unique_lock<std::mutex> plock(pending_mutex);
+	pending_calls[iCallId] = call;
+	pending_calls[iCallId].tSent = std::chrono::steady_clock::now();
+	plock.unlock();
+
+	if(!sck->send(sPacket))
+	{
+		plock.lock();
+		pending_calls.erase(iCallId);
+		plock.unlock();
+
+		disconnect(); //This will join the other thread;
+		return false;
+	}
+
+	return true;
+}
+
+bool jpsock::process_async_reply(const pending_call& call, const opq_json_val* result, const char* sError, size_t iErrorLen)
+{
+	if(call.bGetJob)
+	{
+		if(sError != nullptr)
+		{
+			Printer::inst()->print_msg(L2, "Pool refused the job request: %.*s. Waiting for the next job.", int(iErrorLen), sError);
+			return true;
+		}
+
+		// the result is a job in the same format as the job notification
+		return process_pool_job(result, iMessageCnt);
+	}
+
+	using namespace std::chrono;
+	uint64_t iRoundTripUs = duration_cast<microseconds>(steady_clock::now() - call.tSent).count();
+
+	std::string sErr;
+	if(sError != nullptr)
+		sErr = iErrorLen != 0 ? std::string(sError, iErrorLen) : std::string("Unknown pool error");
+
+	Executor::inst()->push_event(ex_event(submit_rsp(std::move(sErr), call.iActualDiff, iRoundTripUs, false, call.iProxyTag), pool_id));
+	return true;
+}
+
+bool jpsock::have_call_timeout()
+{
+	auto tLimit = std::chrono::steady_clock::now() - std::chrono::seconds(jconf::inst()->GetCallTimeout());
+
+	std::lock_guard<std::mutex> plock(pending_mutex);
+	for(const auto& it : pending_calls)
+	{
+		if(it.second.tSent < tLimit)
+			return true;
+	}
+	return false;
 }
 
-void jpsock::save_nonce(uint32_t nonce)
+void jpsock::save_nonce(uint64_t nonce)
 {
 	std::unique_lock<std::mutex> lck(job_mutex);
 	oCurrentJob.iSavedNonce = nonce;
@@ -6,7 +6,9 @@
 
 #include <mutex>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <map>
 #include <thread>
 #include <string>
 
@@ -34,7 +36,15 @@ public:
 	void disconnect(bool quiet = false);
 
 	bool cmd_login();
-	bool cmd_submit(const char* sJobId, uint32_t iNonce, const uint8_t* bResult, const char* backend_name, uint64_t backend_hashcount, uint64_t total_hashcount, xmrstak_algo algo);
+	/* Submit and getjob are asynchronous, they return after the call is sent.
+	 * The reply of a submit arrives as EV_SUBMIT_RESULT, the job of a getjob as EV_POOL_HAVE_JOB.
+	 * @return false if the call could not be sent
+	 */
+	bool cmd_submit(const char* sJobId, uint32_t iNonce, const uint8_t* bResult, const char* backend_name, uint64_t backend_hashcount, uint64_t total_hashcount, xmrstak_algo algo, uint64_t iProxyTag = 0);
+	bool cmd_getjob();
+
+	// true if the pool did not answer an asynchronous call within the call timeout
+	bool have_call_timeout();
 
 	static bool hex2bin(const char* in, unsigned int len, unsigned char* out);
 	static void bin2hex(const unsigned char* in, unsigned int len, char* out);
@@ -70,7 +80,7 @@ public:
 
 	inline uint64_t get_current_diff() { return iJobDiff; }
 
-	void save_nonce(uint32_t nonce);
+	void save_nonce(uint64_t nonce);
 	bool get_current_job(pool_job& job);
 
 	bool set_socket_error(const char* a);
@@ -125,6 +135,24 @@ private:
 	bool process_pool_job(const opq_json_val* params, const uint64_t messageId);
 	bool cmd_ret_wait(const char* sPacket, opq_json_val& poResult, uint64_t& messageId);
 
+	// asynchronous call which waits for the reply of the pool
+	struct pending_call
+	{
+		bool bGetJob;
+		uint64_t iActualDiff;
+		// tag of a share of the stratum proxy, see submit_rsp::iProxyTag
+		uint64_t iProxyTag;
+		std::chrono::steady_clock::time_point tSent;
+	};
+	bool cmd_async(const char* sPacket, uint64_t iCallId, const pending_call& call);
+	bool process_async_reply(const pending_call& call, const opq_json_val* result, const char* sError, size_t iErrorLen);
+
+	// synchronous calls (login) use the id 1, asynchronous calls count up from 2
+	static constexpr uint64_t iFirstAsyncCallId = 2;
+	uint64_t iNextCallId = iFirstAsyncCallId;
+	std::mutex pending_mutex;
+	std::map<uint64_t, pending_call> pending_calls;
+
 	char sMinerId[64];
 	std::atomic<uint64_t> iJobDiff;
 
@@ -15,11 +15,13 @@ struct pool_job
 	uint8_t		bWorkBlob[112];
 	uint64_t	iTarget;
 	uint32_t	iWorkLen;
-	uint32_t	iSavedNonce;
+	uint64_t	iSavedNonce;
+	// high nonce bits assigned by the pool (job field "nonce_prefix_bits")
+	uint8_t		iNoncePrefixBits;
 
-	pool_job() : iWorkLen(0), iSavedNonce(0) {}
+	pool_job() : iWorkLen(0), iSavedNonce(0), iNoncePrefixBits(0) {}
 	pool_job(const char* sJobID, uint64_t iTarget, const uint8_t* bWorkBlob, uint32_t iWorkLen) :
-		iTarget(iTarget), iWorkLen(iWorkLen), iSavedNonce(0)
+		iTarget(iTarget), iWorkLen(iWorkLen), iSavedNonce(0), iNoncePrefixBits(0)
 	{
 		assert(iWorkLen <= sizeof(pool_job::bWorkBlob));
 		memcpy(this->sJobID, sJobID, sizeof(pool_job::sJobID));
@@ -44,6 +46,17 @@ struct job_result
 	}
 };
 
+// share of a miner connected to the stratum proxy
+struct proxy_share
+{
+	job_result oResult;
+	// identifies the share in the replies of the pool, see submit_rsp::iProxyTag
+	uint64_t iTag;
+
+	proxy_share() : iTag(0) {}
+	proxy_share(const job_result& oResult, uint64_t iTag) : oResult(oResult), iTag(iTag) {}
+};
+
 struct sock_err
 {
 	std::string sSocketError;
@@ -67,6 +80,38 @@ struct sock_err
 	sock_err& operator=(sock_err const&) = delete;
 };
 
+// Reply of the pool to an asynchronous share submit
+struct submit_rsp
+{
+	std::string sError; // empty if the share was accepted
+	uint64_t iActualDiff;
+	uint64_t iRoundTripUs;
+	bool bNetworkError; // the connection was closed before the pool replied
+	uint64_t iProxyTag; // 0 for an own share, else the tag of a share of the stratum proxy
+
+	submit_rsp() : iActualDiff(0), iRoundTripUs(0), bNetworkError(false), iProxyTag(0) {}
+	submit_rsp(std::string&& err, uint64_t iActualDiff, uint64_t iRoundTripUs, bool bNetworkError, uint64_t iProxyTag = 0) :
+		sError(std::move(err)), iActualDiff(iActualDiff), iRoundTripUs(iRoundTripUs), bNetworkError(bNetworkError), iProxyTag(iProxyTag) {}
+	submit_rsp(submit_rsp&& from) : sError(std::move(from.sError)), iActualDiff(from.iActualDiff),
+		iRoundTripUs(from.iRoundTripUs), bNetworkError(from.bNetworkError), iProxyTag(from.iProxyTag) {}
+
+	submit_rsp& operator=(submit_rsp&& from)
+	{
+		assert(this != &from);
+		sError = std::move(from.sError);
+		iActualDiff = from.iActualDiff;
+		iRoundTripUs = from.iRoundTripUs;
+		bNetworkError = from.bNetworkError;
+		iProxyTag = from.iProxyTag;
+		return *this;
+	}
+
+	~submit_rsp() { }
+
+	submit_rsp(submit_rsp const&) = delete;
+	submit_rsp& operator=(submit_rsp const&) = delete;
+};
+
 // Unlike socket errors, GPU errors are read-only strings
 struct gpu_res_err {
 	size_t idx; // GPU index
@@ -77,7 +122,9 @@ struct gpu_res_err {
 
 enum ex_event_name { EV_INVALID_VAL, EV_SOCK_READY, EV_SOCK_ERROR, EV_GPU_RES_ERROR,
 	EV_POOL_HAVE_JOB, EV_MINER_HAVE_RESULT, EV_PERF_TICK, EV_EVAL_POOL_CHOICE,
-	EV_USR_HASHRATE, EV_USR_RESULTS, EV_USR_CONNSTAT, EV_HASHRATE_LOOP };
+	EV_USR_HASHRATE, EV_USR_RESULTS, EV_USR_CONNSTAT, EV_HASHRATE_LOOP, EV_NONCE_EXHAUSTED,
+	EV_SUBMIT_RESULT, EV_HTTP_HASHRATE, EV_HTTP_RESULTS, EV_HTTP_CONNSTAT, EV_HTTP_JSON, EV_HTTP_METRICS,
+	EV_PROXY_SHARE };
 
 /*
    This is how I learned to stop worrying and love c++11 =).
@@ -98,6 +145,8 @@ struct ex_event {
 		job_result oJobResult;
 		sock_err oSocketError;
 		gpu_res_err oGpuError;
+		submit_rsp oSubmitRsp;
+		proxy_share oProxyShare;
 	};
 
 	ex_event() { iName = EV_INVALID_VAL; iPoolId = 0;}
@@ -105,6 +154,8 @@ struct ex_event {
 	ex_event(std::string&& err, bool silent, size_t id) : iName(EV_SOCK_ERROR), iPoolId(id), oSocketError(std::move(err), silent) { }
 	ex_event(job_result dat, size_t id) : iName(EV_MINER_HAVE_RESULT), iPoolId(id), oJobResult(dat) {}
 	ex_event(pool_job dat, size_t id) : iName(EV_POOL_HAVE_JOB), iPoolId(id), oPoolJob(dat) {}
+	ex_event(proxy_share dat, size_t id) : iName(EV_PROXY_SHARE), iPoolId(id), oProxyShare(dat) {}
+	ex_event(submit_rsp&& rsp, size_t id) : iName(EV_SUBMIT_RESULT), iPoolId(id), oSubmitRsp(std::move(rsp)) {}
 	ex_event(ex_event_name ev, size_t id = 0) : iName(ev), iPoolId(id) {}
 
 	// Delete the copy operators to make sure we are moving only what is needed
@@ -119,12 +170,18 @@ struct ex_event {
 		case EV_SOCK_ERROR:
 			new (&oSocketError) sock_err(std::move(from.oSocketError));
 			break;
+		case EV_SUBMIT_RESULT:
+			new (&oSubmitRsp) submit_rsp(std::move(from.oSubmitRsp));
+			break;
 		case EV_MINER_HAVE_RESULT:
 			oJobResult = from.oJobResult;
 			break;
 		case EV_POOL_HAVE_JOB:
 			oPoolJob = from.oPoolJob;
 			break;
+		case EV_PROXY_SHARE:
+			oProxyShare = from.oProxyShare;
+			break;
 		case EV_GPU_RES_ERROR:
 			oGpuError = from.oGpuError;
 		default:
@@ -138,6 +195,9 @@ struct ex_event {
 		if(iName == EV_SOCK_ERROR) {
 		    oSocketError.~sock_err();
 		}
+		else if(iName == EV_SUBMIT_RESULT) {
+		    oSubmitRsp.~submit_rsp();
+		}
 
 		iName = from.iName;
 		iPoolId = from.iPoolId;
@@ -147,12 +207,18 @@ struct ex_event {
 			new (&oSocketError) sock_err();
 			oSocketError = std::move(from.oSocketError);
 			break;
+		case EV_SUBMIT_RESULT:
+			new (&oSubmitRsp) submit_rsp(std::move(from.oSubmitRsp));
+			break;
 		case EV_MINER_HAVE_RESULT:
 			oJobResult = from.oJobResult;
 			break;
 		case EV_POOL_HAVE_JOB:
 			oPoolJob = from.oPoolJob;
 			break;
+		case EV_PROXY_SHARE:
+			oProxyShare = from.oProxyShare;
+			break;
 		case EV_GPU_RES_ERROR:
 			oGpuError = from.oGpuError;
 		default:
@@ -166,6 +232,8 @@ struct ex_event {
 	{
 		if(iName == EV_SOCK_ERROR)
 			oSocketError.~sock_err();
+		else if(iName == EV_SUBMIT_RESULT)
+			oSubmitRsp.~submit_rsp();
 	}
 };
 
@@ -0,0 +1,72 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#include "sock_server.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+SOCKET sock_listen(uint16_t iPort, int iBacklog, std::string& sError)
+{
+	char strerr[256];
+
+	sock_init();
+	SOCKET hListen = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if(hListen == INVALID_SOCKET)
+	{
+		sError = std::string("failed to create a socket: ") + sock_strerror(strerr, sizeof(strerr));
+		return INVALID_SOCKET;
+	}
+
+	int reuse = 1;
+	setsockopt(hListen, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(iPort);
+
+	if(bind(hListen, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(hListen, iBacklog) != 0)
+	{
+		sError = "failed to listen on port " + std::to_string(iPort) + ": " + sock_strerror(strerr, sizeof(strerr));
+		sock_close(hListen);
+		return INVALID_SOCKET;
+	}
+	return hListen;
+}
+
+SOCKET sock_accept(SOCKET hListen, sockaddr_in* addr)
+{
+	while(true)
+	{
+		socklen_t addrLen = sizeof(sockaddr_in);
+		SOCKET sock = accept(hListen, (sockaddr*)addr, addr != nullptr ? &addrLen : nullptr);
+		if(sock != INVALID_SOCKET)
+			return sock;
+
+		// e.g. the client closed the connection before it was accepted
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+}
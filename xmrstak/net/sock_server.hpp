@@ -0,0 +1,19 @@
+#pragma once
+
+#include "socks.hpp"
+
+#include <cstdint>
+#include <string>
+
+/** open a TCP socket which listens on all interfaces
+ *
+ * @param sError reason if the port can not be opened, e.g. "failed to listen on port 80: ..."
+ * @return INVALID_SOCKET on error
+ */
+SOCKET sock_listen(uint16_t iPort, int iBacklog, std::string& sError);
+
+/** wait for the next connection, a failed accept is retried
+ *
+ * @param addr address of the peer, can be nullptr
+ */
+SOCKET sock_accept(SOCKET hListen, sockaddr_in* addr);
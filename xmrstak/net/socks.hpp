@@ -27,6 +27,18 @@ inline void sock_close(SOCKET s)
 	closesocket(s);
 }
 
+inline bool sock_set_nonblocking(SOCKET s)
+{
+	u_long mode = 1;
+	return ioctlsocket(s, FIONBIO, &mode) == 0;
+}
+
+/** true if the last call on a non-blocking socket failed because it would block */
+inline bool sock_would_block()
+{
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+}
+
 inline const char* sock_strerror(char* buf, size_t len)
 {
 	buf[0] = '\0';
@@ -64,6 +76,7 @@ inline const char* sock_gai_strerror(int err, char* buf, size_t len)
 #include <string.h>
 #include <netinet/in.h> /* Needed for IPPROTO_TCP */
 #include <netinet/tcp.h>
+#include <fcntl.h>
 
 inline void sock_init() {}
 typedef int SOCKET;
@@ -77,6 +90,18 @@ inline void sock_close(SOCKET s)
 	close(s);
 }
 
+inline bool sock_set_nonblocking(SOCKET s)
+{
+	int flags = fcntl(s, F_GETFL, 0);
+	return flags != -1 && fcntl(s, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+/** true if the last call on a non-blocking socket failed because it would block */
+inline bool sock_would_block()
+{
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
 inline const char* sock_strerror(char* buf, size_t len)
 {
 	buf[0] = '\0';
@@ -0,0 +1,684 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+#include "stratum_proxy.hpp"
+#include "jpsock.hpp"
+#include "sock_server.hpp"
+
+#include "xmrstak/backend/GlobalStates.hpp"
+#include "xmrstak/backend/cpu/minethd.hpp"
+#include "xmrstak/backend/miner_work.hpp"
+#include "xmrstak/jconf.hpp"
+#include "xmrstak/misc/console.hpp"
+#include "xmrstak/misc/executor.hpp"
+#include "xmrstak/misc/jext.hpp"
+#include "xmrstak/misc/utility.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/select.h>
+#endif
+
+namespace
+{
+// the nonce is at byte 39 of the blob
+constexpr size_t iNonceOffset = 39;
+// limit of the job field "nonce_prefix_bits", see jpsock::process_pool_job()
+constexpr uint8_t iMaxPrefixBits = 24;
+// jobs which are kept to accept the late shares of a miner
+constexpr size_t iMaxJobs = 4;
+// size limit of an unterminated line of a miner
+constexpr size_t iMaxLineSize = 16 * 1024;
+// a miner which does not take its queued data within this time is dropped
+constexpr int iSendTimeoutSec = 10;
+// a connection which is not logged in within this time is dropped
+constexpr int iLoginTimeoutSec = 30;
+// limit of the data queued for a miner which reads slower than it gets jobs
+constexpr size_t iMaxSendQueue = 64 * 1024;
+
+#ifdef MSG_NOSIGNAL
+constexpr int iSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int iSendFlags = 0;
+#endif
+
+} // namespace
+
+bool stratum_proxy::proxy_conn::send(const std::string& str)
+{
+	std::lock_guard<std::mutex> lck(send_mutex);
+	if(bClosed)
+		return false;
+
+	if(sOut.empty())
+		tOutProgress = std::chrono::steady_clock::now();
+	sOut.append(str);
+	if(sOut.size() > iMaxSendQueue || !send_queued())
+	{
+		fail();
+		return false;
+	}
+	return true;
+}
+
+bool stratum_proxy::proxy_conn::flush()
+{
+	std::lock_guard<std::mutex> lck(send_mutex);
+	if(bClosed)
+		return false;
+
+	if(!send_queued() || (!sOut.empty() && std::chrono::steady_clock::now() - tOutProgress > std::chrono::seconds(iSendTimeoutSec)))
+	{
+		fail();
+		return false;
+	}
+	return true;
+}
+
+bool stratum_proxy::proxy_conn::have_output()
+{
+	std::lock_guard<std::mutex> lck(send_mutex);
+	return !sOut.empty();
+}
+
+bool stratum_proxy::proxy_conn::send_queued()
+{
+	while(!sOut.empty())
+	{
+		int ret = ::send(sock, sOut.c_str(), (int)sOut.size(), iSendFlags);
+		if(ret < 0 && sock_would_block())
+			return true;
+		if(ret <= 0)
+			return false;
+		sOut.erase(0, ret);
+		tOutProgress = std::chrono::steady_clock::now();
+	}
+	return true;
+}
+
+void stratum_proxy::proxy_conn::fail()
+{
+	sOut.clear();
+	// wake up the connection thread, it closes the socket
+#ifdef _WIN32
+	shutdown(sock, SD_BOTH);
+#else
+	shutdown(sock, SHUT_RDWR);
+#endif
+}
+
+void stratum_proxy::proxy_conn::close()
+{
+	std::lock_guard<std::mutex> lck(send_mutex);
+	bClosed = true;
+	sock_close(sock);
+}
+
+bool stratum_proxy::start(uint16_t iPort, uint8_t iBits)
+{
+	this->iPort = iPort;
+	iProxyBits = iBits;
+	slots.assign(size_t(1) << iBits, slot_free);
+	// slot 0 is mined by the own backends
+	slots[0] = slot_used;
+
+	std::string sError;
+	hListen = sock_listen(iPort, 64, sError);
+	if(hListen == INVALID_SOCKET)
+	{
+		Printer::inst()->print_msg(L0, "Stratum proxy %s", sError.c_str());
+		return false;
+	}
+
+	Printer::inst()->print_msg(L1, "Stratum proxy listening on port %u for up to %llu miners.", (unsigned int)iPort,
+		int_port(slots.size() - 1));
+	bRunning = true;
+	std::thread(&stratum_proxy::accept_loop, this).detach();
+	std::thread(&stratum_proxy::send_loop, this).detach();
+	return true;
+}
+
+uint32_t stratum_proxy::slot_nonce(const proxy_job& job, uint32_t iSlot)
+{
+	uint32_t iBlobNonce;
+	memcpy(&iBlobNonce, job.bWorkBlob + iNonceOffset, sizeof(iBlobNonce));
+	// the slot is placed directly below the prefix of the pool
+	return xmrstak::GlobalStates::nonce_with_prefix(iBlobNonce, job.iPoolBits, uint64_t(iSlot) << (32 - job.iBits));
+}
+
+void stratum_proxy::on_upstream_job(const pool_job& oPoolJob, size_t pool_id, xmrstak::miner_work& oWork)
+{
+	proxy_job job;
+	memcpy(job.sJobID, oPoolJob.sJobID, sizeof(job.sJobID));
+	memcpy(job.bWorkBlob, oPoolJob.bWorkBlob, oPoolJob.iWorkLen);
+	job.iWorkLen = oPoolJob.iWorkLen;
+	job.iTarget = oPoolJob.iTarget;
+	job.iPoolId = pool_id;
+	job.iPoolBits = oWork.iNoncePrefixBits;
+	job.iBits = 0;
+
+	xmrstak::coinDescription coinDesc = ::jconf::inst()->GetCurrentCoinSelection().GetDescription();
+	if(oPoolJob.bWorkBlob[0] >= coinDesc.GetMiningForkVersion())
+		job.algo = coinDesc.GetMiningAlgo();
+	else
+		job.algo = coinDesc.GetMiningAlgoRoot();
+
+	if(job.iPoolBits + iProxyBits <= iMaxPrefixBits)
+	{
+		job.iBits = job.iPoolBits + iProxyBits;
+		uint32_t iNonce = slot_nonce(job, 0);
+		memcpy(oWork.bWorkBlob + iNonceOffset, &iNonce, sizeof(iNonce));
+		oWork.iNoncePrefixBits = job.iBits;
+	}
+	else
+	{
+		Printer::inst()->print_msg(L1, "Stratum proxy: the pool reserves %u nonce bits, no room for %u proxy bits. The job is not shared.",
+			(unsigned int)job.iPoolBits, (unsigned int)iProxyBits);
+	}
+
+	std::unique_lock<std::mutex> lck(job_mutex);
+	job.iJobNo = ++iJobCnt;
+	jobs.push_back(std::move(job));
+	if(jobs.size() > iMaxJobs)
+		jobs.pop_front();
+
+	for(slot_state& s : slots)
+	{
+		if(s == slot_released)
+			s = slot_free;
+	}
+	lck.unlock();
+
+	send_cv.notify_one();
+}
+
+void stratum_proxy::on_submit_result(uint64_t iTag, const submit_rsp& oRsp)
+{
+	pending_share share;
+	{
+		std::lock_guard<std::mutex> lck(pending_mutex);
+		auto it = pending.find(iTag);
+		if(it == pending.end())
+			return;
+		share = it->second;
+		pending.erase(it);
+	}
+
+	pending_reply reply;
+	reply.conn = share.conn;
+	if(oRsp.bNetworkError)
+	{
+		iSharesRejected++;
+		reply.sMsg = error_msg(share.iCallId, "[NETWORK ERROR]");
+	}
+	else if(!oRsp.sError.empty())
+	{
+		iSharesRejected++;
+		reply.sMsg = error_msg(share.iCallId, oRsp.sError);
+	}
+	else
+	{
+		iSharesAccepted++;
+		reply.sMsg = result_msg(share.iCallId, "{\"status\":\"OK\"}");
+	}
+
+	{
+		std::lock_guard<std::mutex> lck(job_mutex);
+		replies.push_back(std::move(reply));
+	}
+	send_cv.notify_one();
+}
+
+void stratum_proxy::accept_loop()
+{
+	while(true)
+	{
+		sockaddr_in addr;
+		SOCKET sock = sock_accept(hListen, &addr);
+
+		// the connection thread waits with select, a send never blocks the send thread
+		if(!sock_set_nonblocking(sock))
+		{
+			sock_close(sock);
+			continue;
+		}
+
+		char sAddr[INET_ADDRSTRLEN] = "unknown";
+		inet_ntop(AF_INET, &addr.sin_addr, sAddr, sizeof(sAddr));
+
+		// each connection costs a thread, no more connections than nonce slots are accepted
+		std::shared_ptr<proxy_conn> conn;
+		{
+			std::lock_guard<std::mutex> lck(conn_mutex);
+			if(conns.size() < slots.size() - 1)
+			{
+				conn = std::make_shared<proxy_conn>(iNextConnId++, sock, std::string(sAddr));
+				conns.push_back(conn);
+			}
+		}
+
+		if(!conn)
+		{
+			std::string msg = error_msg(0, "Proxy is full");
+			::send(sock, msg.c_str(), (int)msg.size(), iSendFlags);
+			sock_close(sock);
+			Printer::inst()->print_msg(L2, "Stratum proxy: refused miner %s, all %llu slots are used.", sAddr, int_port(slots.size() - 1));
+			continue;
+		}
+
+		int flag = 1;
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&flag, sizeof(flag));
+		setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, (const char*)&flag, sizeof(flag));
+
+		std::thread(&stratum_proxy::conn_thread, this, conn).detach();
+	}
+}
+
+void stratum_proxy::conn_thread(std::shared_ptr<proxy_conn> conn)
+{
+	// the shares of the miner are hashed on this thread, the executor is never blocked by it
+	cryptonight_ctx* ctx = nullptr;
+	auto tLoginLimit = std::chrono::steady_clock::now() + std::chrono::seconds(iLoginTimeoutSec);
+	bool bLoggedIn = false;
+
+	std::string buf;
+	char rcv[4096];
+	while(true)
+	{
+		if(!bLoggedIn)
+		{
+			{
+				std::lock_guard<std::mutex> lck(job_mutex);
+				bLoggedIn = conn->iSlot != 0;
+			}
+			if(!bLoggedIn && std::chrono::steady_clock::now() > tLoginLimit)
+				break;
+		}
+
+		// the queued data of a slow miner is sent once the socket is writable
+		bool bOutput = conn->have_output();
+		fd_set rfds, wfds;
+		FD_ZERO(&rfds);
+		FD_ZERO(&wfds);
+		FD_SET(conn->sock, &rfds);
+		FD_SET(conn->sock, &wfds);
+		timeval timeout = { 1, 0 };
+		if(select((int)conn->sock + 1, &rfds, bOutput ? &wfds : nullptr, nullptr, &timeout) < 0)
+			break;
+		if(bOutput && !conn->flush())
+			break;
+		if(!FD_ISSET(conn->sock, &rfds))
+			continue;
+
+		int ret = recv(conn->sock, rcv, sizeof(rcv), 0);
+		if(ret < 0 && sock_would_block())
+			continue;
+		if(ret <= 0)
+			break;
+		buf.append(rcv, ret);
+
+		size_t pos;
+		bool ok = true;
+		while(ok && (pos = buf.find('\n')) != std::string::npos)
+		{
+			std::string line = buf.substr(0, pos);
+			buf.erase(0, pos + 1);
+			if(!line.empty())
+				ok = handle_line(conn, ctx, line.c_str());
+		}
+		if(!ok || buf.size() > iMaxLineSize)
+			break;
+	}
+
+	conn->close();
+	if(ctx != nullptr)
+		cryptonight_free_ctx(ctx);
+
+	uint32_t iSlot;
+	{
+		std::lock_guard<std::mutex> lck(job_mutex);
+		iSlot = conn->iSlot;
+		if(iSlot != 0)
+			slots[iSlot] = slot_released;
+		conn->iSlot = 0;
+	}
+	{
+		std::lock_guard<std::mutex> lck(conn_mutex);
+		conns.remove(conn);
+	}
+
+	if(iSlot != 0)
+		Printer::inst()->print_msg(L2, "Stratum proxy: miner %s disconnected.", conn->sAddr.c_str());
+}
+
+void stratum_proxy::send_loop()
+{
+	uint64_t iLastJobNo = 0;
+	while(true)
+	{
+		std::deque<pending_reply> rsp;
+		bool bNewJob;
+		{
+			std::unique_lock<std::mutex> lck(job_mutex);
+			send_cv.wait(lck, [&]() { return iJobCnt != iLastJobNo || !replies.empty(); });
+			bNewJob = iJobCnt != iLastJobNo;
+			iLastJobNo = iJobCnt;
+			rsp.swap(replies);
+		}
+
+		for(pending_reply& r : rsp)
+		{
+			std::shared_ptr<proxy_conn> conn = r.conn.lock();
+			if(conn)
+				conn->send(r.sMsg);
+		}
+
+		if(!bNewJob)
+			continue;
+
+		std::list<std::shared_ptr<proxy_conn>> current;
+		{
+			std::lock_guard<std::mutex> lck(conn_mutex);
+			current = conns;
+		}
+
+		for(auto& conn : current)
+		{
+			std::string job;
+			{
+				std::lock_guard<std::mutex> lck(job_mutex);
+				if(conn->iSlot != 0)
+					job = make_job(*conn);
+			}
+			if(job.empty())
+				continue;
+
+			std::string msg("{\"jsonrpc\":\"2.0\",\"method\":\"job\",\"params\":");
+			msg.append(job).append("}\n");
+			conn->send(msg);
+		}
+	}
+}
+
+std::string stratum_proxy::make_job(proxy_conn& conn)
+{
+	// a job which can't be split is not shared, the miners keep the previous job
+	if(jobs.empty() || jobs.back().iBits == 0 || jobs.back().iJobNo == conn.iJobNo)
+		return std::string();
+
+	const proxy_job& job = jobs.back();
+	uint8_t bBlob[sizeof(job.bWorkBlob)];
+	memcpy(bBlob, job.bWorkBlob, job.iWorkLen);
+	uint32_t iNonce = slot_nonce(job, conn.iSlot);
+	memcpy(bBlob + iNonceOffset, &iNonce, sizeof(iNonce));
+
+	char sBlob[sizeof(bBlob) * 2 + 1];
+	jpsock::bin2hex(bBlob, job.iWorkLen, sBlob);
+	sBlob[job.iWorkLen * 2] = '\0';
+	char sTarget[17];
+	jpsock::bin2hex((const unsigned char*)&job.iTarget, 8, sTarget);
+	sTarget[16] = '\0';
+
+	std::string json("{\"blob\":\"");
+	json.append(sBlob).append("\",\"job_id\":");
+	xmrstak::json_escape(json, job.sJobID);
+	json.append(",\"target\":\"").append(sTarget).append("\",\"nonce_prefix_bits\":").append(std::to_string(job.iBits)).append("}");
+
+	conn.iJobNo = job.iJobNo;
+	return json;
+}
+
+bool stratum_proxy::handle_line(const std::shared_ptr<proxy_conn>& conn, cryptonight_ctx*& ctx, const char* line)
+{
+	Document doc;
+	if(doc.Parse(line).HasParseError() || !doc.IsObject())
+		return false;
+
+	const Value* method = GetObjectMember(doc, "method");
+	const Value* id = GetObjectMember(doc, "id");
+	const Value* params = GetObjectMember(doc, "params");
+	if(method == nullptr || !method->IsString() || id == nullptr || !id->IsUint64())
+		return false;
+
+	uint64_t iCallId = id->GetUint64();
+	if(strcmp(method->GetString(), "login") == 0)
+		handle_login(*conn, iCallId);
+	else if(strcmp(method->GetString(), "getjob") == 0)
+	{
+		std::string job;
+		bool bLoggedIn;
+		{
+			std::lock_guard<std::mutex> lck(job_mutex);
+			bLoggedIn = conn->iSlot != 0;
+			if(bLoggedIn)
+				job = make_job(*conn);
+		}
+
+		if(!bLoggedIn)
+			conn->send(error_msg(iCallId, "Unauthenticated"));
+		else if(job.empty())
+			conn->send(error_msg(iCallId, "No new job"));
+		else
+			conn->send(result_msg(iCallId, job));
+	}
+	else if(strcmp(method->GetString(), "submit") == 0)
+	{
+		const Value* jobId = params != nullptr ? GetObjectMember(*params, "job_id") : nullptr;
+		const Value* nonce = params != nullptr ? GetObjectMember(*params, "nonce") : nullptr;
+		const Value* result = params != nullptr ? GetObjectMember(*params, "result") : nullptr;
+		if(jobId == nullptr || nonce == nullptr || result == nullptr || !jobId->IsString() || !nonce->IsString() || !result->IsString())
+		{
+			iSharesRefused++;
+			conn->send(error_msg(iCallId, "Malformed share"));
+		}
+		else if(!handle_submit(conn, ctx, iCallId, jobId->GetString(), nonce->GetString(), result->GetString()))
+			return false;
+	}
+	else if(strcmp(method->GetString(), "keepalived") == 0)
+		conn->send(result_msg(iCallId, "{\"status\":\"KEEPALIVED\"}"));
+	else
+		conn->send(error_msg(iCallId, "Unknown method"));
+
+	return true;
+}
+
+void stratum_proxy::handle_login(proxy_conn& conn, uint64_t iCallId)
+{
+	std::unique_lock<std::mutex> lck(job_mutex);
+	if(conn.iSlot != 0)
+	{
+		lck.unlock();
+		conn.send(error_msg(iCallId, "Already logged in"));
+		return;
+	}
+
+	if(jobs.empty() || jobs.back().iBits == 0)
+	{
+		lck.unlock();
+		conn.send(error_msg(iCallId, "No job available, the proxy is not connected to a pool"));
+		return;
+	}
+
+	auto it = std::find(slots.begin(), slots.end(), slot_free);
+	if(it == slots.end())
+	{
+		lck.unlock();
+		conn.send(error_msg(iCallId, "Proxy is full"));
+		return;
+	}
+
+	*it = slot_used;
+	conn.iSlot = uint32_t(it - slots.begin());
+	std::string job = make_job(conn);
+	uint32_t iSlot = conn.iSlot;
+	lck.unlock();
+
+	std::string result("{\"id\":\"");
+	result.append(std::to_string(conn.id)).append("\",\"job\":").append(job).append(",\"status\":\"OK\"}");
+	conn.send(result_msg(iCallId, result));
+
+	Printer::inst()->print_msg(L2, "Stratum proxy: miner %s logged in, nonce slot %u.", conn.sAddr.c_str(), (unsigned int)iSlot);
+}
+
+bool stratum_proxy::handle_submit(const std::shared_ptr<proxy_conn>& conn, cryptonight_ctx*& ctx, uint64_t iCallId, const char* sJobId, const char* sNonce, const char* sResult)
+{
+	uint32_t iNonce;
+	uint8_t bResult[32];
+	if(strlen(sNonce) != 8 || strlen(sResult) != 64 ||
+		!jpsock::hex2bin(sNonce, 8, (unsigned char*)&iNonce) || !jpsock::hex2bin(sResult, 64, bResult))
+	{
+		iSharesRefused++;
+		conn->send(error_msg(iCallId, "Malformed share"));
+		return true;
+	}
+
+	auto find_job = [&]() {
+		return std::find_if(jobs.rbegin(), jobs.rend(),
+			[&](const proxy_job& job) { return strncmp(job.sJobID, sJobId, sizeof(job.sJobID)) == 0; });
+	};
+
+	const char* error = nullptr;
+	uint8_t bWorkBlob[112];
+	uint32_t iWorkLen = 0;
+	uint64_t iJobNo = 0;
+	xmrstak_algo algo = invalid_algo;
+	{
+		std::lock_guard<std::mutex> lck(job_mutex);
+		auto it = find_job();
+
+		if(conn->iSlot == 0)
+			error = "Unauthenticated";
+		else if(it == jobs.rend() || it->iBits == 0)
+			error = "Unknown job";
+		else
+		{
+			const uint32_t iMask = 0xFFFFFFFFu << (32 - it->iBits);
+			if((iNonce & iMask) != slot_nonce(*it, conn->iSlot))
+				error = "Invalid nonce";
+			// a share below the target is never forwarded
+			else if(((const uint64_t*)bResult)[3] >= it->iTarget)
+				error = "Low difficulty share";
+			else if(it->nonces.count(iNonce) != 0)
+				error = "Duplicate share";
+			else
+			{
+				memcpy(bWorkBlob, it->bWorkBlob, it->iWorkLen);
+				iWorkLen = it->iWorkLen;
+				iJobNo = it->iJobNo;
+				algo = it->algo;
+			}
+		}
+	}
+
+	if(error == nullptr && ctx == nullptr && (ctx = xmrstak::cpu::minethd::minethd_alloc_ctx()) == nullptr)
+	{
+		iSharesRefused++;
+		conn->send(error_msg(iCallId, "Proxy can't verify the share"));
+		return false;
+	}
+
+	if(error == nullptr)
+	{
+		// hashed without the lock, a miner with an invalid hash never reaches the pool
+		uint8_t bHash[32];
+		memcpy(bWorkBlob + iNonceOffset, &iNonce, 4);
+		xmrstak::cpu::minethd::func_selector(algo)(bWorkBlob, iWorkLen, bHash, ctx);
+		if(memcmp(bHash, bResult, 32) != 0)
+			error = "Invalid hash";
+	}
+
+	job_result oResult;
+	size_t pool_id = 0;
+	if(error == nullptr)
+	{
+		std::lock_guard<std::mutex> lck(job_mutex);
+		auto it = find_job();
+
+		// the job may be dropped or the nonce submitted twice while the share was hashed
+		if(it == jobs.rend() || it->iJobNo != iJobNo)
+			error = "Unknown job";
+		else if(!it->nonces.insert(iNonce).second)
+			error = "Duplicate share";
+		else
+		{
+			oResult = job_result(it->sJobID, iNonce, bResult, 0, it->algo);
+			pool_id = it->iPoolId;
+		}
+	}
+
+	if(error != nullptr)
+	{
+		iSharesRefused++;
+		conn->send(error_msg(iCallId, error));
+		return true;
+	}
+
+	uint64_t iTag;
+	{
+		std::lock_guard<std::mutex> lck(pending_mutex);
+		iTag = iNextTag++;
+		pending_share& share = pending[iTag];
+		share.conn = conn;
+		share.iCallId = iCallId;
+	}
+
+	// the executor submits the share with the pool connection and replies with on_submit_result()
+	Executor::inst()->push_event(ex_event(proxy_share(oResult, iTag), pool_id));
+	return true;
+}
+
+std::string stratum_proxy::result_msg(uint64_t iCallId, const std::string& result)
+{
+	std::string msg("{\"id\":");
+	msg.append(std::to_string(iCallId)).append(",\"jsonrpc\":\"2.0\",\"error\":null,\"result\":").append(result).append("}\n");
+	return msg;
+}
+
+std::string stratum_proxy::error_msg(uint64_t iCallId, const std::string& err)
+{
+	std::string msg("{\"id\":");
+	msg.append(std::to_string(iCallId)).append(",\"jsonrpc\":\"2.0\",\"error\":{\"code\":-1,\"message\":");
+	xmrstak::json_escape(msg, err);
+	msg.append("},\"result\":null}\n");
+	return msg;
+}
+
+void stratum_proxy::proxy_report(std::string& out)
+{
+	char num[128];
+	size_t iMiners;
+	{
+		std::lock_guard<std::mutex> lck(job_mutex);
+		iMiners = std::count(slots.begin() + 1, slots.end(), slot_used);
+	}
+
+	snprintf(num, sizeof(num), "Proxy port      : %u, %llu of %llu miners\n", (unsigned int)iPort,
+		int_port(iMiners), int_port(slots.size() - 1));
+	out.append(num);
+	snprintf(num, sizeof(num), "Proxy shares    : %llu accepted, %llu rejected, %llu refused by the proxy\n",
+		int_port(iSharesAccepted.load()), int_port(iSharesRejected.load()), int_port(iSharesRefused.load()));
+	out.append(num);
+}
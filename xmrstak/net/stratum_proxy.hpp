@@ -0,0 +1,192 @@
+#pragma once
+
+#include "xmrstak/backend/cryptonight.hpp"
+#include "xmrstak/backend/cpu/crypto/cryptonight.h"
+#include "xmrstak/misc/Environment.hpp"
+#include "xmrstak/net/msgstruct.hpp"
+#include "xmrstak/net/socks.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace xmrstak
+{
+struct miner_work;
+}
+
+/** stratum server which shares the pool connection with other miners (`--proxy PORT`)
+ *
+ * The nonce space of a job is split by the proxy bits below the nonce prefix of the pool:
+ * slot 0 is mined by the own backends, each downstream miner gets one of the other slots
+ * as its nonce prefix. The shares of the downstream miners are hashed by the connection thread
+ * and submitted with the pool connection of the executor, the reply of the pool is sent back
+ * to the miner.
+ */
+class stratum_proxy
+{
+public:
+	static stratum_proxy* inst()
+	{
+		auto& env = xmrstak::Environment::inst();
+		if(env.pStratumProxy == nullptr)
+			env.pStratumProxy = new stratum_proxy;
+		return env.pStratumProxy;
+	};
+
+	/** listen on the port and start the proxy threads
+	 *
+	 * @param iBits number of nonce prefix bits used by the proxy, 2^iBits - 1 downstream miners are served
+	 * @return false if the port can not be opened
+	 */
+	bool start(uint16_t iPort, uint8_t iBits);
+
+	bool is_running() const { return bRunning; }
+
+	/** share a new job of the current pool, called by the executor thread
+	 *
+	 * The nonce prefix of slot 0 is written to oWork.
+	 */
+	void on_upstream_job(const pool_job& oPoolJob, size_t pool_id, xmrstak::miner_work& oWork);
+
+	/** reply of the pool to a share submitted with the tag */
+	void on_submit_result(uint64_t iTag, const submit_rsp& oRsp);
+
+	void proxy_report(std::string& out);
+
+private:
+	stratum_proxy() = default;
+
+	struct proxy_job
+	{
+		char sJobID[64];
+		uint8_t bWorkBlob[112];
+		uint32_t iWorkLen;
+		uint64_t iTarget;
+		size_t iPoolId;
+		uint64_t iJobNo;
+		// nonce prefix bits of the pool
+		uint8_t iPoolBits;
+		// nonce prefix bits of the pool and the proxy, 0 if the job is not shared
+		uint8_t iBits;
+		xmrstak_algo algo;
+		// submitted nonces, the slots are disjoint
+		std::set<uint32_t> nonces;
+	};
+
+	struct proxy_conn
+	{
+		size_t id;
+		SOCKET sock;
+		std::string sAddr;
+		// nonce slot, 0 until the miner is logged in (guarded by job_mutex)
+		uint32_t iSlot = 0;
+		// number of the last job sent to the miner (guarded by job_mutex)
+		uint64_t iJobNo = 0;
+		// guards sock and sOut, a job or reply can be sent after the connection thread closed the socket
+		std::mutex send_mutex;
+		bool bClosed = false;
+		// data which did not fit into the socket buffer, sent by the connection thread
+		std::string sOut;
+		// last time the miner took data while sOut was not empty
+		std::chrono::steady_clock::time_point tOutProgress;
+
+		proxy_conn(size_t id, SOCKET sock, std::string&& addr) : id(id), sock(sock), sAddr(std::move(addr)) {}
+
+		/** queue the data and send as much as the socket takes without blocking
+		 *
+		 * A miner which does not take its data is disconnected, the other miners never wait for it.
+		 * @return false if the connection is closed or failed
+		 */
+		bool send(const std::string& str);
+		/** send the queued data without blocking, called by the connection thread
+		 *
+		 * @return false if the connection failed or the miner did not take data in time
+		 */
+		bool flush();
+		bool have_output();
+		void close();
+
+	private:
+		// send_mutex must be locked
+		bool send_queued();
+		void fail();
+	};
+
+	struct pending_share
+	{
+		std::weak_ptr<proxy_conn> conn;
+		uint64_t iCallId;
+	};
+
+	struct pending_reply
+	{
+		std::weak_ptr<proxy_conn> conn;
+		std::string sMsg;
+	};
+
+	enum slot_state : uint8_t { slot_free, slot_used, slot_released };
+
+	void accept_loop();
+	void conn_thread(std::shared_ptr<proxy_conn> conn);
+	void send_loop();
+
+	/** @return false if the connection must be closed */
+	bool handle_line(const std::shared_ptr<proxy_conn>& conn, cryptonight_ctx*& ctx, const char* line);
+	void handle_login(proxy_conn& conn, uint64_t iCallId);
+	/** check a share of the miner and forward it to the executor
+	 *
+	 * @param ctx hash context of the connection thread, allocated with the first share
+	 * @return false if the hash context can not be allocated
+	 */
+	bool handle_submit(const std::shared_ptr<proxy_conn>& conn, cryptonight_ctx*& ctx, uint64_t iCallId, const char* sJobId, const char* sNonce, const char* sResult);
+
+	/** JSON of the newest shared job for the slot of the miner, empty if there is none
+	 *
+	 * job_mutex must be locked.
+	 */
+	std::string make_job(proxy_conn& conn);
+
+	static std::string result_msg(uint64_t iCallId, const std::string& result);
+	static std::string error_msg(uint64_t iCallId, const std::string& msg);
+
+	static uint32_t slot_nonce(const proxy_job& job, uint32_t iSlot);
+
+	SOCKET hListen = INVALID_SOCKET;
+	uint16_t iPort = 0;
+	uint8_t iProxyBits = 0;
+	std::atomic<bool> bRunning{false};
+
+	std::mutex conn_mutex;
+	std::list<std::shared_ptr<proxy_conn>> conns;
+	size_t iNextConnId = 1;
+
+	/* The executor thread never writes to a downstream socket, new jobs and the replies
+	 * of the pool are sent by the send thread.
+	 */
+	std::mutex job_mutex;
+	std::condition_variable send_cv;
+	// the newest job is at the back
+	std::deque<proxy_job> jobs;
+	uint64_t iJobCnt = 0;
+	// the slot of a disconnected miner is reused with the next job, a new miner never repeats its nonces
+	std::vector<slot_state> slots;
+	std::deque<pending_reply> replies;
+
+	std::mutex pending_mutex;
+	std::map<uint64_t, pending_share> pending;
+	uint64_t iNextTag = 1;
+
+	std::atomic<uint64_t> iSharesAccepted{0};
+	std::atomic<uint64_t> iSharesRejected{0};
+	std::atomic<uint64_t> iSharesRefused{0};
+};
@@ -2,6 +2,7 @@
 
 #include "xmrstak/misc/Environment.hpp"
 
+#include <cstdint>
 #include <string>
 
 namespace xmrstak {
@@ -16,8 +17,16 @@ struct params {
 	std::string binaryName;
 	std::string executablePrefix;
 	bool cache;
+	// size limit of the OpenCL binary cache in MiB, 0 means unlimited
+	size_t cacheLimit;
 	// user selected OpenCL vendor
 	std::string openCLVendor;
+	// OpenCL device type: gpu, cpu or all
+	std::string openCLDeviceType;
+	// measure the time of each OpenCL command
+	bool openCLProfile = false;
+	// rebuild the context of an AMD gpu which did not finish a round within this time, 0 disables the check
+	int amdWatchdogSec = 30;
 
 	bool poolUseTls = false;
 	std::string poolURL;
@@ -34,6 +43,16 @@ struct params {
 	std::string configFilePools;
 	std::string configFileAMD;
 
+	static constexpr int32_t httpd_port_unset = -1;
+	static constexpr int32_t httpd_port_disabled = 0;
+	// port of the statistics server, httpd_port_unset uses the config file
+	int32_t httpd_port = httpd_port_unset;
+
+	// port of the stratum proxy, 0 disables the proxy
+	int32_t proxyPort = 0;
+	// nonce prefix bits used by the proxy, 2^proxyBits - 1 miners can connect
+	int proxyBits = 8;
+
 	bool allowUAC = true;
 	std::string minerArg0;
 	std::string minerArgs;
@@ -43,11 +62,25 @@ struct params {
 	int benchmark_wait_sec = 30;
 	int benchmark_work_sec = 60;
 
+	// write the received jobs to this file
+	std::string traceRecordFile;
+	// replay the jobs of this file and exit
+	std::string traceReplayFile;
+	// the replay is this factor faster than the recording
+	double traceSpeed = 1.0;
+
+	// search the fastest AMD backend configuration, write it to the config file and exit
+	bool autotune = false;
+	// measure time per tested configuration
+	int autotune_sample_sec = 3;
+
 	params() :
 		binaryName("xmr-stak"),
 		executablePrefix(""),
 		cache(true),
+		cacheLimit(256),
 		openCLVendor("AMD"),
+		openCLDeviceType("gpu"),
 		configFile("config.txt"),
 		configFilePools("pools.txt"),
 		configFileAMD("amd.txt") {
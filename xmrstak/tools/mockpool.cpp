@@ -0,0 +1,905 @@
+/*
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  * Additional permission under GNU GPL version 3 section 7
+  *
+  * If you modify this Program, or any covered work, by linking or combining
+  * it with OpenSSL (or a modified version of that library), containing parts
+  * covered by the terms of OpenSSL License and SSLeay License, the licensors
+  * of this Program grant you additional permission to convey the resulting work.
+  *
+  */
+
+/* Stratum pool for local end-to-end tests of the miner
+ *
+ * The pool sends jobs with a fixed difficulty at a configurable rate and verifies the
+ * submitted shares with the CPU hash functions of the miner. All events can be written
+ * to a CSV file to measure the job to first share latency and the stale share rate.
+ */
+
+#include "xmrstak/backend/cryptonight.hpp"
+#include "xmrstak/backend/cpu/crypto/cryptonight.h"
+#include "xmrstak/backend/cpu/minethd.hpp"
+#include "xmrstak/misc/console.hpp"
+#include "xmrstak/misc/jext.hpp"
+#include "xmrstak/misc/telemetry.hpp"
+#include "xmrstak/net/jpsock.hpp"
+#include "xmrstak/net/sock_server.hpp"
+#include "xmrstak/net/socks.hpp"
+
+#ifndef CONF_NO_TLS
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509.h>
+#endif
+
+#ifndef _WIN32
+#include <sys/select.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <xmmintrin.h>
+
+namespace
+{
+
+struct mock_options
+{
+	int port = 3333;
+	// 0 disables the TLS port
+	int tlsPort = 0;
+	std::string certFile;
+	std::string keyFile;
+	std::string algoName = "cryptonight_v7";
+	uint64_t diff = 1000;
+	// 0 sends only a job on login and on getjob
+	uint64_t jobIntervalMs = 30000;
+	uint8_t blobVersion = 7;
+	std::string logFile;
+	// 0 runs until the process is killed
+	uint64_t durationSec = 0;
+	uint64_t statsSec = 10;
+	bool verify = true;
+};
+
+struct algo_name
+{
+	const char* name;
+	xmrstak_algo algo;
+};
+
+// the names of the algo extension of the stratum protocol, see jpsock::cmd_submit()
+const algo_name algos[] = {
+	{ "cryptonight", cryptonight },
+	{ "cryptonight_lite", cryptonight_lite },
+	{ "cryptonight_v7", cryptonight_monero },
+	{ "cryptonight_lite_v7", cryptonight_aeon },
+	{ "cryptonight_lite_v7_xor", cryptonight_ipbc },
+	{ "cryptonight_v7_stellite", cryptonight_stellite },
+	{ "cryptonight_heavy", cryptonight_heavy },
+	{ "cryptonight_haven", cryptonight_haven },
+	{ "cryptonight_masari", cryptonight_masari }
+};
+
+// size of the blob of a job, the nonce is at byte 39
+constexpr size_t iBlobSize = 76;
+constexpr size_t iNonceOffset = 39;
+// jobs of a connection which are kept to detect stale shares
+constexpr size_t iMaxJobs = 8;
+
+uint64_t now_us()
+{
+	using namespace std::chrono;
+	static const steady_clock::time_point tStart = steady_clock::now();
+	return duration_cast<microseconds>(steady_clock::now() - tStart).count();
+}
+
+struct mock_job
+{
+	std::string sJobId;
+	uint8_t bBlob[iBlobSize];
+	uint64_t iTarget;
+	uint64_t iSentUs;
+	bool bHaveShare = false;
+	std::set<uint32_t> nonces;
+};
+
+struct mock_conn
+{
+	size_t id;
+	SOCKET sock;
+#ifndef CONF_NO_TLS
+	SSL* ssl = nullptr;
+#endif
+	std::atomic<bool> bLoggedIn;
+	// guards the socket, the job thread may still send to a closed connection
+	std::mutex send_mutex;
+	bool bClosed = false;
+#ifndef CONF_NO_TLS
+	/* An SSL object can't read and write at the same time. The socket of a TLS connection is
+	 * non-blocking, ssl_mutex is only held for a single SSL call and never while waiting for data.
+	 */
+	std::mutex ssl_mutex;
+#endif
+
+	// the newest job is at the back
+	std::mutex job_mutex;
+	std::deque<mock_job> jobs;
+
+	mock_conn(size_t id, SOCKET sock) : id(id), sock(sock), bLoggedIn(false) {}
+
+	int recv(char* buf, int len)
+	{
+#ifndef CONF_NO_TLS
+		if(ssl != nullptr)
+		{
+			// a partial record returns at once, the sender is never blocked by a slow client
+			while(true)
+			{
+				int err;
+				{
+					std::lock_guard<std::mutex> lck(ssl_mutex);
+					if(ssl == nullptr)
+						return -1;
+					int ret = SSL_read(ssl, buf, len);
+					if(ret > 0)
+						return ret;
+					err = SSL_get_error(ssl, ret);
+				}
+				if((err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE) || wait_socket(err == SSL_ERROR_WANT_WRITE) < 0)
+					return -1;
+			}
+		}
+#endif
+		return ::recv(sock, buf, len, 0);
+	}
+
+	bool send(const std::string& str)
+	{
+		std::lock_guard<std::mutex> lck(send_mutex);
+		if(bClosed)
+			return false;
+		size_t pos = 0;
+		while(pos < str.size())
+		{
+			int ret;
+#ifndef CONF_NO_TLS
+			if(ssl != nullptr)
+			{
+				int err;
+				{
+					std::lock_guard<std::mutex> lck(ssl_mutex);
+					ret = SSL_write(ssl, str.c_str() + pos, (int)(str.size() - pos));
+					err = ret > 0 ? SSL_ERROR_NONE : SSL_get_error(ssl, ret);
+				}
+				// the write is repeated with the same arguments once the socket is ready
+				if(err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+				{
+					if(wait_socket(err == SSL_ERROR_WANT_WRITE) < 0)
+						return false;
+					continue;
+				}
+			}
+			else
+#endif
+				ret = ::send(sock, str.c_str() + pos, (int)(str.size() - pos), 0);
+			if(ret <= 0)
+				return false;
+			pos += ret;
+		}
+		return true;
+	}
+
+	/** wait up to one second until the socket is readable or writable
+	 *
+	 * @return the result of select, 0 on timeout
+	 */
+	int wait_socket(bool bWrite)
+	{
+		fd_set fds;
+		FD_ZERO(&fds);
+		FD_SET(sock, &fds);
+		timeval timeout = { 1, 0 };
+		return select((int)sock + 1, bWrite ? nullptr : &fds, bWrite ? &fds : nullptr, nullptr, &timeout);
+	}
+
+	void close()
+	{
+		std::lock_guard<std::mutex> lck(send_mutex);
+		bClosed = true;
+#ifndef CONF_NO_TLS
+		std::lock_guard<std::mutex> ssl_lck(ssl_mutex);
+		if(ssl != nullptr)
+		{
+			SSL_free(ssl);
+			ssl = nullptr;
+		}
+#endif
+		sock_close(sock);
+	}
+};
+
+struct ctx_deleter
+{
+	void operator()(cryptonight_ctx* ctx) const
+	{
+		_mm_free(ctx->long_state);
+		_mm_free(ctx);
+	}
+};
+
+class mock_pool
+{
+public:
+	explicit mock_pool(const mock_options& opt) : opt(opt), rnd(std::random_device()()) {}
+
+	bool start();
+	void print_stats(uint64_t iSec);
+
+private:
+	void accept_loop(SOCKET listenSock, bool tls);
+	void conn_thread(std::shared_ptr<mock_conn> conn);
+	void job_loop();
+
+	bool handle_line(mock_conn& conn, const char* line, cryptonight_ctx* ctx);
+	void handle_submit(mock_conn& conn, uint64_t iCallId, const Value& params, cryptonight_ctx* ctx, uint64_t iRecvUs);
+
+	std::string make_job(mock_conn& conn);
+	void send_result(mock_conn& conn, uint64_t iCallId, const std::string& result);
+	void send_error(mock_conn& conn, uint64_t iCallId, const char* msg);
+	void log_event(size_t conn, const char* event, const std::string& jobId, const char* nonce, const char* status, uint64_t iLatencyUs);
+
+#ifndef CONF_NO_TLS
+	bool init_tls();
+	SSL_CTX* tls_ctx = nullptr;
+#endif
+
+	const mock_options& opt;
+	xmrstak_algo algo = invalid_algo;
+	xmrstak::cpu::minethd::cn_hash_fun hash_fun = nullptr;
+
+	std::mutex conn_mutex;
+	std::list<std::shared_ptr<mock_conn>> conns;
+	size_t iNextConnId = 1;
+
+	std::mutex rnd_mutex;
+	std::mt19937_64 rnd;
+	std::atomic<uint64_t> iJobCnt{0};
+
+	std::mutex log_mutex;
+	FILE* fLog = nullptr;
+
+	std::atomic<uint64_t> iShares{0};
+	std::atomic<uint64_t> iSharesOk{0};
+	std::atomic<uint64_t> iSharesStale{0};
+	std::atomic<uint64_t> iSharesInvalid{0};
+	std::atomic<uint64_t> iSharesLowDiff{0};
+	std::atomic<uint64_t> iSharesDuplicate{0};
+	std::atomic<uint64_t> iSharesUnknown{0};
+
+	// microseconds
+	xmrstak::histogram oFirstShare;
+	xmrstak::histogram oVerify;
+	xmrstak::histogram oReply;
+};
+
+bool mock_pool::start()
+{
+	for(const algo_name& a : algos)
+	{
+		if(opt.algoName == a.name)
+			algo = a.algo;
+	}
+	if(algo == invalid_algo)
+	{
+		printf("Unknown algorithm '%s'.\n", opt.algoName.c_str());
+		return false;
+	}
+	hash_fun = xmrstak::cpu::minethd::func_selector(algo);
+
+	if(!opt.logFile.empty())
+	{
+		fLog = fopen(opt.logFile.c_str(), "w");
+		if(fLog == nullptr)
+		{
+			printf("Can't open the log file '%s'.\n", opt.logFile.c_str());
+			return false;
+		}
+		fprintf(fLog, "time_us,conn,event,job_id,nonce,status,latency_us\n");
+	}
+
+	std::string sError;
+	SOCKET sock = sock_listen((uint16_t)opt.port, 64, sError);
+	if(sock == INVALID_SOCKET)
+	{
+		printf("Pool %s\n", sError.c_str());
+		return false;
+	}
+	std::thread(&mock_pool::accept_loop, this, sock, false).detach();
+	printf("Listening on port %d, algorithm %s, difficulty %llu.\n", opt.port, opt.algoName.c_str(), int_port(opt.diff));
+
+	if(opt.tlsPort != 0)
+	{
+#ifndef CONF_NO_TLS
+		if(!init_tls())
+			return false;
+		sock = sock_listen((uint16_t)opt.tlsPort, 64, sError);
+		if(sock == INVALID_SOCKET)
+		{
+			printf("Pool %s\n", sError.c_str());
+			return false;
+		}
+		std::thread(&mock_pool::accept_loop, this, sock, true).detach();
+		printf("Listening on TLS port %d.\n", opt.tlsPort);
+#else
+		printf("TLS is not supported, the pool was compiled without OpenSSL.\n");
+		return false;
+#endif
+	}
+
+	if(opt.jobIntervalMs != 0)
+		std::thread(&mock_pool::job_loop, this).detach();
+
+	return true;
+}
+
+#ifndef CONF_NO_TLS
+bool mock_pool::init_tls()
+{
+	tls_ctx = SSL_CTX_new(SSLv23_method());
+	if(tls_ctx == nullptr)
+		return false;
+
+	if(!opt.certFile.empty())
+	{
+		if(SSL_CTX_use_certificate_chain_file(tls_ctx, opt.certFile.c_str()) != 1 ||
+			SSL_CTX_use_PrivateKey_file(tls_ctx, opt.keyFile.c_str(), SSL_FILETYPE_PEM) != 1)
+		{
+			printf("Can't load the TLS certificate '%s' or key '%s'.\n", opt.certFile.c_str(), opt.keyFile.c_str());
+			ERR_print_errors_fp(stdout);
+			return false;
+		}
+		return true;
+	}
+
+	// a self signed certificate is sufficient, the miner checks only the fingerprint
+	EVP_PKEY* pkey = nullptr;
+	EVP_PKEY_CTX* kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+	if(kctx == nullptr || EVP_PKEY_keygen_init(kctx) != 1 || EVP_PKEY_CTX_set_rsa_keygen_bits(kctx, 2048) != 1 ||
+		EVP_PKEY_keygen(kctx, &pkey) != 1)
+	{
+		EVP_PKEY_CTX_free(kctx);
+		ERR_print_errors_fp(stdout);
+		return false;
+	}
+	EVP_PKEY_CTX_free(kctx);
+
+	X509* cert = X509_new();
+	X509_set_version(cert, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+	X509_gmtime_adj(X509_get_notBefore(cert), 0);
+	X509_gmtime_adj(X509_get_notAfter(cert), 365L * 24 * 3600);
+	X509_set_pubkey(cert, pkey);
+	X509_NAME* name = X509_get_subject_name(cert);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)"xmr-stak-mockpool", -1, -1, 0);
+	X509_set_issuer_name(cert, name);
+
+	bool ok = X509_sign(cert, pkey, EVP_sha256()) != 0 &&
+		SSL_CTX_use_certificate(tls_ctx, cert) == 1 && SSL_CTX_use_PrivateKey(tls_ctx, pkey) == 1;
+	X509_free(cert);
+	EVP_PKEY_free(pkey);
+
+	if(!ok)
+		ERR_print_errors_fp(stdout);
+	return ok;
+}
+#endif
+
+void mock_pool::accept_loop(SOCKET listenSock, bool tls)
+{
+	while(true)
+	{
+		SOCKET sock = sock_accept(listenSock, nullptr);
+
+		int flag = 1;
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&flag, sizeof(flag));
+
+		std::shared_ptr<mock_conn> conn;
+		{
+			std::lock_guard<std::mutex> lck(conn_mutex);
+			conn = std::make_shared<mock_conn>(iNextConnId++, sock);
+			conns.push_back(conn);
+		}
+
+#ifndef CONF_NO_TLS
+		if(tls)
+		{
+			conn->ssl = SSL_new(tls_ctx);
+			SSL_set_fd(conn->ssl, (int)sock);
+		}
+#endif
+		std::thread(&mock_pool::conn_thread, this, conn).detach();
+	}
+}
+
+void mock_pool::conn_thread(std::shared_ptr<mock_conn> conn)
+{
+	log_event(conn->id, "connect", "", "", "", 0);
+
+#ifndef CONF_NO_TLS
+	if(conn->ssl != nullptr && (SSL_accept(conn->ssl) != 1 || !sock_set_nonblocking(conn->sock)))
+	{
+		ERR_print_errors_fp(stdout);
+		log_event(conn->id, "close", "", "", "tls error", 0);
+		conn->close();
+		std::lock_guard<std::mutex> lck(conn_mutex);
+		conns.remove(conn);
+		return;
+	}
+#endif
+
+	std::unique_ptr<cryptonight_ctx, ctx_deleter> ctx;
+	if(opt.verify)
+	{
+		cryptonight_ctx* c = (cryptonight_ctx*)_mm_malloc(sizeof(cryptonight_ctx), 4096);
+		c->long_state = (uint8_t*)_mm_malloc(CRYPTONIGHT_HEAVY_MEMORY, 4096);
+		c->ctx_info[0] = 0;
+		c->ctx_info[1] = 0;
+		ctx.reset(c);
+	}
+
+	std::string buf;
+	char rcv[4096];
+	while(true)
+	{
+		int ret = conn->recv(rcv, sizeof(rcv));
+		if(ret <= 0)
+			break;
+		buf.append(rcv, ret);
+
+		size_t pos;
+		bool ok = true;
+		while(ok && (pos = buf.find('\n')) != std::string::npos)
+		{
+			std::string line = buf.substr(0, pos);
+			buf.erase(0, pos + 1);
+			if(!line.empty())
+				ok = handle_line(*conn, line.c_str(), ctx.get());
+		}
+		if(!ok || buf.size() > 64 * 1024)
+			break;
+	}
+
+	log_event(conn->id, "close", "", "", "", 0);
+	conn->bLoggedIn = false;
+	conn->close();
+	std::lock_guard<std::mutex> lck(conn_mutex);
+	conns.remove(conn);
+}
+
+void mock_pool::job_loop()
+{
+	while(true)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(opt.jobIntervalMs));
+
+		std::list<std::shared_ptr<mock_conn>> current;
+		{
+			std::lock_guard<std::mutex> lck(conn_mutex);
+			current = conns;
+		}
+
+		for(auto& conn : current)
+		{
+			if(!conn->bLoggedIn)
+				continue;
+			std::string msg("{\"jsonrpc\":\"2.0\",\"method\":\"job\",\"params\":");
+			msg.append(make_job(*conn)).append("}\n");
+			conn->send(msg);
+		}
+	}
+}
+
+std::string mock_pool::make_job(mock_conn& conn)
+{
+	mock_job job;
+	uint64_t iJobNo = ++iJobCnt;
+
+	{
+		std::lock_guard<std::mutex> lck(rnd_mutex);
+		for(size_t i = 0; i < iBlobSize; i += 8)
+		{
+			uint64_t r = rnd();
+			memcpy(job.bBlob + i, &r, std::min<size_t>(8, iBlobSize - i));
+		}
+	}
+	job.bBlob[0] = opt.blobVersion;
+	memset(job.bBlob + iNonceOffset, 0, 4);
+	// the miner refuses a job which is equal to the last one
+	memcpy(job.bBlob + iNonceOffset + 4, &iJobNo, sizeof(iJobNo));
+
+	job.sJobId = std::to_string(iJobNo);
+	job.iTarget = jpsock::diff_to_t64(opt.diff);
+	job.iSentUs = now_us();
+
+	char sBlob[iBlobSize * 2 + 1];
+	jpsock::bin2hex(job.bBlob, iBlobSize, sBlob);
+	sBlob[iBlobSize * 2] = '\0';
+	char sTarget[17];
+	jpsock::bin2hex((const unsigned char*)&job.iTarget, 8, sTarget);
+	sTarget[16] = '\0';
+
+	std::string json("{\"blob\":\"");
+	json.append(sBlob).append("\",\"job_id\":\"").append(job.sJobId).append("\",\"target\":\"").append(sTarget).append("\"}");
+
+	{
+		std::lock_guard<std::mutex> lck(conn.job_mutex);
+		conn.jobs.push_back(std::move(job));
+		if(conn.jobs.size() > iMaxJobs)
+			conn.jobs.pop_front();
+	}
+
+	log_event(conn.id, "job", std::to_string(iJobNo), "", "", 0);
+	return json;
+}
+
+bool mock_pool::handle_line(mock_conn& conn, const char* line, cryptonight_ctx* ctx)
+{
+	uint64_t iRecvUs = now_us();
+
+	Document doc;
+	if(doc.Parse(line).HasParseError() || !doc.IsObject())
+	{
+		printf("Connection %llu: invalid JSON '%s'\n", int_port(conn.id), line);
+		return false;
+	}
+
+	const Value* method = GetObjectMember(doc, "method");
+	const Value* id = GetObjectMember(doc, "id");
+	const Value* params = GetObjectMember(doc, "params");
+	if(method == nullptr || !method->IsString() || id == nullptr || !id->IsUint64() || params == nullptr || !params->IsObject())
+	{
+		printf("Connection %llu: invalid call '%s'\n", int_port(conn.id), line);
+		return false;
+	}
+
+	uint64_t iCallId = id->GetUint64();
+	std::string sMethod(method->GetString());
+	if(sMethod == "login")
+	{
+		std::string result("{\"id\":\"");
+		result.append(std::to_string(conn.id)).append("\",\"job\":").append(make_job(conn)).append(",\"status\":\"OK\"}");
+		send_result(conn, iCallId, result);
+		conn.bLoggedIn = true;
+		log_event(conn.id, "login", "", "", "", 0);
+	}
+	else if(sMethod == "getjob")
+		send_result(conn, iCallId, make_job(conn));
+	else if(sMethod == "submit")
+	{
+		handle_submit(conn, iCallId, *params, ctx, iRecvUs);
+		oReply.record(now_us() - iRecvUs);
+	}
+	else if(sMethod == "keepalived")
+		send_result(conn, iCallId, "{\"status\":\"KEEPALIVED\"}");
+	else
+		send_error(conn, iCallId, "Unknown method");
+
+	return true;
+}
+
+void mock_pool::handle_submit(mock_conn& conn, uint64_t iCallId, const Value& params, cryptonight_ctx* ctx, uint64_t iRecvUs)
+{
+	const Value* jobId = GetObjectMember(params, "job_id");
+	const Value* nonce = GetObjectMember(params, "nonce");
+	const Value* result = GetObjectMember(params, "result");
+
+	uint32_t iNonce;
+	uint8_t bResult[32];
+	if(jobId == nullptr || nonce == nullptr || result == nullptr || !jobId->IsString() || !nonce->IsString() || !result->IsString() ||
+		nonce->GetStringLength() != 8 || result->GetStringLength() != 64 ||
+		!jpsock::hex2bin(nonce->GetString(), 8, (unsigned char*)&iNonce) || !jpsock::hex2bin(result->GetString(), 64, bResult))
+	{
+		send_error(conn, iCallId, "Malformed share");
+		return;
+	}
+
+	iShares++;
+	std::string sJobId(jobId->GetString());
+	const char* sNonce = nonce->GetString();
+
+	uint8_t bBlob[iBlobSize];
+	uint64_t iTarget;
+	const char* error = nullptr;
+	uint64_t iLatencyUs = 0;
+	{
+		std::lock_guard<std::mutex> lck(conn.job_mutex);
+		auto it = conn.jobs.begin();
+		while(it != conn.jobs.end() && it->sJobId != sJobId)
+			++it;
+
+		if(it == conn.jobs.end())
+		{
+			iSharesUnknown++;
+			error = "Unknown job";
+		}
+		else
+		{
+			iLatencyUs = iRecvUs - it->iSentUs;
+			if(!it->bHaveShare)
+			{
+				it->bHaveShare = true;
+				oFirstShare.record(iLatencyUs);
+			}
+
+			if(&*it != &conn.jobs.back())
+			{
+				iSharesStale++;
+				error = "Block expired";
+			}
+			else if(!it->nonces.insert(iNonce).second)
+			{
+				iSharesDuplicate++;
+				error = "Duplicate share";
+			}
+			memcpy(bBlob, it->bBlob, iBlobSize);
+			iTarget = it->iTarget;
+		}
+	}
+
+	if(error == nullptr && opt.verify)
+	{
+		uint8_t bHash[32];
+		memcpy(bBlob + iNonceOffset, &iNonce, 4);
+		uint64_t iStart = now_us();
+		hash_fun(bBlob, iBlobSize, bHash, ctx);
+		oVerify.record(now_us() - iStart);
+		if(memcmp(bHash, bResult, 32) != 0)
+		{
+			iSharesInvalid++;
+			error = "Invalid hash";
+		}
+	}
+
+	if(error == nullptr && ((const uint64_t*)bResult)[3] >= iTarget)
+	{
+		iSharesLowDiff++;
+		error = "Low difficulty share";
+	}
+
+	if(error == nullptr)
+	{
+		iSharesOk++;
+		send_result(conn, iCallId, "{\"status\":\"OK\"}");
+	}
+	else
+		send_error(conn, iCallId, error);
+
+	log_event(conn.id, "share", sJobId, sNonce, error == nullptr ? "OK" : error, iLatencyUs);
+}
+
+void mock_pool::send_result(mock_conn& conn, uint64_t iCallId, const std::string& result)
+{
+	std::string msg("{\"id\":");
+	msg.append(std::to_string(iCallId)).append(",\"jsonrpc\":\"2.0\",\"error\":null,\"result\":").append(result).append("}\n");
+	conn.send(msg);
+}
+
+void mock_pool::send_error(mock_conn& conn, uint64_t iCallId, const char* msg)
+{
+	std::string rsp("{\"id\":");
+	rsp.append(std::to_string(iCallId)).append(",\"jsonrpc\":\"2.0\",\"error\":{\"code\":-1,\"message\":\"").append(msg).append("\"},\"result\":null}\n");
+	conn.send(rsp);
+}
+
+void mock_pool::log_event(size_t conn, const char* event, const std::string& jobId, const char* nonce, const char* status, uint64_t iLatencyUs)
+{
+	if(fLog == nullptr)
+		return;
+
+	std::lock_guard<std::mutex> lck(log_mutex);
+	fprintf(fLog, "%llu,%llu,%s,%s,%s,%s,%llu\n", int_port(now_us()), int_port(conn), event, jobId.c_str(), nonce, status, int_port(iLatencyUs));
+}
+
+void mock_pool::print_stats(uint64_t iSec)
+{
+	size_t iConns;
+	{
+		std::lock_guard<std::mutex> lck(conn_mutex);
+		iConns = conns.size();
+	}
+
+	uint64_t iTotal = iShares.load();
+	printf("[%6llus] conns %llu | jobs %llu | shares %llu ok %llu stale %llu (%.2f %%) invalid %llu low diff %llu duplicate %llu unknown job %llu\n",
+		int_port(iSec), int_port(iConns), int_port(iJobCnt.load()), int_port(iTotal), int_port(iSharesOk.load()),
+		int_port(iSharesStale.load()), iTotal != 0 ? 100.0 * iSharesStale.load() / iTotal : 0.0, int_port(iSharesInvalid.load()),
+		int_port(iSharesLowDiff.load()), int_port(iSharesDuplicate.load()), int_port(iSharesUnknown.load()));
+
+	auto print_histogram = [](const char* name, const xmrstak::histogram& h) {
+		if(h.count() == 0)
+			return;
+		printf("          %-18s p50 %9.2f ms | p90 %9.2f ms | p99 %9.2f ms | max %9.2f ms | count %llu\n", name,
+			h.quantile(0.5) / 1000.0, h.quantile(0.9) / 1000.0, h.quantile(0.99) / 1000.0, h.max() / 1000.0, int_port(h.count()));
+	};
+	print_histogram("job to first share", oFirstShare);
+	print_histogram("share verify", oVerify);
+	print_histogram("share reply", oReply);
+
+	if(fLog != nullptr)
+	{
+		std::lock_guard<std::mutex> lck(log_mutex);
+		fflush(fLog);
+	}
+	fflush(stdout);
+}
+
+void help(const char* name)
+{
+	using namespace std;
+	cout<<"Usage: "<<name<<" [OPTION]..."<<endl;
+	cout<<" "<<endl;
+	cout<<"Stratum pool for local tests of the miner, the shares are verified with the CPU."<<endl;
+	cout<<" "<<endl;
+	cout<<"  -h, --help                 show this help"<<endl;
+	cout<<"  --port PORT                plain stratum port, default: 3333"<<endl;
+	cout<<"  --tls-port PORT            TLS stratum port, default: 0 (disabled)"<<endl;
+	cout<<"  --cert FILE --key FILE     TLS certificate and key in PEM format,"<<endl;
+	cout<<"                             default: a generated self signed certificate"<<endl;
+	cout<<"  --algo NAME                algorithm of the shares, default: cryptonight_v7"<<endl;
+	cout<<"  --diff DIFF                difficulty of the jobs, default: 1000"<<endl;
+	cout<<"  --job-interval MS          time between two jobs, 0 sends only a job on login,"<<endl;
+	cout<<"                             default: 30000"<<endl;
+	cout<<"  --blob-version VERSION     major block version in the job blob, default: 7"<<endl;
+	cout<<"  --no-verify                check only the difficulty of the result, not the hash"<<endl;
+	cout<<"  --log FILE                 write all events with a timestamp as CSV to FILE"<<endl;
+	cout<<"  --stats SEC                print the statistic every SEC seconds, default: 10"<<endl;
+	cout<<"  --duration SEC             exit after SEC seconds, default: 0 (run forever)"<<endl;
+	cout<<" "<<endl;
+	cout<<"Supported algorithms:"<<endl;
+	for(const algo_name& a : algos)
+		cout<<"  "<<a.name<<endl;
+}
+
+bool read_number(int argc, char* argv[], int& i, uint64_t& value, uint64_t min, uint64_t max)
+{
+	std::string opName(argv[i]);
+	if(++i >= argc)
+	{
+		printf("No argument for parameter '%s' given\n", opName.c_str());
+		return false;
+	}
+
+	char* endp = nullptr;
+	unsigned long long v = strtoull(argv[i], &endp, 10);
+	if(endp == argv[i] || *endp != '\0' || v < min || v > max)
+	{
+		printf("'%s' must be a number in the range [%llu,%llu]\n", opName.c_str(), int_port(min), int_port(max));
+		return false;
+	}
+	value = v;
+	return true;
+}
+
+bool read_string(int argc, char* argv[], int& i, std::string& value)
+{
+	if(i + 1 >= argc)
+	{
+		printf("No argument for parameter '%s' given\n", argv[i]);
+		return false;
+	}
+	value = argv[++i];
+	return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+#ifndef CONF_NO_TLS
+	SSL_library_init();
+	SSL_load_error_strings();
+	OpenSSL_add_all_algorithms();
+#endif
+
+	mock_options opt;
+	for(int i = 1; i < argc; ++i)
+	{
+		std::string opName(argv[i]);
+		uint64_t value = 0;
+		bool ok = true;
+
+		if(opName == "-h" || opName == "--help")
+		{
+			help(argv[0]);
+			return 0;
+		}
+		else if(opName == "--port")
+		{
+			ok = read_number(argc, argv, i, value, 1, 65535);
+			opt.port = (int)value;
+		}
+		else if(opName == "--tls-port")
+		{
+			ok = read_number(argc, argv, i, value, 0, 65535);
+			opt.tlsPort = (int)value;
+		}
+		else if(opName == "--cert")
+			ok = read_string(argc, argv, i, opt.certFile);
+		else if(opName == "--key")
+			ok = read_string(argc, argv, i, opt.keyFile);
+		else if(opName == "--algo")
+			ok = read_string(argc, argv, i, opt.algoName);
+		else if(opName == "--diff")
+			ok = read_number(argc, argv, i, opt.diff, 1, UINT64_MAX);
+		else if(opName == "--job-interval")
+			ok = read_number(argc, argv, i, opt.jobIntervalMs, 0, UINT32_MAX);
+		else if(opName == "--blob-version")
+		{
+			ok = read_number(argc, argv, i, value, 0, 255);
+			opt.blobVersion = (uint8_t)value;
+		}
+		else if(opName == "--no-verify")
+			opt.verify = false;
+		else if(opName == "--log")
+			ok = read_string(argc, argv, i, opt.logFile);
+		else if(opName == "--stats")
+			ok = read_number(argc, argv, i, opt.statsSec, 1, UINT32_MAX);
+		else if(opName == "--duration")
+			ok = read_number(argc, argv, i, opt.durationSec, 0, UINT32_MAX);
+		else
+		{
+			printf("Parameter unknown '%s'\n", argv[i]);
+			ok = false;
+		}
+
+		if(!ok)
+			return 1;
+	}
+
+	if(opt.certFile.empty() != opt.keyFile.empty())
+	{
+		printf("'--cert' and '--key' have to be used together\n");
+		return 1;
+	}
+
+	mock_pool pool(opt);
+	if(!pool.start())
+		return 1;
+
+	uint64_t iSec = 0;
+	while(opt.durationSec == 0 || iSec < opt.durationSec)
+	{
+		uint64_t iSleep = opt.statsSec;
+		if(opt.durationSec != 0)
+			iSleep = std::min(iSleep, opt.durationSec - iSec);
+		std::this_thread::sleep_for(std::chrono::seconds(iSleep));
+		iSec += iSleep;
+		pool.print_stats(iSec);
+	}
+
+	return 0;
+}